@@ -33,6 +33,28 @@ class CSVread
 class CSVwrite
 - A class to write comma separated values to a stream.
 
+class CSVaggregate
+- A class to count/sum/min/max a column grouped by another column, reading records from CSVread.
+
+class CSVcache
+- A class to convert CSV to a binary columnar file once and then read its records memory mapped.
+
+class CSVdistribute
+- A class to parse records with CSVread and process them on worker threads. It requires C++11 and
+is documented in CSVdistribute.hpp.
+
+class CSVasyncwrite
+- A class with the writing interface of CSVwrite that writes to its file/ostream on a background I/O
+thread. It requires C++11 and is documented in CSVasyncwrite.hpp.
+
+class CSVparallelwrite
+- A class to format batches of records on worker threads and write them in order with CSVwrite. It
+requires C++11 and is documented in CSVparallelwrite.hpp.
+
+class CSVdurablewrite
+- A class to append records to a file so that they survive a crash, committing them in groups. It
+requires C++11 and is documented in CSVdurablewrite.hpp.
+
 
 These classes use libcsv --a powerful well written C library-- to parse the CSV records. Libcsv will
 parse binary CSV data. If you pass in a filename it is opened in binary mode unless you specify the
@@ -56,6 +78,10 @@ car.description = csv.fields[ 3 ];
 Process(car);
 }
 
+Or describe the fields of Car once by specializing CSVfields<Car> and the loop is
+while( csv.ReadStruct( car ) ) Process(car);
+which checks the number of fields and converts them. Refer to CSVread::ReadStruct().
+
 For more examples refer to ..\Example\Example.sln
 */
 
@@ -63,10 +89,15 @@ For more examples refer to ..\Example\Example.sln
 #define JAY_UTIL_CSV_HPP_
 
 #include <stdint.h>
+#include <time.h>
 
+#include <cstddef>
+#include <deque>
 #include <fstream>
+#include <iterator>
 #include <list>
 #include <string>
+#include <utility>
 #include <vector>
 
 
@@ -76,6 +107,70 @@ namespace jay {
 namespace util {
 
 
+struct cb_stuff;
+struct gzip_state;
+class utf16_transcoder;
+class range_streambuf;
+
+
+
+/* A dictionary of interned strings.
+
+Each distinct string added to the dictionary is stored once and identified by a small integer code,
+assigned in the order the strings are first added starting from 0. The string for a code is at a
+stable address for as long as the dictionary isn't cleared, so you may keep pointers to it.
+
+Strings are found by hashing their bytes once into an open addressing table. CSVread uses this to
+intern fields; refer to CSVread::SetInterned().
+*/
+class CSVdictionary
+{
+public:
+    // The code that is never assigned to a string, eg the code of a field that isn't interned.
+    static const uint32_t no_code = 0xFFFFFFFF;
+
+    CSVdictionary();
+
+    /* Add a string if it isn't already in the dictionary.
+
+    [ret] The code of the string. If the dictionary is full (no_code strings) then no_code.
+    */
+    uint32_t Intern( const char *data, size_t size );
+    uint32_t Intern( const std::string &s ) { return Intern( s.data(), s.size() ); }
+
+    /* Find a string.
+
+    [ret] The code of the string, or no_code if it isn't in the dictionary.
+    */
+    uint32_t Find( const char *data, size_t size ) const;
+    uint32_t Find( const std::string &s ) const { return Find( s.data(), s.size() ); }
+
+    // The string for 'code'. 'code' must be less than size().
+    const std::string &operator[]( uint32_t code ) const { return _strings[ code ]; }
+
+    // The number of strings in the dictionary.
+    size_t size() const { return _strings.size(); }
+
+    // Remove all strings. All codes and pointers to strings are invalidated.
+    void Clear();
+
+private:
+    // The table slot where the string is, or the empty slot where it would be inserted.
+    size_t Slot( const char *data, size_t size, uint64_t hash ) const;
+
+    // Double the number of slots in the table.
+    void Grow();
+
+    // The strings, indexed by code. A deque never moves its elements when it grows.
+    std::deque<std::string> _strings;
+
+    // The hash of each string, indexed by code.
+    std::vector<uint64_t> _hashes;
+
+    // The open addressing table of codes. Empty slots are no_code. The size is a power of 2.
+    std::vector<uint32_t> _slots;
+};
+
 
 class CSVread
 {
@@ -149,6 +244,11 @@ public:
 
         If a field contains null bytes those bytes are considered part of the field by default. A
         field is exposed as std::string, and it may be undesirable to allow NULL bytes in a string.
+
+        If this flag is set a field that contains a null byte is an error and 'error_msg' has the
+        record, field and byte offset in the field of the first null byte. Each chunk read from the
+        stream is searched once before it's parsed and fields are only searched after a null byte
+        has been found, so the flag costs little when there are none.
         */
         error_on_null_in_field = 1 << 3,
 
@@ -164,7 +264,74 @@ public:
         An error will occur if you use this flag when associating an existing istream. This is
         subject to change, should I decide to roll my own translation someday for binary streams.
         */
-        text_mode = 1 << 4
+        text_mode = 1 << 4,
+
+
+        /* Validate UTF-8.
+
+        Each field is validated as UTF-8 as it's parsed, so there is no need for a second pass
+        over the fields after ReadRecord(). If a field is not valid UTF-8 it's an error and
+        'error_msg' has the record, field and byte offset in the field of the first invalid
+        sequence. Overlong encodings, surrogates and code points > U+10FFFF are invalid.
+
+        Like 'error_on_null_in_field' only fields that are stored in the cache are checked. A
+        record skipped over by requesting a later record number is not validated.
+        */
+        validate_utf8 = 1 << 5,
+
+
+        /* Transcode UTF-16 to UTF-8.
+
+        If the stream starts with a UTF-16 BOM (little or big endian) the stream is transcoded to
+        UTF-8 before it's parsed and 'has_utf16_bom' is set. The fields are UTF-8. An unpaired
+        surrogate in the stream is an error.
+
+        Without a BOM there is no way to tell whether a stream is UTF-16 and it's parsed as is.
+
+        Since the delimiter, quote and terminator are parsed after transcoding they are unaffected
+        by this flag.
+        */
+        transcode_utf16 = 1 << 6,
+
+
+        /* Sniff the dialect.
+
+        The delimiter and quote character are detected from the first chunk of the stream, the same
+        chunk that is read by Open()/Associate() to check for the BOM. Nothing extra is read from
+        the stream and nothing is read twice. The size of the chunk is 'buffer_size' (up to 64KB
+        of it is examined), so if you want a bigger sample call ResizeBuffer() before Open().
+
+        The delimiters , ; \t | and the quote characters " ' are tried, and the combination that
+        parses the sample into the most consistent number of fields per record (more than one)
+        is chosen as if SetDelimiter() and SetQuote() had been called. If no combination parses
+        into more than one field the delimiter and quote character are unchanged. Either way you
+        can call GetDelimiter() and GetQuote() afterwards to see what's being used.
+
+        If the records in the sample are terminated only by CR (no LF or CRLF) then CR is treated
+        as a terminator even if flag 'process_empty_records' is set.
+        */
+        sniff_dialect = 1 << 7,
+
+
+        /* Unescape quoted fields when they're accessed rather than when they're parsed.
+
+        A quoted field that has escaped quotes ("") is normally unescaped as it's parsed. With this
+        flag it's kept as it is in the stream, including the quotes around it, until Field() is
+        called for it. Field() unescapes it in place in 'fields', so it's only done once. A record
+        that's skipped, or that's read only in part, doesn't pay for unescaping fields that aren't
+        accessed.
+
+        In 'fields' a field that begins with the quote character is still escaped, so call
+        Field( i ) instead of using fields[ i ] to get the field's value. A field that's unescaped as
+        it's parsed, eg by libcsv, and begins with the quote character is escaped again to keep to
+        that. ReleaseFields(), ReadStruct(), BindHeader(), interning, CSVaggregate, CSVcache and
+        CSVdistribute and the record iterator unescape the fields they use.
+
+        Only the parsers for the common dialects keep fields escaped; refer to 'parse_obj'. If flag
+        'validate_utf8' is set, or 'error_on_null_in_field' is and there's a null byte in the
+        stream, fields are unescaped as they're parsed so they can be checked.
+        */
+        lazy_unescape = 1 << 8
     };
 
 
@@ -194,6 +361,7 @@ public:
     Resets most variables, calls ResetParser() and ResetCache().
 
     The delimiter is not reset. To reset the delimiter call SetDelimiter( ',' ).
+    The quote character is not reset. To reset the quote character call SetQuote( '"' ).
     The size of the buffer is not reset. To reset the size of the buffer call ResizeBuffer().
 
     If the file/istream is open/associated it's clear()'d, then its position is reset. If the
@@ -235,7 +403,9 @@ public:
 
     If the stream starts with a UTF-8 BOM those bytes are ignored unless flag
     CSVread::skip_utf8_bom_check is passed. There is no UTF-8 processing done on the stream
-    either way; the check is just to identify and then ignore the BOM if present.
+    either way; the check is just to identify and then ignore the BOM if present. If flag
+    CSVread::transcode_utf16 is passed and the stream starts with a UTF-16 BOM then those bytes are
+    ignored and the stream is transcoded to UTF-8.
 
     Once the stream has been opened you may call ReadRecord() to retrieve each record.
 
@@ -248,11 +418,49 @@ public:
     [in] 'stream' : An istream already opened for input.
     [in][opt] 'flags' : Refer to CSVread::Flags. The default is no flags are set.
     [ret][failure] (false) : 'error' and 'error_msg' are set.
-    [ret][success] (true) : 'has_utf8_bom' may be set.
+    [ret][success] (true) : 'has_utf8_bom' or 'has_utf16_bom' may be set.
     */
     bool Open( std::string filename, Flags flags = none );
     bool Associate( std::istream *stream, Flags flags = none );
 
+    // The flags passed to Open()/Associate().
+    Flags GetFlags() const { return _flags; }
+
+
+    /* CSVread::OpenRange()
+    - Open the records of a file that start in a byte range.
+
+    This is for dividing a very large file between several readers, eg processes or threads that
+    each open a consecutive range such as [0, n), [n, 2n), [2n, 3n) and so on up to the file size.
+    Every record is read by exactly one of them.
+
+    A record belongs to the range its first byte is in. The range is extended to record boundaries:
+    it starts at the first line start at or after 'begin', and ends at the first line start at or
+    after 'end', so the record that straddles 'end' is the last one read. A line start is the first
+    byte of the file or a byte after LF, CRLF or a CR not followed by LF. The actual boundaries are
+    in 'range_begin' and 'range_end'.
+
+    Since record boundaries are found by looking for line endings the file must not have fields
+    that contain CR or LF at a boundary, or a range could end (and the next one start) in the
+    middle of a quoted field. If a range ends inside a quoted field then reading the record split
+    by it fails: the records before it are read and then ReadRecord() fails with an error.
+
+    The records are numbered from 1 within the range. The file is opened in binary mode, and a UTF-8
+    BOM is checked for only if the range starts at byte 0. Flags 'text_mode' and 'transcode_utf16'
+    are not valid.
+
+    If this function fails for any reason you must call Close() to reset before trying again.
+
+    [in] 'filename' : A file to open for input.
+    [in] 'begin' : The byte offset of the beginning of the range.
+    [in] 'end' : The byte offset of the end of the range, not included. Must be >= 'begin'. If it's
+        past the end of the file the range ends at the end of the file.
+    [in][opt] 'flags' : Refer to CSVread::Flags. The default is no flags are set.
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true)
+    */
+    bool OpenRange( std::string filename, uint64_t begin, uint64_t end, Flags flags = none );
+
 
     /* CSVread::GetDelimiter(), CSVread::SetDelimiter()
     - Get or set the delimiter character to be used when parsing the stream.
@@ -273,6 +481,46 @@ public:
     void SetDelimiter( unsigned char delim );
 
 
+    /* CSVread::GetQuote(), CSVread::SetQuote()
+    - Get or set the quote character to be used when parsing the stream.
+
+    The default quote character is a double quote and does not need to be set.
+
+    The quote character is persistent and will survive resets. It doesn't need to be set on each
+    open.
+    */
+    unsigned char GetQuote();
+    void SetQuote( unsigned char quote );
+
+
+    /* CSVread::SetInterned(), CSVread::IsInterned(), CSVread::ClearDictionary()
+    - Intern the fields of a column.
+
+    Interning is for columns that have few distinct values over many records, eg country, status or
+    currency. When ReadRecord() succeeds, each field in an interned column is looked up in
+    'dictionary' by hashing its bytes once, added if it's not already there, and its code is put
+    in 'codes'. A table built from CSVread can then store the 4 byte code instead of a string, and
+    the code makes a cheap key to compare, sort or group by. The string for a code is at a stable
+    address in 'dictionary' for the life of the object, so a pointer to it can be kept as well.
+
+    An interned field is looked up straight from the parser's buffer and isn't copied to 'fields':
+    fields[i] is empty until Field( i ) copies the string from 'dictionary'. So for an interned
+    column use Field( i ) or the code rather than fields[i]. ReleaseFields() and the record iterator
+    copy them first. All columns share one dictionary and a code is the same string regardless of
+    column.
+
+    The interned columns and the dictionary are persistent and survive resets. The codes remain
+    valid across Close() and Open(), so records from several files can share the dictionary. To
+    empty the dictionary call ClearDictionary(), which invalidates every code.
+
+    [in] 'column' : The index of the column in 'fields', eg 0 for the first column.
+    [in][opt] 'interned' : Whether or not the column is interned. The default is true.
+    */
+    void SetInterned( size_t column, bool interned = true );
+    bool IsInterned( size_t column ) const;
+    void ClearDictionary();
+
+
     /* CSVread::ReadRecord()
     - Read and parse a record.
 
@@ -300,6 +548,211 @@ public:
     bool ReadRecord( const uintmax_t requested_record_num = 0 );
 
 
+    // A record parsed into fields. This is the type of 'fields'.
+    typedef std::vector<std::string> Record;
+
+
+    /* CSVread::Field()
+    - Get a field of the current record.
+
+    This is fields[ index ]. If flag 'lazy_unescape' is set and the field is still escaped then it's
+    unescaped in 'fields' first. If the column is interned the field is copied to 'fields' from
+    'dictionary' first; refer to SetInterned().
+
+    [in] 'index' : The index of the field in 'fields'. Must be less than fields.size().
+    [ret] The field.
+    */
+    const std::string &Field( size_t index );
+
+
+    /* CSVread::ReleaseFields()
+    - Move the current record out of 'fields' without copying it.
+
+    The fields of the current record are swapped into 'record' and 'fields' is left empty. No field
+    is copied; the strings are handed over with their buffers intact. 'record_num' is unchanged.
+
+    This is the cheap way to retain records, for example when building an in-memory table:
+
+    std::list<CSVread::Record> table;
+    while( csv.ReadRecord() )
+    {
+    table.push_back( CSVread::Record() );
+    csv.ReleaseFields( table.back() );
+    }
+
+    If flag 'lazy_unescape' is set the fields that are still escaped are unescaped first, and the
+    fields of interned columns are copied from 'dictionary' first.
+
+    [out] 'record' : Receives the fields of the current record. Any previous contents are discarded.
+    */
+    void ReleaseFields( Record &record );
+
+
+    /* Reads each field of a record into a member of a struct. It's passed to CSVfields<T>::Visit()
+    by ReadStruct() and BindHeader(). Calling it with a member converts the field for it with the
+    overload of ConvertField() for the member's type, chosen at compile time.
+
+    The Nth call is for column N, or for the column bound to it by BindHeader(). A name passed with a
+    member is what BindHeader() looks for in the header, and is in the error message if the field is
+    missing or not valid.
+    */
+    class FieldReader
+    {
+    public:
+        // The C locale's decimal point is looked up once here rather than for each number.
+        FieldReader( CSVread &csv, bool bind ) :
+            _csv( csv ), _bind( bind ), _index( 0 ), _point( DecimalPoint() ) {}
+
+        template< class F >
+        void operator()( F &member ) { Field( member, NULL ); }
+
+        template< class F >
+        void operator()( F &member, const char *name ) { Field( member, name ); }
+
+    private:
+        template< class F >
+        void Field( F &member, const char *name )
+        {
+            const size_t index = _index++;
+
+            if( _csv._error )
+                return;
+
+            if( _bind )
+            {
+                _csv.BindColumn( index, name );
+                return;
+            }
+
+            const char *data;
+            size_t size;
+
+            if( _csv.FieldOf( index, name, data, size )
+                && !ConvertField( data, size, _point, member ) )
+            {
+                _csv.FieldInvalid( index, name, data, size );
+            }
+        }
+
+        CSVread &_csv;
+        bool _bind;
+        size_t _index;
+        std::string _point;
+    };
+
+
+    /* CSVread::ReadStruct()
+    - Read a record into a struct.
+
+    The fields of T are described once by specializing CSVfields<T>, which is documented with
+    CSVwrite::WriteStruct(). The same description works for both if its Visit() is a template.
+
+    The record is read by ReadRecord() and then each field is converted straight from its bytes into
+    its member: a std::string is copied, an integer is parsed digit by digit with a range check, and
+    a float or double is parsed by strtof() or strtod() but with a period for the decimal point,
+    whatever the C locale's is, which is looked up once per call. A number must be the whole field,
+    with no whitespace; '+' or '-' may come first. A number out of range for its member is invalid,
+    except that infinity and NaN are valid for a float or double.
+
+    The bytes of a field of an interned column are read from 'dictionary', and with flag
+    'lazy_unescape' a quoted field is read from inside its quotes if it has none to unescape, so
+    neither is copied to 'fields' first.
+
+    A field that's missing or isn't valid for its member is an error, as with flag
+    'error_on_null_in_field', and 'error_msg' has the record number, field number and member name.
+    The members before it have been set.
+
+    [out] 'record' : The struct.
+    [ret][failure] (false) : 'error' and 'error_msg' are set; or as ReadRecord().
+    [ret][success] (true) : 'record', 'record_num' and 'fields' are set.
+    */
+    template< class T >
+    bool ReadStruct( T &record );
+
+
+    /* CSVread::BindHeader()
+    - Read the header record and bind the members of a struct to its columns by name.
+
+    Every member in CSVfields<T>::Visit() must be passed with its name, eg field( car.year, "year" ),
+    and the header must have a column of that name. From then on ReadStruct() reads each member from
+    its column, whatever the order of the columns in the file. The names are only looked up here.
+
+    The binding is for this stream; Close() removes it. T must be default constructible.
+
+    [ret][failure] (false) : 'error' and 'error_msg' are set; or as ReadRecord().
+    [ret][success] (true) : 'fields' is the header.
+    */
+    template< class T >
+    bool BindHeader();
+
+
+    /* CSVread::iterator, CSVread::begin(), CSVread::end()
+    - Input iterator over the records.
+
+    begin() calls ReadRecord() to read the next record and returns an iterator to it, or end() if
+    ReadRecord() failed. Incrementing the iterator calls ReadRecord() again, and once it fails the
+    iterator compares equal to end(). This is the same as the usual ReadRecord() loop, so after
+    the loop is done the error and end record information is tested the same way:
+
+    for( CSVread::iterator it = csv.begin(); it != csv.end(); ++it )
+    {
+    // *it is 'fields', the current record. It may be moved from to take its buffers, eg
+    // table.push_back( std::move( *it ) );
+    }
+
+    if( !csv.eof || ( csv.record_num != csv.end_record_num ) )
+    { handle it. not all records were read, check error_msg }
+
+    Dereferencing gives a modifiable reference to the current record (the same record exposed by
+    'fields'). Its fields are unescaped and the interned fields copied from 'dictionary' first, as
+    ReleaseFields() does, so each is the field's value whatever the flags. Moving from it or
+    swapping it out is allowed and is the intended way to retain the record without copying; the
+    next increment replaces it with the next record. As with any input iterator, all copies of an
+    iterator refer to the same position; incrementing one of them advances the CSVread object.
+
+    If 'error' is already set begin() returns end().
+    */
+    class iterator
+    {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef Record value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef Record *pointer;
+        typedef Record &reference;
+
+        iterator() : _csv( NULL ) {}
+
+        reference operator*() const { _csv->UnescapeFields(); return _csv->_fields; }
+        pointer operator->() const { _csv->UnescapeFields(); return &_csv->_fields; }
+
+        iterator & operator++()
+        {
+            if( !_csv->ReadRecord() )
+            {
+                _csv = NULL;
+            }
+            return *this;
+        }
+
+        // Postfix increment returns nothing, since the previous record no longer exists.
+        void operator++( int ) { ++*this; }
+
+        bool operator==( const iterator &other ) const { return _csv == other._csv; }
+        bool operator!=( const iterator &other ) const { return _csv != other._csv; }
+
+    private:
+        friend class CSVread;
+        explicit iterator( CSVread *csv ) : _csv( csv ) {}
+
+        // The object the records are read from, or NULL if this is the end iterator.
+        CSVread *_csv;
+    };
+
+    iterator begin() { return ReadRecord() ? iterator( this ) : iterator(); }
+    iterator end() { return iterator(); }
+
+
     /* Change the size of the buffer, in bytes.
 
     The buffer exists for the life of the object. It has a default size of 4096 bytes and is used to
@@ -337,11 +790,33 @@ public:
     // File/istream has a UTF-8 BOM
     const bool &has_utf8_bom; // = _has_utf8_bom
 
+    // File/istream has a UTF-16 BOM and is transcoded to UTF-8. Refer to flag 'transcode_utf16'.
+    const bool &has_utf16_bom; // = _has_utf16_bom
+
+    // The byte offsets in the file of the records read, [range_begin, range_end).
+    // These are only set if the file was opened by OpenRange(), otherwise they're 0.
+    const uint64_t &range_begin; // = _range_begin
+    const uint64_t &range_end; // = _range_end
+
     // The record number of the current record.
     // The first CSV record is record number 1.
     const uintmax_t &record_num; // = _record_num
 
 
+    /* The byte offset of the current record.
+
+    This is the offset of the start of the line the record begins on, ie just past the line ending
+    of the record before it or of the blank line before it, or the start of the stream (the BOM is
+    part of the first line). For a file opened by OpenRange() it's the offset in the file, so the
+    first record of a range is at 'range_begin', or after it if blank lines before it are skipped.
+    Reading from this offset would read this record first.
+
+    It's the offset in the bytes that are parsed, so it's not the offset in the file in text mode or
+    if a UTF-16 stream is transcoded. It's 0 if there's no current record.
+    */
+    const uint64_t &record_offset; // = _record_offset
+
+
     /* The record number of the end record.
 
     This is set if 'eof' is true and all records were parsed successfully.
@@ -393,6 +868,18 @@ public:
     const std::vector<std::string> &fields; // = _fields
 
 
+    /* The codes of the current record's fields in 'dictionary'.
+
+    If any column is interned then codes.size() == fields.size() and codes[i] is the code of
+    fields[i] in 'dictionary', or CSVdictionary::no_code if column i is not interned. If no column
+    is interned this is empty. Refer to SetInterned().
+    */
+    const std::vector<uint32_t> &codes; // = _codes
+
+    // The strings of the interned fields. Refer to SetInterned().
+    const CSVdictionary &dictionary; // = _dictionary
+
+
     /* The libcsv parse object.
 
     You may use this to set more advanced behavior.
@@ -401,9 +888,19 @@ public:
 
     Do not call these functions on parse_obj:
     csv_init(), csv_set_opts(), csv_parse(), csv_fini(), csv_free(), csv_get_delim(),
-    csv_set_delim().
+    csv_set_delim(), csv_get_quote(), csv_set_quote().
 
     To get/set the delimiter call Get/SetDelimiter() instead.
+    To get/set the quote character call Get/SetQuote() instead.
+
+    Fields are parsed from the read buffer without copying when possible. If you set your own
+    space or terminator function (csv_set_space_func(), csv_set_term_func()) or option
+    CSV_APPEND_NULL then every field is copied character by character by libcsv, which is slower.
+
+    If the delimiter is a comma, semicolon or tab and the quote character is a double quote then
+    the records are parsed into parse_obj by a parser specialized for that dialect instead of by
+    csv_parse(). The results are the same. If you set your own space or terminator function or any
+    option then libcsv parses the chunks read after that.
 
     If 'error' parse_obj is not guaranteed != NULL or a good state; don't call any libcsv function.
     */
@@ -417,9 +914,32 @@ private:
     // Call this to reset parse_obj.
     bool ResetParser();
 
+    // Parse a chunk of data read from the stream, transcoding it first if it's UTF-16.
+    // On error '_error_pending' and '_error_msg' are set.
+    void ParseChunk( const char *data, size_t size, cb_stuff &args );
+
+    // The parser ParseChunk() calls, which has the signature of libcsv's csv_parse(). It's either a
+    // parser specialized for the dialect or csv_parse() itself. Refer to SelectParser().
+    size_t ( *_parse )( struct ::csv_parser *p, const void *s, size_t len,
+        void ( *cb1 )( void *, size_t, void * ), void ( *cb2 )( int, void * ), void *data );
+
+    // Select '_parse' for the delimiter, quote character and options of parse_obj.
+    void SelectParser();
+
+    // The number of bytes at the beginning of the stream that are a BOM.
+    std::streamoff BOMSize() const;
+
+    // Whether or not the stream is a range that ends before the end of the file, and it ends inside
+    // a quoted field. Refer to OpenRange().
+    bool RangeEndsInQuotedField() const;
+
     // A file stream if one was opened by this class.
     std::ifstream _file;
 
+    // The byte range of _file if it was opened by OpenRange(), otherwise NULL.
+    range_streambuf *_range_buf;
+    std::istream *_range_stream;
+
     // The stream the records are read from.
     // This points to the user specified istream or _file.
     std::istream *_input_ptr;
@@ -430,8 +950,30 @@ private:
     // To clear this list call ResetCache(), which starts a new list with an empty back element.
     std::list<std::vector<std::string>> _cache;
 
-    // Call this to reset _cache.
-    // The new list starts with one empty vector as the pending record.
+    // What's known about a record in _cache other than its fields.
+    struct cache_info
+    {
+        cache_info() : offset( no_offset ) {}
+
+        // The offset of a record whose first field or terminator hasn't been parsed yet.
+        static const uint64_t no_offset = ~(uint64_t)0;
+
+        // The codes of the interned fields. An interned field is left empty in _cache and its code
+        // is here instead, or no_code if it wasn't interned. Empty if it has no interned fields.
+        std::vector<uint32_t> codes;
+
+        // The byte offset of the record. Refer to 'record_offset'.
+        uint64_t offset;
+    };
+
+    // The info of each record in _cache, in step with it.
+    std::list<cache_info> _info_cache;
+
+    // The callbacks add records to _cache and _info_cache.
+    friend struct cb_stuff;
+
+    // Call this to reset _cache and _info_cache.
+    // The new lists start with one empty vector as the pending record.
     void ResetCache();
 
     // Whether or not an error is pending. Sometimes this is set instead of '_error' if there are
@@ -448,16 +990,108 @@ private:
     // The field separator character.
     unsigned char _delimiter; // = ,
 
+    // The quote character.
+    unsigned char _quote; // = "
+
+    // Whether or not the dialect is to be sniffed from the next chunk parsed.
+    bool _sniff_pending;
+
+    // Whether or not CR is the record terminator, as sniffed. Refer to flag 'sniff_dialect'.
+    bool _cr_terminated;
+
+    // Whether or not a null byte has been found in the stream since the parser was reset.
+    // Only set if flag 'error_on_null_in_field'.
+    bool _null_seen;
+
+    // Set the codes of the current record from the codes 'cached' with it in _info_cache, and
+    // intern the fields that weren't. Refer to SetInterned().
+    void InternFields( const std::vector<uint32_t> &cached );
+
+    // Copy the fields of the current record that have codes from the dictionary to 'fields'.
+    void CopyInternedFields();
+
+    /* Unescape the fields of the current record that are still escaped and copy the interned fields
+    from the dictionary, so that each of 'fields' is the field's value. This is for the record
+    iterator and ReleaseFields(), whose callers use the fields without Field().
+    */
+    void UnescapeFields();
+
+    // Whether or not each column is interned, indexed by column.
+    std::vector<bool> _interned;
+
+    // Whether or not each field of the current record has been unescaped by Field(), indexed by
+    // field. A field past the end hasn't been. Only used with flag 'lazy_unescape'.
+    std::vector<bool> _unescaped;
+
+    // The column of each member in ReadStruct(), in order, from BindHeader(). Empty if the members
+    // are read in column order.
+    std::vector<size_t> _columns;
+
+    // Bind member number 'index' to the column of the current record, the header, named 'name'.
+    void BindColumn( size_t index, const char *name );
+
+    /* The unescaped bytes of the field for member number 'index', without copying it to 'fields' if
+    it can be helped. Refer to ReadStruct().
+    [ret][failure] (false) : The record doesn't have the field. 'error' and 'error_msg' are set.
+    [ret][success] (true) : 'data' and 'size' are set. 'data' isn't null terminated.
+    */
+    bool FieldOf( size_t index, const char *name, const char *&data, size_t &size );
+
+    // Set the error for the field of member number 'index' not being valid for the member.
+    void FieldInvalid( size_t index, const char *name, const char *data, size_t size );
+
+    // The C locale's decimal point, for ConvertField().
+    static std::string DecimalPoint();
+
+    /* Convert the bytes of a field for a member of ReadStruct(). 'point' is from DecimalPoint().
+    [ret][failure] (false) : The field isn't valid for the type.
+    [ret][success] (true) : 'value' is set.
+    */
+    static bool ConvertField( const char *data, size_t size, const std::string &point,
+        std::string &value );
+    static bool ConvertField( const char *data, size_t size, const std::string &point,
+        int &value );
+    static bool ConvertField( const char *data, size_t size, const std::string &point,
+        long &value );
+    static bool ConvertField( const char *data, size_t size, const std::string &point,
+        long long &value );
+    static bool ConvertField( const char *data, size_t size, const std::string &point,
+        unsigned &value );
+    static bool ConvertField( const char *data, size_t size, const std::string &point,
+        unsigned long &value );
+    static bool ConvertField( const char *data, size_t size, const std::string &point,
+        unsigned long long &value );
+    static bool ConvertField( const char *data, size_t size, const std::string &point,
+        float &value );
+    static bool ConvertField( const char *data, size_t size, const std::string &point,
+        double &value );
+
+    // The UTF-16 transcoder state and the UTF-8 output of the chunk being parsed.
+    // These are only used if '_has_utf16_bom'.
+    utf16_transcoder *_utf16;
+    std::string _transcoded;
+
     // For a description of any of these refer to their public const references.
     std::streamsize _buffer_size;
     bool _eof;
     bool _error;
     std::string _error_msg;
     bool _has_utf8_bom;
+    bool _has_utf16_bom;
+    uint64_t _range_begin;
+    uint64_t _range_end;
     uintmax_t _record_num;
+    uint64_t _record_offset;
+
+    // The byte offset of the next chunk to parse, and of the start of the line after the last line
+    // ending parsed before it. Refer to 'record_offset'.
+    uint64_t _chunk_offset;
+    uint64_t _line_offset;
     uintmax_t _end_record_num;
     bool _end_record_not_terminated;
     std::vector<std::string> _fields;
+    std::vector<uint32_t> _codes;
+    CSVdictionary _dictionary;
 
     // Initialization to be called from the constructor only.
     bool Init();
@@ -515,7 +1149,22 @@ public:
         WriteTerminator() without first writing a field or record then you have written an empty
         record, regardless of whether or not this flag is used.
        */
-        process_empty_records = 1 << 2
+        process_empty_records = 1 << 2,
+
+        /* Quote only the fields that need it.
+
+        By default every field is qualified with double quotes. With this flag a field is written
+        without quotes unless it would not be read back the same without them, which is when it:
+        - contains a double quote, CR or LF
+        - contains a character of the delimiter or terminator other than whitespace, or any of their
+        characters if they are all whitespace
+        - starts or ends with a space or tab, which CSVread would trim
+        - starts with byte EF, so it can't be mistaken for a UTF-8 BOM
+        - is empty and the first field of the record, since an empty record has no fields
+
+        Typically most fields don't need quotes, so the output is smaller and faster to read.
+        */
+        minimal_quoting = 1 << 3
     };
 
 
@@ -539,8 +1188,11 @@ public:
     ~CSVwrite();
 
 
-    // Closes file if open or dissociates the existing ostream, and then calls Reset().
-    // If this returns false the file/ostream has been closed/dissociated but Reset() failed.
+    /* Writes the buffer to the stream, closes file if open or dissociates the existing ostream or file
+    descriptor, and then calls Reset().
+    If this returns false the file/ostream has been closed/dissociated but either the buffer could
+    not be written or Reset() failed, and 'error' and 'error_msg' are set.
+    */
     bool Close();
 
     // This is the same as Close(). It may make your code easier to understand to call this when you
@@ -561,6 +1213,10 @@ public:
     When the class destructs if there is a file that was opened by this function it is automatically
     closed, but you may call Close() before then.
 
+    Records are written to the buffer and the buffer is written to the stream when it's full, or
+    when Flush() or Close() is called or the class destructs. An associated ostream must still exist
+    when that happens.
+
     If you are writing UTF-8 data and are writing from the beginning of the file/ostream and need
     the UTF-8 BOM call WriteUTF8BOM() after opening.
 
@@ -583,6 +1239,99 @@ public:
     bool Associate( std::ostream *stream, Flags flags = none );
 
 
+    /* CSVwrite::OpenFD(), CSVwrite::AssociateFD()
+    - Open a file or associate an existing file descriptor, to write without an ostream.
+
+    This is the same as Open() and Associate() except the buffer is written with the system call
+    write() instead of through an ostream and its streambuf. Data that's at least the size of the
+    buffer, eg a very long field, isn't copied to the buffer but is written along with it, with one
+    call to writev() on POSIX. Make the buffer large with ResizeBuffer() for the fewest calls.
+
+    The file is opened with O_APPEND by default, or with O_TRUNC if the flag CSVwrite::truncate is
+    passed. An associated file descriptor may be a file, pipe or socket open for writing. It's not
+    closed by Close(), only dissociated, and it must stay open until then. Flags 'truncate' and
+    'text_mode' are not valid when associating.
+
+    Error messages for failed system calls include the errno message.
+
+    [in] 'filename' : A file to open for output.
+    [in] 'fd' : A file descriptor already opened for output.
+    [in][opt] 'flags' : Refer to CSVwrite::Flags. The default is no flags are set.
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true)
+    */
+    bool OpenFD( std::string filename, Flags flags = none );
+    bool AssociateFD( int fd, Flags flags = none );
+
+
+    /* CSVwrite::SetGzip()
+    - Compress the output in gzip format.
+
+    This is only available if the library is compiled with JAY_UTIL_CSV_ZLIB defined and linked with
+    zlib. Otherwise any level but 0 is an error.
+
+    The buffer is compressed with zlib each time it's full, so the uncompressed data is never
+    written anywhere. The gzip stream is finished by Close(). Flush() writes everything compressed
+    so far so that it can be decompressed, at a small cost in compression.
+
+    If 'member_size' is not 0 the output is a series of independent gzip members, each ending at a
+    record terminator once at least 'member_size' bytes of records have been compressed into it.
+    A file of several members is a valid gzip file, and since a member can be decompressed without
+    the ones before it, each one can be decompressed and parsed separately, eg on separate threads.
+
+    This can only be called when a file/ostream isn't open, and applies to each one opened after
+    it. Like the delimiter and terminator it survives resets. It can't be used with 'text_mode'.
+
+    [in] 'level' : The zlib compression level, 1 (fastest) to 9 (smallest), or 0 for none. The
+        default is none.
+    [in][opt] 'member_size' : The number of uncompressed bytes after which a gzip member ends.
+        The default is 0, a single member.
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true)
+    */
+    bool SetGzip( int level, uint64_t member_size = 0 );
+
+
+    /* CSVwrite::SetRotation()
+    - Switch to a new file once the current one is big enough or old enough.
+
+    Before a record is started, if the current file has at least 'max_bytes' or has been open for
+    'max_seconds', the file is closed and the next one is opened with the same flags. No record is
+    split between files, and no file is left empty since a file is only opened for a record. The
+    files are named after the one passed to Open() or OpenFD() with a number before the extension,
+    eg out.csv, out.1.csv, out.2.csv. 'filename' is the name of the current one.
+
+    Each file after the first is a new file. A number whose file already exists, eg from an earlier
+    run, is skipped. If the flags have 'truncate' it's truncated instead, like the first file.
+
+    Each new file can start with a UTF-8 BOM and a header record, which are only written if it's
+    empty. They aren't written to the first file, which may be appended to; write them yourself
+    after opening if you need them there. When compressing, each file is a complete gzip file.
+
+    The size of a file is its size when it was opened, which is more than 0 if it's appended to,
+    plus the bytes written to it by this class, including those in the buffer. When compressing the
+    bytes written are the compressed bytes, which lag behind the records by what zlib holds.
+
+    The switch happens in the call that starts the record, eg the first WriteField() of it: the
+    buffer is written, the file is closed and the next one is opened, so that call takes longer
+    than the others.
+
+    This can only be called when a file/ostream isn't open, and applies to each file opened after it.
+    Like the delimiter and terminator it survives resets. Associating an ostream or file descriptor
+    while it's set is an error.
+
+    [in] 'max_bytes' : The size after which to switch files, or 0 for no limit.
+    [in] 'max_seconds' : The time after which to switch files, or 0 for no limit. If both are 0
+        there's no rotation.
+    [in][opt] 'header' : A header record to write at the start of each new file. The default is none.
+    [in][opt] 'utf8bom' : Write a UTF-8 BOM at the start of each new file. The default is false.
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true)
+    */
+    bool SetRotation( uint64_t max_bytes, unsigned max_seconds,
+        const std::vector<std::string> &header = std::vector<std::string>(), bool utf8bom = false );
+
+
     /* CSVwrite::WriteUTF8BOM()
     - Write a UTF-8 BOM.
 
@@ -594,6 +1343,21 @@ public:
     bool WriteUTF8BOM();
 
 
+    /* CSVwrite::Flush()
+    - Write the buffer to the stream and flush the stream.
+
+    Since the stream is only written when the buffer is full, a stream error caused by a field or
+    record may not be reported until a later call. Call this to make sure that everything written
+    so far has reached the stream, eg before reading the file or before another process may.
+
+    A file descriptor has no buffer of its own, so for one this only writes the buffer.
+
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true)
+    */
+    bool Flush();
+
+
     /* CSVwrite::WriteTerminator()
     - Write a record terminator.
 
@@ -612,7 +1376,8 @@ public:
 
     When writing the last field in the record set 'terminate' true or call WriteTerminator().
 
-    Every field is automatically qualified with quotes; you do not need to add your own qualifiers.
+    Every field is automatically qualified with quotes unless flag CSVwrite::minimal_quoting was
+    specified; you do not need to add your own qualifiers.
 
     [in] 'field' : The field.
     [in][opt] 'terminate' : Terminate the record. The default is false.
@@ -622,6 +1387,74 @@ public:
     bool WriteField( const std::string &field, const bool terminate = false );
 
 
+    /* CSVwrite::WriteField() for data that isn't a std::string
+    - Write a field from a pointer and length, or from a null terminated string.
+
+    This is the same as WriteField() for a std::string, without having to make one. The data is
+    copied only to the buffer, so it can be in a buffer of your own, eg a memory mapped file or a
+    network packet. With a length it may contain null bytes.
+
+    The length may be any integer type, eg int. It's a template parameter so that an int length
+    isn't ambiguous with the 'terminate' of the null terminated form; a bool is always 'terminate'.
+
+    [in] 'data' : The field. It may be NULL if 'size' is 0.
+    [in] 'size' : The length of the field, in bytes. It must not be negative.
+    [in] 'field' : The field, a null terminated string.
+    [in][opt] 'terminate' : Terminate the record. The default is false.
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true)
+    */
+    template< class Size >
+    bool WriteField( const char *data, Size size, const bool terminate = false )
+        { return WriteData( data, (size_t)size, terminate ); }
+    bool WriteField( const char *field, const bool terminate = false );
+
+
+    // A fixed-point decimal number, 'units' / 10^'scale'. eg Decimal( -12345, 2 ) is -123.45
+    struct Decimal
+    {
+        Decimal( long long units, unsigned scale ) : units( units ), scale( scale ) {}
+        long long units;
+        // The number of digits after the decimal point. At most 30.
+        unsigned scale;
+    };
+
+
+    /* CSVwrite::WriteField() for numbers
+    - Write a number as a field.
+
+    This is the same as WriteField() for a string of the number, except the number is formatted in a
+    small array on the stack and copied once to the buffer instead of being built in a std::string.
+    A number can't contain a double quote so it isn't scanned for any to escape.
+
+    Integers are written in decimal. A floating point number is written with the fewest significant
+    digits, from 1 to 17, that strtod() reads back as the same value, eg 0.1 rather than
+    0.10000000000000001 and 5e-324 rather than 4.94065645841247e-324. Negative zero is written as
+    -0. The decimal point is always a period regardless of the C locale. Infinity and NaN are
+    written as printf() writes them. A Decimal is written with exactly 'scale' digits after the
+    decimal point, eg Decimal( 5, 3 ) is 0.005.
+
+    [in] 'value' : The number.
+    [in][opt] 'terminate' : Terminate the record. The default is false.
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true)
+    */
+    bool WriteField( int value, const bool terminate = false )
+        { return WriteSigned( value, terminate ); }
+    bool WriteField( long value, const bool terminate = false )
+        { return WriteSigned( value, terminate ); }
+    bool WriteField( long long value, const bool terminate = false )
+        { return WriteSigned( value, terminate ); }
+    bool WriteField( unsigned value, const bool terminate = false )
+        { return WriteUnsigned( value, terminate ); }
+    bool WriteField( unsigned long value, const bool terminate = false )
+        { return WriteUnsigned( value, terminate ); }
+    bool WriteField( unsigned long long value, const bool terminate = false )
+        { return WriteUnsigned( value, terminate ); }
+    bool WriteField( double value, const bool terminate = false );
+    bool WriteField( const Decimal &value, const bool terminate = false );
+
+
     /* CSVwrite::WriteRecord()
     - Write a record.
 
@@ -634,7 +1467,8 @@ public:
     If 'fields' has a size of 0 (no fields- empty record) nothing is written unless
     flag CSVwrite::process_empty_records was specified, in which case a terminator is written.
 
-    Every field is automatically qualified with quotes; you do not need to add your own qualifiers.
+    Every field is automatically qualified with quotes unless flag CSVwrite::minimal_quoting was
+    specified; you do not need to add your own qualifiers.
 
     [in] 'fields' : The record.
     [in][opt] 'terminate' : Terminate the record. The default is true.
@@ -644,14 +1478,78 @@ public:
     bool WriteRecord( const std::vector<std::string> &fields, const bool terminate = true );
 
 
+    /* CSVwrite::WriteRecord() for a range of fields
+    - Write a record whose fields are in the range [first, last).
+
+    This is the same as WriteRecord() for a vector, for fields that aren't std::strings. Each field
+    is written with WriteField( data, size ) so the only copy is to the buffer. The data and size of
+    a field are taken by csv_field_data() and csv_field_size(), below, which work for:
+    - anything with data() and size(), eg std::string, std::string_view, std::vector<char>.
+    - std::pair of a pointer and a length, eg std::pair<const char *, size_t>.
+    For another type overload csv_field_data() and csv_field_size() in the namespace of the type.
+
+    eg for fields in buffers of your own:
+    std::pair<const char *, size_t> fields[ 3 ];
+    ... point them at the data ...
+    csv.WriteRecord( fields, fields + 3 );
+
+    [in] 'first', 'last' : The fields, as input iterators.
+    [in][opt] 'terminate' : Terminate the record. The default is true.
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true)
+    */
+    template< class InputIterator >
+    bool WriteRecord( InputIterator first, InputIterator last, const bool terminate = true );
+
+
+    /* Writes each member of a struct as a field. It's passed to CSVfields<T>::Visit() by
+    WriteStruct(). Calling it with a member calls the WriteField() overload for the member's type.
+    */
+    class FieldWriter
+    {
+    public:
+        explicit FieldWriter( CSVwrite &csv ) : _csv( csv ) {}
+
+        template< class F >
+        void operator()( const F &value ) { _csv.WriteField( value ); }
+
+        // The name is for CSVread::BindHeader(), and isn't used here.
+        template< class F >
+        void operator()( const F &value, const char * ) { _csv.WriteField( value ); }
+
+        void operator()( const char *data, size_t size ) { _csv.WriteField( data, size ); }
+
+    private:
+        CSVwrite &_csv;
+    };
+
+
+    /* CSVwrite::WriteStruct()
+    - Write a struct as a record, each member a field.
+
+    The fields of T are described once by specializing CSVfields<T>, below. Each member is written
+    by the WriteField() overload for its type, chosen at compile time: a number is formatted on the
+    stack and isn't scanned for quotes, and a string is escaped. Nothing is built for the record;
+    the fields are written straight to the buffer.
+
+    If the previous record written by WriteField() wasn't terminated then it's terminated first.
+
+    [in] 'record' : The struct.
+    [in][opt] 'terminate' : Terminate the record. The default is true.
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true)
+    */
+    template< class T >
+    bool WriteStruct( const T &record, const bool terminate = true );
+
+
     /* Change the size of the buffer, in bytes.
 
     The buffer exists for the life of the object. It has a default size of 4096 bytes and is used to
     hold data before it's written to the stream.
 
-    The buffer will hold at most a single field before writing it, therefore it's not as useful to
-    change the buffer size for this as it is for CSVread's buffer, unless your fields typically
-    are greater than 4096 bytes.
+    The buffer holds as many records as fit before it's written to the stream, so a larger buffer
+    means fewer writes. Any data in the buffer is written to the stream before it's resized.
 
     [ret][failure] (false) : The buffer could not be resized and has retained its current size.
         'error' and 'error_msg' are set.
@@ -670,6 +1568,10 @@ public:
     // If 'error' you can read this string before calling Close() or Dissociate().
     const std::string &error_msg; // = _error_msg
 
+    // The name of the file being written if it was opened by Open() or OpenFD(), otherwise empty.
+    // It changes when the file is rotated. Refer to SetRotation().
+    const std::string &filename; // = _filename
+
     // Set this to change the delimiter.
     // The delimiter should be a single character but prepended/appended whitespace is ok.
     // The delimiter is persistent and will survive resets. It doesn't need to be set on each open.
@@ -686,6 +1588,13 @@ private:
     CSVwrite( const CSVwrite & );
     CSVwrite & operator=( const CSVwrite & );
 
+    // CSVasyncwrite reports the errors of its I/O thread through 'error' and 'error_msg'.
+    friend class CSVasyncwrite;
+
+    // CSVparallelwrite formats records with the same settings, and copies the text to the buffer,
+    // ending it as a record.
+    friend class CSVparallelwrite;
+
     // A file stream if one was opened by this class.
     std::ofstream _file;
 
@@ -693,27 +1602,252 @@ private:
     // This points to the user specified ostream or _file.
     std::ostream *_output_ptr;
 
+    // The file descriptor the records are written to instead of a stream, or -1. If it was opened by
+    // this class then it's owned and closed by this class.
+    int _fd;
+    bool _fd_owned;
+
+    // The zlib state while the output is being compressed, and the settings from SetGzip().
+    gzip_state *_gzip;
+    int _gzip_level;
+    uint64_t _gzip_member_size;
+
+    // The settings from SetRotation(), and the name of the first file, which the others are named
+    // after. _file_number is the number of the current file, 0 for the first.
+    uint64_t _rotation_bytes;
+    unsigned _rotation_seconds;
+    std::vector<std::string> _rotation_header;
+    bool _rotation_bom;
+    std::string _rotation_base;
+    unsigned long _file_number;
+
+    // The size of the current file and when it was opened. Refer to SetRotation().
+    uint64_t _file_bytes;
+    time_t _file_opened;
+
+    // The BOM and header of a new file are being written, which can't cause another switch.
+    bool _rotating;
+
+    // Whether or not any of the current record has been put in the buffer. The file is switched
+    // before the first byte of a record. Refer to Put().
+    bool _in_record;
+
     // The flags passed to Open()/Associate().
     Flags _flags;
 
-    // The buffer used to hold data written to the stream.
+    // The buffer used to hold data written to the stream, and the number of bytes in it.
     char *_buffer;
+    size_t _buffer_used;
 
     // Whether or not the field to be written is the first field in the record.
     bool _is_first_field;
 
+    // The bytes that make a field need quotes in minimal_quoting mode, indexed by unsigned char.
+    // They depend on the delimiter and terminator they were found from. Refer to FindSpecial().
+    bool _special[ 256 ];
+    std::string _special_delimiter;
+    std::string _special_terminator;
+    bool _special_valid;
+
     // For a description of any of these refer to their public const references.
     std::streamsize _buffer_size;
     bool _error;
     std::string _error_msg;
+    std::string _filename;
 
     // Initialization to be called from the constructor only.
     bool Init();
 
     // Resets most variables. Does not reset the buffer size, delimiter or terminator.
     bool Reset();
+
+    // Whether or not a stream or file descriptor is associated.
+    bool IsAssociated() const { return _output_ptr || ( _fd != -1 ); }
+
+    // Copy data to the buffer, writing it to the stream whenever it's full. Switch files first if
+    // it's the start of a record and it's time.
+    bool Put( const char *data, size_t size );
+
+    // Copy the terminator to the buffer, and end the gzip member if it's time.
+    bool PutTerminator();
+    bool EndRecord();
+    bool CheckGzipMember();
+
+    // Open a file for output as a stream, or as a file descriptor if 'fd'.
+    bool OpenFile( const std::string &filename, Flags flags, bool fd );
+
+    // Whether or not it's time to switch files, and close the file and open the next one. Refer to
+    // SetRotation().
+    bool RotationDue() const;
+    bool Rotate();
+
+    // Write the data in the buffer to the stream, compressing it if necessary, and empty the buffer.
+    bool WriteBuffer();
+
+    // Write data to the stream or file descriptor as is.
+    bool WriteRaw( const char *data, size_t size );
+
+    // Start compressing when a stream is associated, finish the gzip stream, and free the zlib state.
+    bool StartGzip();
+    bool EndGzip();
+    void FreeGzip();
+
+    // Compress data and write what's ready. 'mode' is a zlib flush mode.
+    bool Deflate( const char *data, size_t size, int mode );
+
+    // Return the first byte in [data, end) that needs the field quoted, or 'end' if there is none.
+    const char *FindSpecial( const char *data, const char *end );
+
+    // Write a field from a pointer and length. Refer to WriteField() for data that isn't a string.
+    bool WriteData( const char *data, size_t size, const bool terminate );
+
+    // Write an integer field. Refer to WriteField() for numbers.
+    bool WriteSigned( long long value, const bool terminate );
+    bool WriteUnsigned( unsigned long long value, const bool terminate );
+
+    // Write a formatted number as a field. It must not contain a double quote.
+    bool WriteNumber( const char *text, size_t size, const bool terminate );
+
+    /* Start a record, terminating the previous one if it wasn't. 'write' is set false if the record
+    is empty and empty records aren't written, in which case there's nothing more to do.
+    */
+    bool StartRecord( bool empty, bool &write );
 };
 
+
+// The data and size of a field for CSVwrite::WriteRecord( first, last ).
+template< class T >
+inline const char *csv_field_data( const T &field )
+{
+    return field.data();
+}
+
+template< class T >
+inline size_t csv_field_size( const T &field )
+{
+    return field.size();
+}
+
+template< class T, class Size >
+inline const char *csv_field_data( const std::pair<T, Size> &field )
+{
+    return field.first;
+}
+
+template< class T, class Size >
+inline size_t csv_field_size( const std::pair<T, Size> &field )
+{
+    return (size_t)field.second;
+}
+
+
+/* CSVfields<T>
+- Describe the fields of a struct for CSVwrite::WriteStruct().
+
+Specialize it for your struct with a static function Visit() that calls 'field' with each member
+that's a field, in order. For writing a member can be any type WriteField() takes: std::string, a
+null terminated string, a number or CSVwrite::Decimal. A pointer and a length are passed together.
+For reading with CSVread::ReadStruct() a member can be a std::string, an integer, a float or a
+double. A member may be passed with its name, for CSVread::BindHeader().
+
+Visit() as a template does both, with a const struct and CSVwrite::FieldWriter for writing and a
+struct and CSVread::FieldReader for reading:
+
+struct Car { std::string make, model; int year; double price; };
+
+namespace jay { namespace util {
+template<> struct CSVfields<Car>
+{
+    template< class Record, class Field >
+    static void Visit( Record &car, Field &field )
+    {
+        field( car.make, "make" );
+        field( car.model, "model" );
+        field( car.year, "year" );
+        field( car.price, "price" );
+    }
+};
+} }
+
+csv_write.WriteStruct( car );
+...
+while( csv_read.ReadStruct( car ) ) { Process( car ); }
+*/
+template< class T >
+struct CSVfields;
+
+
+template< class T >
+bool CSVread::ReadStruct( T &record )
+{
+    if( !ReadRecord() )
+        return false;
+
+    FieldReader field( *this, false );
+    CSVfields<T>::Visit( record, field );
+    return !_error;
+}
+
+
+template< class T >
+bool CSVread::BindHeader()
+{
+    _columns.clear();
+
+    if( !ReadRecord() )
+        return false;
+
+    T record;
+    FieldReader field( *this, true );
+    CSVfields<T>::Visit( record, field );
+
+    if( _error )
+    {
+        _columns.clear();
+        return false;
+    }
+
+    return true;
+}
+
+
+template< class T >
+bool CSVwrite::WriteStruct( const T &record, const bool terminate )
+{
+    bool write;
+    if( !StartRecord( false, write ) )
+        return false;
+
+    // The writer does nothing more once there's an error, so that's checked once at the end.
+    FieldWriter field( *this );
+    CSVfields<T>::Visit( record, field );
+
+    if( _error )
+        return false;
+
+    return !terminate || WriteTerminator();
+}
+
+
+template< class InputIterator >
+bool CSVwrite::WriteRecord( InputIterator first, InputIterator last, const bool terminate )
+{
+    bool write;
+    if( !StartRecord( ( first == last ), write ) )
+        return false;
+
+    if( !write )
+        return true;
+
+    for( ; first != last; ++first )
+    {
+        if( !WriteField( csv_field_data( *first ), csv_field_size( *first ) ) )
+            return false;
+    }
+
+    return !terminate || WriteTerminator();
+}
+
 inline CSVwrite::Flags operator | (CSVwrite::Flags a, CSVwrite::Flags b)
 {
     return CSVwrite::Flags( ( (int)a ) | ( (int)b ) );
@@ -724,6 +1858,347 @@ inline CSVwrite::Flags & operator |= (CSVwrite::Flags &a, CSVwrite::Flags b)
 }
 
 
+
+/* Streaming group-by aggregation.
+
+Computes count, sum, min and max of a value column grouped by a key column, ie the equivalent of
+SELECT key, COUNT(*), SUM(value), MIN(value), MAX(value) ... GROUP BY key. Records are consumed one
+at a time so the CSV is never held in memory, only one entry per distinct key.
+
+jay::util::CSVread csv( "filename" );
+jay::util::CSVaggregate agg( 0, 2 ); // group by column 0, aggregate column 2
+if( !agg.Consume( csv ) ) { handle it. not all records were read, check csv.error_msg }
+for( uint32_t i = 0; i < agg.size(); ++i )
+{
+agg.Key( i ) is the key and agg[ i ] is the Group for the key.
+}
+
+The key is hashed from the raw bytes of the key field into an open addressing table (a
+CSVdictionary), and the accumulators of the group it finds are updated in place. A new key is
+stored once when it's first seen; otherwise adding a record does not allocate.
+
+Each thread may aggregate part of the data into its own object and the partial results are then
+combined with Merge(). An object must not be used by more than one thread at a time.
+*/
+class CSVaggregate
+{
+public:
+    // The accumulators of a group.
+    struct Group
+    {
+        // The number of records in the group.
+        uintmax_t count;
+
+        // The number of records in the group whose value is a number. Only those are accumulated.
+        // If this is 0 then 'sum', 'min' and 'max' are undefined.
+        uintmax_t numbers;
+
+        // The sum, minimum and maximum of the numbers.
+        double sum;
+        double min;
+        double max;
+
+        // The exact sum of the numbers if 'integral', ie all of the numbers were integers and the
+        // sum did not overflow. 'sum' may have lost precision past 2^53, this will not have.
+        int64_t int_sum;
+        bool integral;
+
+        Group();
+
+        // Accumulate another group of the same key.
+        void Merge( const Group &other );
+    };
+
+    /* Constructor
+
+    [in] 'key_column' : The index of the column to group by.
+    [in] 'value_column' : The index of the column to aggregate.
+    */
+    CSVaggregate( size_t key_column, size_t value_column );
+
+
+    /* CSVaggregate::Add()
+    - Add a record.
+
+    A record that has too few fields to have both columns is not added and is counted in
+    'skipped'.
+
+    The value is a number if it's entirely an integer or a floating point number as parsed by
+    strtod(), eg 5, -3.25 or 1e9, except that the decimal point is always a period as CSVwrite
+    writes it, whatever the C locale's is. Leading or trailing whitespace or a NaN is not a number.
+    The record is counted in its group either way.
+
+    The C locale's decimal point is looked up by the constructor and by each Consume(), not for
+    each value, so if you change the locale between calls to Add() call Consume() or construct
+    another object.
+
+    [in] 'fields' : The record.
+    */
+    void Add( const std::vector<std::string> &fields );
+
+    // Add a key and value directly. The value doesn't need to be null terminated.
+    void Add( const char *key, size_t key_size, const char *value, size_t value_size );
+
+
+    /* CSVaggregate::Consume()
+    - Read and add all remaining records.
+
+    Calls csv.ReadRecord() until it fails and adds each record.
+
+    [in] 'csv' : The records.
+    [ret][failure] (false) : Not all records were read. csv.error_msg has the reason.
+    [ret][success] (true) : The end record was read.
+    */
+    bool Consume( CSVread &csv );
+
+
+    /* CSVaggregate::Merge()
+    - Add the groups of another object.
+
+    The groups of 'other' are combined with the groups that have the same key and the rest are
+    added. 'other' should group the same columns, and is not changed.
+    */
+    void Merge( const CSVaggregate &other );
+
+
+    // Remove all groups. 'skipped' is reset.
+    void Clear();
+
+    // The number of groups. They are numbered from 0 in the order their keys were first added.
+    size_t size() const { return _groups.size(); }
+
+    // The key of group 'i'. 'i' must be less than size().
+    const std::string &Key( uint32_t i ) const { return _keys[ i ]; }
+
+    // Group 'i'. 'i' must be less than size().
+    const Group &operator[]( uint32_t i ) const { return _groups[ i ]; }
+
+    // The group with 'key', or NULL if there is none.
+    const Group *Find( const std::string &key ) const;
+
+    // The number of records not added because they were missing the key or value column.
+    const uintmax_t &skipped; // = _skipped
+
+    const size_t key_column;
+    const size_t value_column;
+
+private:
+    CSVaggregate( const CSVaggregate & );
+    CSVaggregate & operator=( const CSVaggregate & );
+
+    // The keys. A key's code in the dictionary is the index of its group.
+    CSVdictionary _keys;
+
+    // The groups, indexed by the code of their key.
+    std::vector<Group> _groups;
+
+    // For a description of any of these refer to their public const references.
+    uintmax_t _skipped;
+
+    // The C locale's decimal point. Refer to Add().
+    std::string _point;
+};
+
+
+
+/* A binary columnar cache of a CSV file.
+
+Parsing text is the bulk of the time spent reading CSV. If the same CSV file is read repeatedly it
+can be converted once by Build() into a cache file, which is then memory mapped by Open() and read
+without parsing. The records and fields read from the cache are the same as those read from the
+CSV file by CSVread.
+
+The easiest way to use it is Load(), which opens the cache if it's up to date with its CSV file
+and otherwise (re)builds it first:
+
+jay::util::CSVcache cache;
+if( !cache.Load( "filename.csv", "filename.csv.cache" ) ) { handle it. check error_msg }
+while( cache.ReadRecord() )
+{
+cache.fields is the same as CSVread::fields
+}
+
+The cache is stored by column. Each column is encoded as whichever of these fits:
+- integers: Every field that isn't empty is an integer written the canonical way (no leading zeros
+  or plus sign, up to 18 digits). Stored as an array of int64.
+- dictionary: There are at most half as many distinct fields as records. Each distinct field is
+  stored once and each record has a 4 byte code.
+- strings: Each record has an offset into the field bytes of the column.
+Each column also has a bitmap of which records have a field that isn't empty, and each record has
+its number of fields so that records with fewer fields than others read back the same.
+
+A cache records the size, modification time and a hash of the beginning and end of the CSV file it
+was built from, and is stale if they don't match the CSV file when it's opened. A change to a CSV
+file in the same second that doesn't change its size, beginning or end is not detected; rebuild
+the cache yourself if you write files that way.
+
+The cache file is in the byte order of the machine that built it and can't be opened on a machine
+with a different byte order. The whole cache file is mapped, so on a 32-bit machine it's limited to
+the available address space.
+*/
+class CSVcache
+{
+public:
+    CSVcache();
+
+    // The cache file is unmapped when the class destructs.
+    ~CSVcache();
+
+
+    /* CSVcache::Build()
+    - Build a cache file from CSV.
+
+    Reads all remaining records from 'csv' and writes them to 'cache', replacing it. The records
+    are held in memory by column until they're written, so this uses memory on the order of the
+    size of the CSV.
+
+    The cache is written to a temporary file in the same directory, named after 'cache' with the
+    process id, and that file is then renamed to 'cache'. The old cache file isn't changed, so a
+    CSVcache in this or another process that has it open keeps reading the old records until it's
+    opened again. In Windows a cache file can't be replaced while it's open, so that fails. If
+    writing or renaming fails the temporary file is removed and 'cache' is unchanged.
+
+    [in] 'csv' : The CSV to read, already opened or associated.
+    [in] 'cache' : The cache file to write.
+    [in][opt] 'source' : The filename of the CSV. It's hashed to detect when the cache is stale.
+        If it's empty the cache is never stale.
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true)
+    */
+    bool Build( CSVread &csv, const std::string &cache, const std::string &source = "" );
+
+
+    /* CSVcache::Open()
+    - Map a cache file.
+
+    If there is already a mapped cache file it's closed first.
+
+    [in] 'cache' : The cache file to map.
+    [in][opt] 'source' : The filename of the CSV the cache was built from. If it's not empty and
+        the CSV has changed since then the cache is stale and this fails.
+    [ret][failure] (false) : 'error' and 'error_msg' are set. If the cache is stale 'stale' is set.
+    [ret][success] (true)
+    */
+    bool Open( const std::string &cache, const std::string &source = "" );
+
+
+    /* CSVcache::Load()
+    - Map a cache file, first building it if necessary.
+
+    Calls Open( cache, source ). If that fails for any reason, or the cache was built using a
+    different delimiter, quote character or flags, the cache is rebuilt from 'source' using
+    CSVread and opened.
+
+    [in] 'source' : The CSV file.
+    [in] 'cache' : The cache file.
+    [in][opt] 'flags', 'delimiter', 'quote' : Refer to CSVread. If CSVread::sniff_dialect is
+        passed then the delimiter and quote character of an existing cache aren't compared.
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true) : 'rebuilt' is set if the cache was rebuilt.
+    */
+    bool Load(
+        const std::string &source,
+        const std::string &cache,
+        CSVread::Flags flags = CSVread::none,
+        unsigned char delimiter = ',',
+        unsigned char quote = '"'
+    );
+
+
+    // Unmap the cache file and reset to an empty state.
+    void Close();
+
+
+    /* CSVcache::ReadRecord()
+    - Read a record.
+
+    The same as CSVread::ReadRecord() except that any record can be read directly, there is no
+    parsing. When there are no more records this fails with 'eof' set, which is not an error.
+
+    [in][opt] 'requested_record_num' : The record number to read. The default is the next record.
+    [ret][failure] (false) : 'eof' is set, or 'error' and 'error_msg' are set.
+    [ret][success] (true) : 'record_num' and 'fields' are set.
+    */
+    bool ReadRecord( const uintmax_t requested_record_num = 0 );
+
+
+    /* CSVcache::GetField()
+    - Get a field of any record without copying it.
+
+    The field is read from the mapped file. A field in an integer column is formatted to a buffer
+    in the object instead, and 'data' is only valid until the next call.
+
+    [in] 'requested_record_num' : The record number, from 1.
+    [in] 'column' : The index of the field in the record.
+    [out] 'data', 'size' : The field. 'data' is not null terminated.
+    [ret][failure] (false) : There is no such record or field, or 'error' is set.
+    [ret][success] (true)
+    */
+    bool GetField(
+        const uintmax_t requested_record_num,
+        const size_t column,
+        const char *&data,
+        size_t &size
+    );
+
+
+    // Error. Functions will not succeed when this is true. Call Open(), Load() or Close().
+    const bool &error; // = _error
+
+    // Contains an error message when 'error'.
+    const std::string &error_msg; // = _error_msg
+
+    // The cache is stale. Refer to Open().
+    const bool &stale; // = _stale
+
+    // Load() rebuilt the cache.
+    const bool &rebuilt; // = _rebuilt
+
+    // ReadRecord() was called for the record after the end record.
+    const bool &eof; // = _eof
+
+    // The record number of the current record. The first record is record number 1.
+    const uintmax_t &record_num; // = _record_num
+
+    // The record number of the end record, ie the number of records in the cache.
+    const uintmax_t &end_record_num; // = _end_record_num
+
+    // The end record of the CSV was not terminated. Refer to CSVread.
+    const bool &end_record_not_terminated; // = _end_record_not_terminated
+
+    // The current record. Refer to CSVread.
+    const std::vector<std::string> &fields; // = _fields
+
+private:
+    CSVcache( const CSVcache & );
+    CSVcache & operator=( const CSVcache & );
+
+    // Set '_error' and '_error_msg', and return false.
+    bool Fail( const std::string &msg );
+
+    // The mapped cache file, or NULL.
+    const char *_map;
+    uint64_t _map_size;
+
+    // The flags, delimiter and quote character the mapped cache was built with.
+    uint32_t _dialect;
+
+    // A field of an integer column formatted by GetField().
+    char _number[ 24 ];
+
+    // For a description of any of these refer to their public const references.
+    bool _error;
+    std::string _error_msg;
+    bool _stale;
+    bool _rebuilt;
+    bool _eof;
+    uintmax_t _record_num;
+    uintmax_t _end_record_num;
+    bool _end_record_not_terminated;
+    std::vector<std::string> _fields;
+};
+
+
 } // namespace util
 } // namespace jay
 #endif // JAY_UTIL_CSV_HPP_
@@ -0,0 +1,298 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Streaming group-by aggregation.
+
+Documentation is in CSV.hpp.
+*/
+
+#include "CSV.hpp"
+
+#include <stdint.h>
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "number.hpp"
+
+
+using namespace std;
+
+
+namespace jay {
+namespace util {
+
+
+// Returns true if a + b overflows.
+static bool add_overflows( int64_t a, int64_t b )
+{
+    return ( ( b > 0 ) && ( a > ( numeric_limits<int64_t>::max() - b ) ) )
+        || ( ( b < 0 ) && ( a < ( numeric_limits<int64_t>::min() - b ) ) );
+}
+
+
+/* Parse a field as a number. A floating point number has a period for the decimal point, as
+CSVwrite writes it, whatever the C locale's decimal point 'point' is.
+
+[ret][failure] (false) : The field is not a number.
+[ret][success] (true) : 'number' is set. If the field is an integer 'integer' is set and
+    'integral' is true.
+*/
+static bool parse_number(
+    const char *data,
+    size_t size,
+    const string &point,
+    double &number,
+    int64_t &integer,
+    bool &integral
+)
+{
+    const char *p = data;
+    const char *const end = data + size;
+
+    // Integers of up to 18 digits can't overflow and are parsed here instead of by strtod().
+    bool negative = false;
+    if( ( p != end ) && ( ( *p == '-' ) || ( *p == '+' ) ) )
+    {
+        negative = ( *p++ == '-' );
+    }
+
+    if( ( p != end ) && ( ( end - p ) <= 18 ) )
+    {
+        int64_t n = 0;
+        for( ; ( p != end ) && ( (unsigned)( *p - '0' ) <= 9 ); ++p )
+        {
+            n = ( n * 10 ) + ( *p - '0' );
+        }
+
+        if( p == end )
+        {
+            integer = negative ? -n : n;
+            number = (double)integer;
+            integral = true;
+            return true;
+        }
+    }
+
+    if( !parse_double( data, size, point, number ) || ( number != number ) )
+    {
+        return false;
+    }
+
+    integral = false;
+    return true;
+}
+
+
+
+CSVaggregate::Group::Group() :
+    count( 0 ),
+    numbers( 0 ),
+    sum( 0 ),
+    min( 0 ),
+    max( 0 ),
+    int_sum( 0 ),
+    integral( true )
+{
+}
+
+
+void CSVaggregate::Group::Merge( const Group &other )
+{
+    count += other.count;
+
+    if( !other.numbers )
+    {
+        return;
+    }
+
+    if( !numbers )
+    {
+        min = other.min;
+        max = other.max;
+    }
+    else
+    {
+        if( other.min < min )
+            min = other.min;
+        if( other.max > max )
+            max = other.max;
+    }
+
+    numbers += other.numbers;
+    sum += other.sum;
+
+    if( integral )
+    {
+        if( !other.integral || add_overflows( int_sum, other.int_sum ) )
+        {
+            integral = false;
+        }
+        else
+        {
+            int_sum += other.int_sum;
+        }
+    }
+}
+
+
+
+CSVaggregate::CSVaggregate( size_t key_column, size_t value_column ) :
+    skipped( _skipped ),
+    key_column( key_column ),
+    value_column( value_column ),
+    _skipped( 0 ),
+    _point( c_decimal_point() )
+{
+}
+
+
+void CSVaggregate::Clear()
+{
+    _keys.Clear();
+    vector<Group>().swap( _groups );
+    _skipped = 0;
+}
+
+
+void CSVaggregate::Add( const vector<string> &fields )
+{
+    if( ( key_column >= fields.size() ) || ( value_column >= fields.size() ) )
+    {
+        ++_skipped;
+        return;
+    }
+
+    const string &key = fields[ key_column ];
+    const string &value = fields[ value_column ];
+    Add( key.data(), key.size(), value.data(), value.size() );
+}
+
+
+void CSVaggregate::Add( const char *key, size_t key_size, const char *value, size_t value_size )
+{
+    const uint32_t code = _keys.Intern( key, key_size );
+    if( code == CSVdictionary::no_code )
+    {
+        ++_skipped;
+        return;
+    }
+
+    if( code == _groups.size() )
+    {
+        _groups.push_back( Group() );
+    }
+
+    Group &group = _groups[ code ];
+    ++group.count;
+
+    double number;
+    int64_t integer = 0;
+    bool integral = false;
+    if( !parse_number( value, value_size, _point, number, integer, integral ) )
+    {
+        return;
+    }
+
+    if( !group.numbers )
+    {
+        group.min = group.max = number;
+    }
+    else
+    {
+        if( number < group.min )
+            group.min = number;
+        if( number > group.max )
+            group.max = number;
+    }
+
+    ++group.numbers;
+    group.sum += number;
+
+    if( group.integral )
+    {
+        if( !integral || add_overflows( group.int_sum, integer ) )
+        {
+            group.integral = false;
+        }
+        else
+        {
+            group.int_sum += integer;
+        }
+    }
+}
+
+
+bool CSVaggregate::Consume( CSVread &csv )
+{
+    _point = c_decimal_point();
+
+    while( csv.ReadRecord() )
+    {
+        // Only the key and value fields are unescaped, if flag 'lazy_unescape' is set, or copied
+        // from the dictionary if they're interned.
+        if( ( key_column < csv.fields.size() ) && ( value_column < csv.fields.size() ) )
+        {
+            csv.Field( key_column );
+            csv.Field( value_column );
+        }
+
+        Add( csv.fields );
+    }
+
+    return csv.eof && ( csv.record_num == csv.end_record_num );
+}
+
+
+void CSVaggregate::Merge( const CSVaggregate &other )
+{
+    for( uint32_t i = 0; i < other._groups.size(); ++i )
+    {
+        const uint32_t code = _keys.Intern( other._keys[ i ] );
+        if( code == CSVdictionary::no_code )
+        {
+            _skipped += other._groups[ i ].count;
+            continue;
+        }
+
+        if( code == _groups.size() )
+        {
+            _groups.push_back( Group() );
+        }
+
+        _groups[ code ].Merge( other._groups[ i ] );
+    }
+
+    _skipped += other._skipped;
+}
+
+
+const CSVaggregate::Group *CSVaggregate::Find( const string &key ) const
+{
+    const uint32_t code = _keys.Find( key );
+    return ( code == CSVdictionary::no_code ) ? NULL : &_groups[ code ];
+}
+
+
+} // namespace util
+} // namespace jay
@@ -0,0 +1,503 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** A CSVwrite that writes to its file/ostream on a background thread.
+
+Documentation is in CSVasyncwrite.hpp.
+*/
+
+#include "CSVasyncwrite.hpp"
+
+#include <limits.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "strerror.hpp"
+
+
+using namespace std;
+
+
+namespace jay {
+namespace util {
+
+
+/* A streambuf that copies what's written to it into blocks, and writes the full blocks to another
+ostream on an I/O thread.
+
+The put area is the block being filled, so most writes are a memcpy. When it's full the block is
+queued for the I/O thread and a free one takes its place, waiting for one if there are none.
+
+Only the I/O thread uses the target ostream while this exists. An error writing to it is recorded
+and the blocks after it are discarded; the producer finds out the next time it needs a free block,
+or on sync().
+*/
+class async_streambuf : public streambuf
+{
+public:
+    async_streambuf( ostream *target, size_t block_size, size_t block_count ) :
+        _target( target ), _blocks( block_count ), _current( NULL ),
+        _flush( false ), _stop( false ), _failed( false )
+    {
+        for( size_t i = 0; i < _blocks.size(); ++i )
+        {
+            _blocks[ i ].data.resize( block_size );
+            _blocks[ i ].size = 0;
+            _free.push_back( &_blocks[ i ] );
+        }
+
+        Take();
+        _thread = thread( &async_streambuf::Run, this );
+    }
+
+    ~async_streambuf()
+    {
+        Stop();
+    }
+
+    /* Write everything, wait for the I/O thread to end, and return whether there was an error.
+    Nothing can be written after this.
+    */
+    bool Stop()
+    {
+        if( !_thread.joinable() )
+            return !_failed;
+
+        unique_lock<mutex> lock( _mutex );
+        Queue();
+        _stop = true;
+        _work.notify_one();
+        lock.unlock();
+
+        _thread.join();
+        return !_failed;
+    }
+
+    // The error if the I/O thread failed to write a block.
+    bool failed()
+    {
+        lock_guard<mutex> lock( _mutex );
+        return _failed;
+    }
+
+    string error_msg()
+    {
+        lock_guard<mutex> lock( _mutex );
+        return _error_msg;
+    }
+
+protected:
+    streamsize xsputn( const char *s, streamsize n )
+    {
+        streamsize done = 0;
+
+        while( done < n )
+        {
+            if( ( pptr() == epptr() ) && !Submit() )
+                break;
+
+            const streamsize room = epptr() - pptr();
+            const streamsize count = ( ( n - done ) < room ) ? ( n - done ) : room;
+            memcpy( pptr(), s + done, (size_t)count );
+            pbump( (int)count );
+            done += count;
+        }
+
+        return done;
+    }
+
+    int_type overflow( int_type c )
+    {
+        if( !Submit() )
+            return traits_type::eof();
+
+        if( traits_type::eq_int_type( c, traits_type::eof() ) )
+            return traits_type::not_eof( c );
+
+        *pptr() = traits_type::to_char_type( c );
+        pbump( 1 );
+        return c;
+    }
+
+    // Queue the block being filled and wait until the I/O thread has written everything and flushed
+    // the target.
+    int sync()
+    {
+        unique_lock<mutex> lock( _mutex );
+
+        if( _current && ( pptr() != pbase() ) )
+        {
+            Queue();
+            Take( lock );
+        }
+
+        _flush = true;
+        _work.notify_one();
+
+        while( _flush )
+        {
+            _done.wait( lock );
+        }
+
+        return _failed ? -1 : 0;
+    }
+
+private:
+    async_streambuf( const async_streambuf & );
+    async_streambuf & operator=( const async_streambuf & );
+
+    struct block
+    {
+        vector<char> data;
+        size_t size;
+    };
+
+    // Queue the block being filled and take a free one, waiting for one if necessary.
+    bool Submit()
+    {
+        unique_lock<mutex> lock( _mutex );
+        Queue();
+        return Take( lock );
+    }
+
+    // Queue the block being filled for the I/O thread. The lock must be held.
+    void Queue()
+    {
+        if( !_current )
+            return;
+
+        _current->size = pptr() - pbase();
+
+        if( _current->size && !_failed )
+        {
+            _full.push_back( _current );
+            _work.notify_one();
+        }
+        else
+        {
+            _free.push_back( _current );
+        }
+
+        _current = NULL;
+        setp( NULL, NULL );
+    }
+
+    // Take a free block to fill. The lock must be held. There is one unless the I/O thread failed.
+    bool Take( unique_lock<mutex> &lock )
+    {
+        while( _free.empty() && !_failed )
+        {
+            _done.wait( lock );
+        }
+
+        if( _failed )
+            return false;
+
+        Take();
+        return true;
+    }
+
+    // Take a free block to fill, when it's known there is one.
+    void Take()
+    {
+        _current = _free.back();
+        _free.pop_back();
+        setp( &_current->data[ 0 ], &_current->data[ 0 ] + _current->data.size() );
+    }
+
+    // The I/O thread.
+    void Run()
+    {
+        unique_lock<mutex> lock( _mutex );
+
+        for( ;; )
+        {
+            if( !_full.empty() )
+            {
+                block *b = _full.front();
+                _full.pop_front();
+
+                if( !_failed )
+                {
+                    lock.unlock();
+                    _target->write( &b->data[ 0 ], (streamsize)b->size );
+                    const ios::iostate state = _target->rdstate();
+                    lock.lock();
+
+                    if( state )
+                    {
+                        _failed = true;
+                        _error_msg = "Failed writing a block. ostream: " + ios_strerror( state );
+                    }
+                }
+
+                _free.push_back( b );
+                _done.notify_all();
+            }
+            else if( _flush )
+            {
+                if( !_failed )
+                {
+                    lock.unlock();
+                    _target->flush();
+                    const ios::iostate state = _target->rdstate();
+                    lock.lock();
+
+                    if( state )
+                    {
+                        _failed = true;
+                        _error_msg = "Failed flushing. ostream: " + ios_strerror( state );
+                    }
+                }
+
+                _flush = false;
+                _done.notify_all();
+            }
+            else if( _stop )
+            {
+                return;
+            }
+            else
+            {
+                _work.wait( lock );
+            }
+        }
+    }
+
+    ostream *_target;
+
+    // The blocks. The one being filled is _current, and the others are either waiting to be written
+    // (_full, in order), being written, or free.
+    vector<block> _blocks;
+    deque<block *> _full;
+    vector<block *> _free;
+    block *_current;
+
+    // Requests for the I/O thread to flush the target, and to end when the blocks are written.
+    bool _flush;
+    bool _stop;
+
+    // The I/O thread failed to write to the target.
+    bool _failed;
+    string _error_msg;
+
+    // _work is signaled for the I/O thread and _done for the producer. All the members above except
+    // _target, _blocks and _current are only accessed with _mutex held.
+    mutex _mutex;
+    condition_variable _work;
+    condition_variable _done;
+    thread _thread;
+};
+
+
+
+CSVasyncwrite::CSVasyncwrite() :
+    block_size( _block_size ), block_count( _block_count ),
+    _blocks_stream( NULL ), _block_size( 1 << 20 ), _block_count( 4 )
+{
+}
+
+
+CSVasyncwrite::CSVasyncwrite( string filename, Flags flags /* = none */ ) :
+    block_size( _block_size ), block_count( _block_count ),
+    _blocks_stream( NULL ), _block_size( 1 << 20 ), _block_count( 4 )
+{
+    Open( filename, flags );
+}
+
+
+CSVasyncwrite::CSVasyncwrite( ostream *stream, Flags flags /* = none */ ) :
+    block_size( _block_size ), block_count( _block_count ),
+    _blocks_stream( NULL ), _block_size( 1 << 20 ), _block_count( 4 )
+{
+    Associate( stream, flags );
+}
+
+
+CSVasyncwrite::~CSVasyncwrite()
+{
+    Close();
+}
+
+
+bool CSVasyncwrite::SetBlocks( size_t size, size_t count )
+{
+    if( _error )
+        return false;
+
+    if( IsAssociated() )
+    {
+        _error = true;
+        _error_msg = "The blocks can't be changed while a stream is associated. Call Close() first.";
+        return false;
+    }
+
+    if( !size || ( size > INT_MAX ) || ( count < 2 ) )
+    {
+        _error = true;
+        _error_msg = "The block size must be from 1 to INT_MAX and there must be at least 2 blocks.";
+        return false;
+    }
+
+    _block_size = size;
+    _block_count = count;
+    return true;
+}
+
+
+bool CSVasyncwrite::Close()
+{
+    // CSVwrite::Close() flushes the stream, which waits for the I/O thread to write everything.
+    const bool closed = CSVwrite::Close();
+    const bool stopped = Stop();
+
+    if( _async_file.is_open() )
+    {
+        _async_file.close();
+    }
+
+    return closed && stopped;
+}
+
+
+bool CSVasyncwrite::Open( string filename, const Flags flags /* = none */ )
+{
+    if( _error )
+        return false;
+
+    if( IsAssociated() )
+    {
+        _error = true;
+        _error_msg = "A stream is already associated. Call Close() to dissociate.";
+        return false;
+    }
+
+    ios::openmode mode = ( ( flags & text_mode ) ) ? 0 : ios::binary;
+    mode |= ( ( flags & truncate ) ) ? ios::trunc : ios::app;
+
+    _async_file.open( filename, mode );
+    if( !_async_file )
+    {
+        _error = true;
+        _error_msg = "Failed opening " + filename;
+        return false;
+    }
+
+    return Start( &_async_file, flags );
+}
+
+
+bool CSVasyncwrite::Associate( ostream *stream, const Flags flags /* = none */ )
+{
+    if( _error )
+        return false;
+
+    if( !stream )
+    {
+        _error = true;
+        _error_msg = "The stream parameter is NULL.";
+        return false;
+    }
+
+    if( IsAssociated() )
+    {
+        _error = true;
+        _error_msg = "A stream is already associated. Call Close() to dissociate.";
+        return false;
+    }
+
+    if( ( flags & text_mode ) )
+    {
+        // For the time being text mode is only valid if it's a file opened by this class.
+        _error = true;
+        _error_msg = "Text mode is only valid for files opened by this class.";
+        return false;
+    }
+
+    return Start( stream, flags );
+}
+
+
+bool CSVasyncwrite::Flush()
+{
+    if( CSVwrite::Flush() )
+        return true;
+
+    // The stream only knows that a write failed; the I/O thread knows why.
+    if( _blocks && _blocks->failed() )
+    {
+        _error_msg = _blocks->error_msg();
+    }
+
+    return false;
+}
+
+
+bool CSVasyncwrite::Start( ostream *target, const Flags flags )
+{
+    if( !target->good() )
+    {
+        _error = true;
+        _error_msg = "ostream: " + ios_strerror( target->rdstate() );
+        return false;
+    }
+
+    _blocks.reset( new async_streambuf( target, _block_size, _block_count ) );
+    _blocks_stream.rdbuf( _blocks.get() );
+
+    // Text mode is done by the file the I/O thread writes to, not by the stream of blocks.
+    return CSVwrite::Associate( &_blocks_stream, (Flags)( flags & ~text_mode ) );
+}
+
+
+bool CSVasyncwrite::Stop()
+{
+    if( !_blocks )
+        return true;
+
+    const bool stopped = _blocks->Stop();
+    const string stop_error_msg = _blocks->error_msg();
+
+    _blocks_stream.rdbuf( NULL );
+    _blocks.reset();
+
+    if( !stopped )
+    {
+        // This replaces any error from the stream of blocks, which is the result of this one.
+        _error = true;
+        _error_msg = stop_error_msg;
+        return false;
+    }
+
+    return true;
+}
+
+
+} // namespace util
+} // namespace jay
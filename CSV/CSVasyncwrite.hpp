@@ -0,0 +1,208 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Usage and design:
+
+class CSVasyncwrite
+- A class with the writing interface of CSVwrite that writes to its file/ostream on a background
+thread.
+
+Unlike CSV.hpp this header requires C++11 threads (Visual Studio 2012 or later).
+
+CSVasyncwrite is used the same way as CSVwrite. The difference is where the time goes: the records
+are formatted into blocks of memory on the calling thread, and a dedicated I/O thread writes the full
+blocks to the file/ostream. WriteRecord() and WriteField() only copy bytes, so they don't wait on the
+disk unless the disk has fallen behind.
+
+It isn't a CSVwrite though. It's built on one privately, because CSVwrite's Open(), Close(), Flush()
+and destructor aren't virtual: through a CSVwrite reference or pointer they would skip the I/O
+thread. Its public interface is the functions and members declared here, which includes CSVwrite's
+functions to write records and its settings. CSVwrite's SetGzip(), SetRotation(), OpenFD() and
+AssociateFD() aren't available.
+
+A fixed number of blocks is allocated when the file/ostream is opened and they're reused. While one
+block is being filled the others are waiting to be written or being written. If every block is full
+the calling thread waits for the I/O thread to finish one, so a slow disk holds back the writer
+rather than memory growing.
+
+An error writing to the file/ostream happens on the I/O thread after the call that wrote the data
+has returned. It's reported by a later call: the next write that needs a free block, Flush() or
+Close(). The blocks after an error are discarded. Always check the return of Close().
+
+jay::util::CSVasyncwrite csv( "filename" );
+if( csv.error ) { initialization failed, handle it }
+while( more records )
+{
+    csv.WriteRecord( record );
+}
+if( !csv.Close() ) { handle it. some records may not have been written, check csv.error_msg }
+*/
+
+#ifndef JAY_UTIL_CSVASYNCWRITE_HPP_
+#define JAY_UTIL_CSVASYNCWRITE_HPP_
+
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "CSV.hpp"
+
+
+namespace jay {
+namespace util {
+
+
+class async_streambuf;
+
+
+class CSVasyncwrite : private CSVwrite
+{
+public:
+    // Refer to CSVwrite.
+    using CSVwrite::Flags;
+    using CSVwrite::none;
+    using CSVwrite::truncate;
+    using CSVwrite::text_mode;
+    using CSVwrite::process_empty_records;
+    using CSVwrite::minimal_quoting;
+    using CSVwrite::Decimal;
+
+
+    /* Constructor
+
+    The constructor also calls Open() if a filename is specified.
+    The constructor also calls Associate() if an ostream is specified.
+
+    In any case check 'error' to determine whether or not construction succeeded.
+
+    [in] 'filename' : A file to open for output.
+    [in] 'stream' : An ostream already opened for output. It's written by the I/O thread only, so
+        don't use it until Close().
+    [in][opt] 'flags' : Refer to CSVwrite::Flags. The default is no flags are set.
+    */
+    CSVasyncwrite();
+    CSVasyncwrite( std::string filename, Flags flags = none );
+    CSVasyncwrite( std::ostream *stream, Flags flags = none );
+
+    // Close() is called when the class destructs. There's no way to report an error then.
+    ~CSVasyncwrite();
+
+
+    /* CSVasyncwrite::Close()
+    - Write everything that's left, stop the I/O thread, and close or dissociate.
+
+    This waits for the I/O thread to write all the blocks.
+
+    [ret][failure] (false) : The file/ostream has been closed/dissociated but not everything could be
+        written, or Reset() failed. 'error' and 'error_msg' are set.
+    [ret][success] (true) : Everything written has reached the file/ostream.
+    */
+    bool Close();
+
+    bool Dissociate() { return Close(); };
+
+
+    /* CSVasyncwrite::Open(), CSVasyncwrite::Associate()
+    - Open a file or associate an existing ostream, and start the I/O thread.
+
+    This is the same as CSVwrite::Open() and CSVwrite::Associate(). The blocks are allocated here.
+
+    [in] 'filename' : A file to open for output.
+    [in] 'stream' : An ostream already opened for output.
+    [in][opt] 'flags' : Refer to CSVwrite::Flags. The default is no flags are set.
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true)
+    */
+    bool Open( std::string filename, Flags flags = none );
+    bool Associate( std::ostream *stream, Flags flags = none );
+
+
+    /* CSVasyncwrite::Flush()
+    - Write everything so far and wait until the I/O thread has written it.
+
+    The file/ostream is flushed by the I/O thread after the blocks are written.
+
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true)
+    */
+    bool Flush();
+
+
+    /* CSVasyncwrite::SetBlocks()
+    - Set the size and number of the blocks the I/O thread writes.
+
+    This can only be called when a file/ostream isn't open. The default is 4 blocks of 1MB. There
+    must be at least 2 blocks, one to fill while another is written.
+
+    [in] 'size' : The size of a block, in bytes.
+    [in] 'count' : The number of blocks.
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true)
+    */
+    bool SetBlocks( size_t size, size_t count );
+
+    const size_t &block_size; // = _block_size
+    const size_t &block_count; // = _block_count
+
+
+    // Refer to CSVwrite.
+    using CSVwrite::WriteUTF8BOM;
+    using CSVwrite::WriteTerminator;
+    using CSVwrite::WriteField;
+    using CSVwrite::WriteRecord;
+    using CSVwrite::WriteStruct;
+    using CSVwrite::ResizeBuffer;
+
+    using CSVwrite::buffer_size;
+    using CSVwrite::error;
+    using CSVwrite::error_msg;
+    using CSVwrite::delimiter;
+    using CSVwrite::terminator;
+
+private:
+    CSVasyncwrite( const CSVasyncwrite & );
+    CSVasyncwrite & operator=( const CSVasyncwrite & );
+
+    // Start the I/O thread writing to 'target' and associate the blocks with the base class.
+    bool Start( std::ostream *target, Flags flags );
+
+    // Stop the I/O thread. If it had an error that's the error, since it's more specific than any
+    // error it caused in CSVwrite.
+    bool Stop();
+
+    // A file stream if one was opened by this class. Unlike CSVwrite::_file it's written by the I/O
+    // thread.
+    std::ofstream _async_file;
+
+    // The blocks, and the stream that CSVwrite writes its buffer to, which copies it to the blocks.
+    std::unique_ptr<async_streambuf> _blocks;
+    std::ostream _blocks_stream;
+
+    size_t _block_size;
+    size_t _block_count;
+};
+
+
+} // namespace util
+} // namespace jay
+#endif // JAY_UTIL_CSVASYNCWRITE_HPP_
@@ -0,0 +1,921 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** A binary columnar cache of a CSV file.
+
+Documentation is in CSV.hpp.
+*/
+
+#include "CSV.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "hash.hpp"
+#include "strerror.hpp"
+
+
+using namespace std;
+
+
+namespace jay {
+namespace util {
+
+
+/* The cache file format.
+
+The file starts with a cache_header. Every other section is at an offset, from the beginning of the
+file, that is a multiple of 8 and is found through the header:
+
+field_counts : uint32_t[ record_count ], the number of fields in each record.
+columns : cache_column[ column_count ], one for each column.
+
+And for each column:
+
+present : uint64_t[ ( record_count + 63 ) / 64 ], bit r % 64 of word r / 64 is set if record r
+    has a field in the column that isn't empty. All other fields are empty.
+values : Depends on the encoding.
+    integers: int64_t[ record_count ], the value of each field.
+    dictionary: uint32_t[ record_count ], the code of each field.
+    strings: uint64_t[ record_count + 1 ], the offset in 'bytes' of each field. A field ends
+        where the next begins.
+strings : Dictionary only. uint64_t[ string_count + 1 ], the offset in 'bytes' of each string.
+bytes : The field or string bytes.
+
+All numbers are in the byte order of the machine that built the file.
+*/
+static const char cache_magic[ 8 ] = { 'C', 'S', 'V', 'c', 'a', 'c', 'h', 'e' };
+static const uint32_t cache_version = 1;
+static const uint32_t cache_byte_order = 0x01020304;
+
+enum cache_encoding
+{
+    encoding_strings = 0,
+    encoding_dictionary = 1,
+    encoding_integers = 2
+};
+
+// Identifies the CSV file a cache was built from.
+struct cache_source
+{
+    uint64_t size;
+    int64_t mtime;
+    uint64_t hash;
+};
+
+struct cache_header
+{
+    char magic[ 8 ];
+    uint32_t version;
+    uint32_t byte_order;
+    cache_source source;
+    uint64_t file_size;
+    uint64_t record_count;
+    uint64_t column_count;
+    uint64_t field_counts;
+    uint64_t columns;
+    // The delimiter, quote character << 8 and CSVread flags << 16 the cache was built with.
+    uint32_t dialect;
+    uint32_t end_record_not_terminated;
+};
+
+struct cache_column
+{
+    uint64_t encoding;
+    uint64_t present;
+    uint64_t values;
+    uint64_t strings;
+    uint64_t string_count;
+    uint64_t bytes;
+    uint64_t bytes_size;
+};
+
+// A column as it's built, before it's encoded.
+struct cache_build_column
+{
+    cache_build_column() : integers( true ) {}
+
+    // The bytes of the fields, and the offset in 'bytes' of each field.
+    string bytes;
+    vector<uint64_t> offsets;
+
+    // The present bitmap. Refer to the format.
+    vector<uint64_t> present;
+
+    // Whether or not every field that isn't empty is a canonical integer.
+    bool integers;
+};
+
+
+/* Parse a field as an integer if it's written the canonical way, that is the way format_integer()
+writes it: an optional minus sign and then up to 18 digits without leading zeros, or just 0.
+
+[ret][failure] (false) : The field is not a canonical integer.
+[ret][success] (true) : 'value' is set.
+*/
+static bool parse_integer( const char *p, size_t size, int64_t &value )
+{
+    const char *const end = p + size;
+
+    const bool negative = ( ( p != end ) && ( *p == '-' ) );
+    if( negative )
+    {
+        ++p;
+    }
+
+    const size_t digits = (size_t)( end - p );
+    if( !digits || ( digits > 18 ) || ( ( *p == '0' ) && ( ( digits > 1 ) || negative ) ) )
+    {
+        return false;
+    }
+
+    int64_t n = 0;
+    for( ; p != end; ++p )
+    {
+        if( (unsigned)( *p - '0' ) > 9 )
+        {
+            return false;
+        }
+        n = ( n * 10 ) + ( *p - '0' );
+    }
+
+    value = negative ? -n : n;
+    return true;
+}
+
+
+// Write 'value' the canonical way at the end of 'buf'. Returns where it begins.
+static char *format_integer( int64_t value, char ( &buf )[ 24 ] )
+{
+    char *p = buf + sizeof buf;
+    // parse_integer() only accepts 18 digits so the negation can't overflow.
+    uint64_t n = ( value < 0 ) ? (uint64_t)-value : (uint64_t)value;
+
+    do
+    {
+        *--p = (char)( '0' + ( n % 10 ) );
+        n /= 10;
+    } while( n );
+
+    if( value < 0 )
+    {
+        *--p = '-';
+    }
+
+    return p;
+}
+
+
+/* Identify a CSV file by its size, modification time and a hash of its first and last 64KB.
+
+[ret][failure] (false) : 'error_msg' is set.
+[ret][success] (true) : 'source' is set.
+*/
+static bool get_source( const string &filename, cache_source &source, string &error_msg )
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if( _stat64( filename.c_str(), &st ) )
+#else
+    struct stat st;
+    if( stat( filename.c_str(), &st ) )
+#endif
+    {
+        error_msg = "Failed getting the status of " + filename + ": " + errno_strerror( errno );
+        return false;
+    }
+
+    source.size = (uint64_t)st.st_size;
+    source.mtime = (int64_t)st.st_mtime;
+
+    const uint64_t sample = 65536;
+    const uint64_t head = min( source.size, sample );
+    const uint64_t tail = min( source.size - head, sample );
+    vector<char> buf( (size_t)( head + tail ) + 1 );
+
+    ifstream file( filename.c_str(), ios::in | ios::binary );
+    file.read( &buf[ 0 ], (streamsize)head );
+    if( tail )
+    {
+        file.seekg( (streamoff)( source.size - tail ) );
+        file.read( &buf[ (size_t)head ], (streamsize)tail );
+    }
+
+    if( !file )
+    {
+        error_msg = "Failed reading " + filename + ": " + ios_strerror( file.rdstate() );
+        return false;
+    }
+
+    source.hash = hash_bytes( &buf[ 0 ], (size_t)( head + tail ) );
+    return true;
+}
+
+
+/* Map a whole file for reading.
+
+[ret][failure] (false) : 'error_msg' is set.
+[ret][success] (true) : 'map' and 'size' are set.
+*/
+static bool map_file( const string &filename, const char *&map, uint64_t &size, string &error_msg )
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA( filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, NULL );
+    if( file == INVALID_HANDLE_VALUE )
+    {
+        error_msg = "Failed opening " + filename + ": " + win32_strerror( GetLastError() );
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if( !GetFileSizeEx( file, &file_size ) )
+    {
+        error_msg = "Failed getting the size of " + filename + ": " + win32_strerror( GetLastError() );
+        CloseHandle( file );
+        return false;
+    }
+
+    size = (uint64_t)file_size.QuadPart;
+    if( !size || ( size > SIZE_MAX ) )
+    {
+        error_msg = "The size of " + filename + " is 0 or too large to map.";
+        CloseHandle( file );
+        return false;
+    }
+
+    // The view keeps the file mapped after the handles are closed.
+    HANDLE mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+    void *view = mapping ? MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) : NULL;
+    if( !view )
+    {
+        error_msg = "Failed mapping " + filename + ": " + win32_strerror( GetLastError() );
+    }
+
+    if( mapping )
+    {
+        CloseHandle( mapping );
+    }
+    CloseHandle( file );
+#else
+    int fd = open( filename.c_str(), O_RDONLY );
+    if( fd == -1 )
+    {
+        error_msg = "Failed opening " + filename + ": " + errno_strerror( errno );
+        return false;
+    }
+
+    struct stat st;
+    if( fstat( fd, &st ) )
+    {
+        error_msg = "Failed getting the size of " + filename + ": " + errno_strerror( errno );
+        close( fd );
+        return false;
+    }
+
+    size = (uint64_t)st.st_size;
+    if( !size || ( size > SIZE_MAX ) )
+    {
+        error_msg = "The size of " + filename + " is 0 or too large to map.";
+        close( fd );
+        return false;
+    }
+
+    // The mapping remains after the file is closed.
+    void *view = mmap( NULL, (size_t)size, PROT_READ, MAP_SHARED, fd, 0 );
+    if( view == MAP_FAILED )
+    {
+        error_msg = "Failed mapping " + filename + ": " + errno_strerror( errno );
+        view = NULL;
+    }
+
+    close( fd );
+#endif
+
+    map = (const char *)view;
+    return !!view;
+}
+
+
+/* Replace file 'to' with file 'from', which is renamed. A process that has 'to' mapped keeps the
+old file, since it isn't changed; it's only unlinked. In Windows a file can't be replaced while
+it's mapped, so that fails instead.
+
+[ret][failure] (false) : 'error_msg' is set.
+[ret][success] (true)
+*/
+static bool replace_file( const string &from, const string &to, string &error_msg )
+{
+#ifdef _WIN32
+    if( !MoveFileExA( from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING ) )
+    {
+        error_msg = "Failed replacing " + to + ": " + win32_strerror( GetLastError() );
+        return false;
+    }
+#else
+    if( rename( from.c_str(), to.c_str() ) )
+    {
+        error_msg = "Failed replacing " + to + ": " + errno_strerror( errno );
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+
+static void unmap_file( const char *map, uint64_t size )
+{
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile( map );
+#else
+    munmap( (void *)map, (size_t)size );
+#endif
+}
+
+
+// Returns true if 'count' elements of 'element' bytes at 'offset' are within a file of 'size'.
+static bool in_bounds( uint64_t size, uint64_t offset, uint64_t count, uint64_t element )
+{
+    return !( offset % 8 ) && ( offset <= size ) && ( count <= ( ( size - offset ) / element ) );
+}
+
+
+// Write a section of 'size' bytes padded to a multiple of 8. Returns the offset of the section.
+static uint64_t write_section( ostream &out, uint64_t &pos, const void *data, uint64_t size )
+{
+    static const char zeros[ 8 ] = { 0 };
+    const uint64_t offset = pos;
+    const uint64_t padding = ( 8 - ( size % 8 ) ) % 8;
+
+    if( size )
+    {
+        out.write( (const char *)data, (streamsize)size );
+    }
+    out.write( zeros, (streamsize)padding );
+
+    pos += size + padding;
+    return offset;
+}
+
+template<class T> static uint64_t write_section( ostream &out, uint64_t &pos, const vector<T> &v )
+{
+    return write_section( out, pos, v.empty() ? NULL : &v[ 0 ], v.size() * sizeof( T ) );
+}
+
+
+// Encode a column and write its sections. 'column' is emptied.
+static cache_column write_column(
+    ostream &out,
+    uint64_t &pos,
+    cache_build_column &column,
+    uint64_t record_count
+)
+{
+    cache_column header;
+    memset( &header, 0, sizeof header );
+
+    column.offsets.resize( (size_t)record_count + 1, column.bytes.size() );
+    column.present.resize( (size_t)( ( record_count + 63 ) / 64 ) );
+    header.present = write_section( out, pos, column.present );
+
+    const uint64_t *offsets = &column.offsets[ 0 ];
+    const char *bytes = column.bytes.data();
+
+    const bool any = ( column.bytes.size() != 0 );
+    if( column.integers && any )
+    {
+        vector<int64_t> values( (size_t)record_count );
+        for( size_t r = 0; r < values.size(); ++r )
+        {
+            parse_integer( bytes + offsets[ r ], (size_t)( offsets[ r + 1 ] - offsets[ r ] ),
+                values[ r ] );
+        }
+
+        header.encoding = encoding_integers;
+        header.values = write_section( out, pos, values );
+        header.bytes = pos;
+    }
+    else
+    {
+        // Try a dictionary, and give up on it once there are too many distinct fields.
+        CSVdictionary dictionary;
+        vector<uint32_t> codes( (size_t)record_count );
+        bool use_dictionary = true;
+
+        for( size_t r = 0; r < codes.size(); ++r )
+        {
+            codes[ r ] = dictionary.Intern( bytes + offsets[ r ],
+                (size_t)( offsets[ r + 1 ] - offsets[ r ] ) );
+
+            if( ( dictionary.size() * 2 ) > record_count )
+            {
+                use_dictionary = false;
+                break;
+            }
+        }
+
+        if( use_dictionary )
+        {
+            vector<uint64_t> strings( 1, 0 );
+            string concatenated;
+            for( uint32_t code = 0; code < dictionary.size(); ++code )
+            {
+                concatenated += dictionary[ code ];
+                strings.push_back( concatenated.size() );
+            }
+
+            header.encoding = encoding_dictionary;
+            header.values = write_section( out, pos, codes );
+            header.strings = write_section( out, pos, strings );
+            header.string_count = dictionary.size();
+            header.bytes_size = concatenated.size();
+            header.bytes = write_section( out, pos, concatenated.data(), concatenated.size() );
+        }
+        else
+        {
+            header.encoding = encoding_strings;
+            header.values = write_section( out, pos, column.offsets );
+            header.bytes_size = column.bytes.size();
+            header.bytes = write_section( out, pos, bytes, column.bytes.size() );
+        }
+    }
+
+    string().swap( column.bytes );
+    vector<uint64_t>().swap( column.offsets );
+    vector<uint64_t>().swap( column.present );
+    return header;
+}
+
+
+
+
+CSVcache::CSVcache() :
+    error( _error ),
+    error_msg( _error_msg ),
+    stale( _stale ),
+    rebuilt( _rebuilt ),
+    eof( _eof ),
+    record_num( _record_num ),
+    end_record_num( _end_record_num ),
+    end_record_not_terminated( _end_record_not_terminated ),
+    fields( _fields ),
+    _map( NULL ),
+    _map_size( 0 )
+{
+    Close();
+}
+
+
+CSVcache::~CSVcache()
+{
+    Close();
+}
+
+
+void CSVcache::Close()
+{
+    if( _map )
+    {
+        unmap_file( _map, _map_size );
+    }
+
+    _map = NULL;
+    _map_size = 0;
+    _dialect = 0;
+    _error = false;
+    _error_msg = "";
+    _stale = false;
+    _rebuilt = false;
+    _eof = false;
+    _record_num = 0;
+    _end_record_num = 0;
+    _end_record_not_terminated = false;
+    _fields = vector<string>();
+}
+
+
+bool CSVcache::Fail( const string &msg )
+{
+    _error = true;
+    _error_msg = msg;
+    return false;
+}
+
+
+bool CSVcache::Build( CSVread &csv, const string &cache, const string &source /* = "" */ )
+{
+    Close();
+
+    cache_header header;
+    memset( &header, 0, sizeof header );
+
+    // The source is identified before it's read, so a change made while reading makes it stale.
+    if( !source.empty() && !get_source( source, header.source, _error_msg ) )
+    {
+        return Fail( _error_msg );
+    }
+
+    deque<cache_build_column> columns;
+    vector<uint32_t> field_counts;
+
+    while( csv.ReadRecord() )
+    {
+        const vector<string> &f = csv.fields;
+        const size_t r = field_counts.size();
+
+        if( f.size() > numeric_limits<uint32_t>::max() )
+        {
+            return Fail( "A record has too many fields for the cache." );
+        }
+
+        field_counts.push_back( (uint32_t)f.size() );
+
+        while( columns.size() < f.size() )
+        {
+            columns.push_back( cache_build_column() );
+        }
+
+        for( size_t c = 0; c < f.size(); ++c )
+        {
+            cache_build_column &column = columns[ c ];
+
+            // The records before this one that didn't have the column have empty fields.
+            column.offsets.resize( r + 1, column.bytes.size() );
+
+            const string &field = csv.Field( c );
+            if( field.empty() )
+            {
+                continue;
+            }
+
+            column.bytes += field;
+
+            if( column.present.size() <= ( r / 64 ) )
+            {
+                column.present.resize( ( r / 64 ) + 1 );
+            }
+            column.present[ r / 64 ] |= (uint64_t)1 << ( r % 64 );
+
+            int64_t value;
+            if( column.integers && !parse_integer( field.data(), field.size(), value ) )
+            {
+                column.integers = false;
+            }
+        }
+    }
+
+    if( !csv.eof || ( csv.record_num != csv.end_record_num ) )
+    {
+        return Fail( "CSVread: " + csv.error_msg );
+    }
+
+    /* The cache is written to a temporary file that then replaces it, rather than truncating it,
+    since it may be mapped by this or another process that would read the new bytes through the
+    old header. The temporary file is unique to this object in this process so that builds of the
+    same cache at the same time don't write to the same file.
+    */
+    ostringstream temp_ss;
+#ifdef _WIN32
+    temp_ss << cache << "." << GetCurrentProcessId() << "." << (const void *)this << ".tmp";
+#else
+    temp_ss << cache << "." << getpid() << "." << (const void *)this << ".tmp";
+#endif
+    const string temp = temp_ss.str();
+
+    ofstream out( temp.c_str(), ios::out | ios::binary | ios::trunc );
+    if( !out.is_open() )
+    {
+        return Fail( "Failed opening " + temp );
+    }
+
+    // The header is written last so that a partly written file is never valid.
+    uint64_t pos = 0;
+    write_section( out, pos, &header, sizeof header );
+
+    header.record_count = field_counts.size();
+    header.column_count = columns.size();
+    header.field_counts = write_section( out, pos, field_counts );
+
+    vector<cache_column> column_headers;
+    for( size_t c = 0; c < columns.size(); ++c )
+    {
+        column_headers.push_back( write_column( out, pos, columns[ c ], header.record_count ) );
+    }
+
+    header.columns = write_section( out, pos, column_headers );
+
+    memcpy( header.magic, cache_magic, sizeof header.magic );
+    header.version = cache_version;
+    header.byte_order = cache_byte_order;
+    header.file_size = pos;
+    header.dialect = (uint32_t)csv.GetDelimiter() | ( (uint32_t)csv.GetQuote() << 8 )
+        | ( (uint32_t)csv.GetFlags() << 16 );
+    header.end_record_not_terminated = csv.end_record_not_terminated;
+
+    out.seekp( 0 );
+    out.write( (const char *)&header, sizeof header );
+    out.close();
+
+    if( !out )
+    {
+        remove( temp.c_str() );
+        return Fail( "Failed writing " + temp + ": " + ios_strerror( out.rdstate() ) );
+    }
+
+    if( !replace_file( temp, cache, _error_msg ) )
+    {
+        remove( temp.c_str() );
+        return Fail( _error_msg );
+    }
+
+    return true;
+}
+
+
+bool CSVcache::Open( const string &cache, const string &source /* = "" */ )
+{
+    Close();
+
+    const char *map;
+    uint64_t size;
+    if( !map_file( cache, map, size, _error_msg ) )
+    {
+        return Fail( _error_msg );
+    }
+
+    _map = map;
+    _map_size = size;
+
+    const cache_header &h = *(const cache_header *)_map;
+
+    bool valid = ( size >= sizeof h )
+        && !memcmp( h.magic, cache_magic, sizeof h.magic )
+        && ( h.version == cache_version )
+        && ( h.byte_order == cache_byte_order )
+        && ( h.file_size == size )
+        && in_bounds( size, h.field_counts, h.record_count, sizeof( uint32_t ) )
+        && in_bounds( size, h.columns, h.column_count, sizeof( cache_column ) );
+
+    const cache_column *columns = valid ? (const cache_column *)( _map + h.columns ) : NULL;
+
+    for( uint64_t c = 0; valid && ( c < h.column_count ); ++c )
+    {
+        const cache_column &col = columns[ c ];
+
+        valid = in_bounds( size, col.present, ( h.record_count + 63 ) / 64, sizeof( uint64_t ) )
+            && in_bounds( size, col.bytes, col.bytes_size, 1 );
+
+        if( col.encoding == encoding_integers )
+        {
+            valid = valid && in_bounds( size, col.values, h.record_count, sizeof( int64_t ) );
+        }
+        else if( col.encoding == encoding_dictionary )
+        {
+            valid = valid && in_bounds( size, col.values, h.record_count, sizeof( uint32_t ) )
+                && ( col.string_count < size )
+                && in_bounds( size, col.strings, col.string_count + 1, sizeof( uint64_t ) );
+        }
+        else if( col.encoding == encoding_strings )
+        {
+            valid = valid && ( h.record_count < size )
+                && in_bounds( size, col.values, h.record_count + 1, sizeof( uint64_t ) );
+        }
+        else
+        {
+            valid = false;
+        }
+    }
+
+    if( !valid )
+    {
+        Close();
+        return Fail( cache + " is not a valid cache file, or was built on a different machine." );
+    }
+
+    if( !source.empty() )
+    {
+        cache_source current;
+        string msg;
+        if( !get_source( source, current, msg ) )
+        {
+            Close();
+            return Fail( msg );
+        }
+
+        if( memcmp( &current, &h.source, sizeof current ) )
+        {
+            Close();
+            _stale = true;
+            return Fail( "The cache " + cache + " is stale, " + source + " has changed." );
+        }
+    }
+
+    _dialect = h.dialect;
+    _end_record_num = h.record_count;
+    _end_record_not_terminated = !!h.end_record_not_terminated;
+    return true;
+}
+
+
+bool CSVcache::Load(
+    const string &source,
+    const string &cache,
+    CSVread::Flags flags /* = CSVread::none */,
+    unsigned char delimiter /* = ',' */,
+    unsigned char quote /* = '"' */
+)
+{
+    if( Open( cache, source ) )
+    {
+        const uint32_t dialect = (uint32_t)delimiter | ( (uint32_t)quote << 8 )
+            | ( (uint32_t)flags << 16 );
+        const uint32_t mask = ( flags & CSVread::sniff_dialect ) ? 0xFFFF0000 : 0xFFFFFFFF;
+
+        if( ( _dialect & mask ) == ( dialect & mask ) )
+        {
+            return true;
+        }
+    }
+
+    Close();
+
+    CSVread csv;
+    csv.SetDelimiter( delimiter );
+    csv.SetQuote( quote );
+    if( !csv.Open( source, flags ) )
+    {
+        return Fail( "CSVread: " + csv.error_msg );
+    }
+
+    if( !Build( csv, cache, source ) || !Open( cache, source ) )
+    {
+        return false;
+    }
+
+    _rebuilt = true;
+    return true;
+}
+
+
+bool CSVcache::ReadRecord( const uintmax_t requested_record_num /* = 0 */ )
+{
+    if( _error )
+        return false;
+
+    if( !_map )
+    {
+        return Fail( "A cache file is not open." );
+    }
+
+    const uintmax_t requested = requested_record_num ? requested_record_num : _record_num + 1;
+    if( requested > _end_record_num )
+    {
+        _eof = true;
+        return false;
+    }
+
+    const cache_header &h = *(const cache_header *)_map;
+    const uint32_t count = ( (const uint32_t *)( _map + h.field_counts ) )[ requested - 1 ];
+
+    if( count > h.column_count )
+    {
+        return Fail( "The cache is corrupt. A record has more fields than there are columns." );
+    }
+
+    _fields.resize( count );
+    for( uint32_t c = 0; c < count; ++c )
+    {
+        const char *data;
+        size_t size;
+        if( !GetField( requested, c, data, size ) )
+        {
+            return false;
+        }
+
+        _fields[ c ].assign( data, size );
+    }
+
+    _eof = false;
+    _record_num = requested;
+    return true;
+}
+
+
+bool CSVcache::GetField(
+    const uintmax_t requested_record_num,
+    const size_t column,
+    const char *&data,
+    size_t &size
+)
+{
+    if( _error || !_map || !requested_record_num || ( requested_record_num > _end_record_num ) )
+    {
+        return false;
+    }
+
+    const cache_header &h = *(const cache_header *)_map;
+    const size_t r = (size_t)( requested_record_num - 1 );
+
+    if( column >= ( (const uint32_t *)( _map + h.field_counts ) )[ r ] )
+    {
+        return false;
+    }
+
+    if( column >= h.column_count )
+    {
+        return Fail( "The cache is corrupt. A record has more fields than there are columns." );
+    }
+
+    const cache_column &col = ( (const cache_column *)( _map + h.columns ) )[ column ];
+
+    const uint64_t word = ( (const uint64_t *)( _map + col.present ) )[ r / 64 ];
+    if( !( ( word >> ( r % 64 ) ) & 1 ) )
+    {
+        data = "";
+        size = 0;
+        return true;
+    }
+
+    if( col.encoding == encoding_integers )
+    {
+        const int64_t value = ( (const int64_t *)( _map + col.values ) )[ r ];
+        data = format_integer( value, _number );
+        size = (size_t)( ( _number + sizeof _number ) - data );
+        return true;
+    }
+
+    const uint64_t *offsets;
+    uint64_t i;
+
+    if( col.encoding == encoding_dictionary )
+    {
+        i = ( (const uint32_t *)( _map + col.values ) )[ r ];
+        if( i >= col.string_count )
+        {
+            return Fail( "The cache is corrupt. A dictionary code is out of range." );
+        }
+        offsets = (const uint64_t *)( _map + col.strings );
+    }
+    else
+    {
+        i = r;
+        offsets = (const uint64_t *)( _map + col.values );
+    }
+
+    const uint64_t begin = offsets[ i ];
+    const uint64_t end = offsets[ i + 1 ];
+    if( ( begin > end ) || ( end > col.bytes_size ) )
+    {
+        return Fail( "The cache is corrupt. A field offset is out of range." );
+    }
+
+    data = _map + col.bytes + begin;
+    size = (size_t)( end - begin );
+    return true;
+}
+
+
+} // namespace util
+} // namespace jay
@@ -0,0 +1,142 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** A dictionary of interned strings.
+
+Documentation is in CSV.hpp.
+*/
+
+#include "CSV.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "hash.hpp"
+
+
+using namespace std;
+
+
+namespace jay {
+namespace util {
+
+
+const uint32_t CSVdictionary::no_code;
+
+
+CSVdictionary::CSVdictionary()
+{
+    Clear();
+}
+
+
+void CSVdictionary::Clear()
+{
+    deque<string>().swap( _strings );
+    vector<uint64_t>().swap( _hashes );
+    vector<uint32_t>( 64, no_code ).swap( _slots );
+}
+
+
+size_t CSVdictionary::Slot( const char *data, size_t size, uint64_t hash ) const
+{
+    const size_t mask = _slots.size() - 1;
+
+    for( size_t i = (size_t)hash & mask;; i = ( i + 1 ) & mask )
+    {
+        const uint32_t code = _slots[ i ];
+
+        if( ( code == no_code )
+            || ( ( _hashes[ code ] == hash )
+                && ( _strings[ code ].size() == size )
+                && !memcmp( _strings[ code ].data(), data, size ) )
+        )
+        {
+            return i;
+        }
+    }
+}
+
+
+void CSVdictionary::Grow()
+{
+    vector<uint32_t>( _slots.size() * 2, no_code ).swap( _slots );
+
+    const size_t mask = _slots.size() - 1;
+
+    for( uint32_t code = 0; code < _strings.size(); ++code )
+    {
+        size_t i = (size_t)_hashes[ code ] & mask;
+
+        while( _slots[ i ] != no_code )
+        {
+            i = ( i + 1 ) & mask;
+        }
+
+        _slots[ i ] = code;
+    }
+}
+
+
+uint32_t CSVdictionary::Intern( const char *data, size_t size )
+{
+    const uint64_t hash = hash_bytes( data, size );
+    size_t i = Slot( data, size, hash );
+
+    if( _slots[ i ] != no_code )
+    {
+        return _slots[ i ];
+    }
+
+    if( _strings.size() == no_code )
+    {
+        return no_code;
+    }
+
+    // The table is kept at most half full so that probe sequences stay short.
+    if( ( ( _strings.size() + 1 ) * 2 ) > _slots.size() )
+    {
+        Grow();
+        i = Slot( data, size, hash );
+    }
+
+    const uint32_t code = (uint32_t)_strings.size();
+    _strings.push_back( string( data, size ) );
+    _hashes.push_back( hash );
+    _slots[ i ] = code;
+
+    return code;
+}
+
+
+uint32_t CSVdictionary::Find( const char *data, size_t size ) const
+{
+    return _slots[ Slot( data, size, hash_bytes( data, size ) ) ];
+}
+
+
+} // namespace util
+} // namespace jay
@@ -0,0 +1,385 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Distribute the records of one CSV stream to worker threads.
+
+Documentation is in CSVdistribute.hpp.
+*/
+
+#include "CSVdistribute.hpp"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+
+using namespace std;
+
+
+namespace jay {
+namespace util {
+
+
+/* A bounded multi-producer multi-consumer queue of blocks.
+
+This is Dmitry Vyukov's bounded MPMC queue. Each cell has a sequence number that says whether it's
+ready to be pushed to or popped from for the current lap around the buffer, so a push or pop is one
+compare-exchange of a position and there are no locks. Push fails if the queue is full and Pop fails
+if it's empty; the caller decides how to wait.
+*/
+class block_queue
+{
+public:
+    // 'capacity' is rounded up to a power of 2.
+    explicit block_queue( size_t capacity )
+    {
+        size_t size = 2;
+        while( size < capacity )
+        {
+            size *= 2;
+        }
+
+        vector<cell>( size ).swap( _cells );
+        for( size_t i = 0; i < size; ++i )
+        {
+            _cells[ i ].sequence.store( i, memory_order_relaxed );
+        }
+
+        _mask = size - 1;
+        _push_pos.store( 0, memory_order_relaxed );
+        _pop_pos.store( 0, memory_order_relaxed );
+    }
+
+    bool Push( CSVdistribute::Block *block )
+    {
+        cell *c;
+        size_t pos = _push_pos.load( memory_order_relaxed );
+
+        for( ;; )
+        {
+            c = &_cells[ pos & _mask ];
+            const size_t seq = c->sequence.load( memory_order_acquire );
+            const intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+            if( !dif )
+            {
+                if( _push_pos.compare_exchange_weak( pos, pos + 1, memory_order_relaxed ) )
+                    break;
+            }
+            else if( dif < 0 )
+                return false;
+            else
+                pos = _push_pos.load( memory_order_relaxed );
+        }
+
+        c->block = block;
+        c->sequence.store( pos + 1, memory_order_release );
+        return true;
+    }
+
+    bool Pop( CSVdistribute::Block *&block )
+    {
+        cell *c;
+        size_t pos = _pop_pos.load( memory_order_relaxed );
+
+        for( ;; )
+        {
+            c = &_cells[ pos & _mask ];
+            const size_t seq = c->sequence.load( memory_order_acquire );
+            const intptr_t dif = (intptr_t)seq - (intptr_t)( pos + 1 );
+
+            if( !dif )
+            {
+                if( _pop_pos.compare_exchange_weak( pos, pos + 1, memory_order_relaxed ) )
+                    break;
+            }
+            else if( dif < 0 )
+                return false;
+            else
+                pos = _pop_pos.load( memory_order_relaxed );
+        }
+
+        block = c->block;
+        c->sequence.store( pos + _mask + 1, memory_order_release );
+        return true;
+    }
+
+private:
+    struct cell
+    {
+        cell() : block( NULL ) {}
+        cell( const cell & ) : block( NULL ) {}
+        atomic<size_t> sequence;
+        CSVdistribute::Block *block;
+    };
+
+    vector<cell> _cells;
+    size_t _mask;
+
+    // The positions are kept on separate cache lines so pushers and poppers don't contend.
+    char _pad0[ 64 ];
+    atomic<size_t> _push_pos;
+    char _pad1[ 64 ];
+    atomic<size_t> _pop_pos;
+    char _pad2[ 64 ];
+};
+
+
+/* Wait for another thread, a little longer each time.
+
+The waits are short at first, because the other side of a queue usually catches up quickly, and
+then sleeps so that an idle thread doesn't take a core.
+*/
+class backoff
+{
+public:
+    backoff() : _count( 0 ) {}
+
+    void Wait()
+    {
+        if( _count < 64 )
+            ++_count;
+        else if( _count < 128 )
+        {
+            ++_count;
+            this_thread::yield();
+        }
+        else
+            this_thread::sleep_for( chrono::microseconds( 100 ) );
+    }
+
+    void Reset() { _count = 0; }
+
+private:
+    unsigned _count;
+};
+
+
+
+/* The state shared by the threads during CSVdistribute::Run(). */
+struct distribute_state
+{
+    distribute_state( size_t block_count )
+        : free_blocks( block_count ), work( block_count ), done( block_count )
+    {
+        for( size_t i = 0; i < done.size(); ++i )
+        {
+            done[ i ].store( NULL, memory_order_relaxed );
+        }
+
+        reading_done.store( false, memory_order_relaxed );
+        blocks_read.store( 0, memory_order_relaxed );
+    }
+
+    // The blocks that are ready to be filled, and the blocks that are waiting for a worker.
+    block_queue free_blocks, work;
+
+    /* The blocks that are waiting for output, in slot ( sequence % block_count ).
+
+    The blocks waiting for output or being processed all have sequence numbers from the next to be
+    output up to fewer than block_count after it, because there are no more blocks than that. So
+    there's never more than one block for a slot.
+    */
+    vector<atomic<CSVdistribute::Block *>> done;
+
+    // The number of blocks read, which is stored before reading_done is set.
+    atomic<uintmax_t> blocks_read;
+    atomic<bool> reading_done;
+};
+
+
+static void worker_thread(
+    distribute_state *state,
+    const atomic<bool> *stop,
+    const CSVdistribute::Process *process,
+    bool ordered,
+    size_t worker
+)
+{
+    backoff wait;
+
+    for( ;; )
+    {
+        /* reading_done is checked before the pop. If it was set and then the pop fails the queue is
+        empty for good, since all the pushes were done before it was set.
+        */
+        const bool reading_done = state->reading_done.load( memory_order_acquire );
+
+        CSVdistribute::Block *block;
+        if( !state->work.Pop( block ) )
+        {
+            if( reading_done )
+                return;
+
+            wait.Wait();
+            continue;
+        }
+
+        wait.Reset();
+
+        if( !stop->load( memory_order_relaxed ) )
+        {
+            ( *process )( *block, worker );
+        }
+
+        if( ordered )
+        {
+            const size_t slot = (size_t)( block->sequence % state->done.size() );
+            state->done[ slot ].store( block, memory_order_release );
+        }
+        else
+        {
+            state->free_blocks.Push( block );
+        }
+    }
+}
+
+
+static void output_thread(
+    distribute_state *state,
+    const atomic<bool> *stop,
+    const CSVdistribute::Output *output
+)
+{
+    backoff wait;
+
+    for( uintmax_t next = 0;; )
+    {
+        atomic<CSVdistribute::Block *> &slot = state->done[ (size_t)( next % state->done.size() ) ];
+        CSVdistribute::Block *block = slot.load( memory_order_acquire );
+
+        if( !block )
+        {
+            if( state->reading_done.load( memory_order_acquire )
+                && ( next == state->blocks_read.load( memory_order_acquire ) )
+            )
+            {
+                return;
+            }
+
+            wait.Wait();
+            continue;
+        }
+
+        wait.Reset();
+        slot.store( NULL, memory_order_relaxed );
+
+        if( !stop->load( memory_order_relaxed ) )
+        {
+            ( *output )( *block );
+        }
+
+        state->free_blocks.Push( block );
+        ++next;
+    }
+}
+
+
+
+CSVdistribute::CSVdistribute(
+    CSVread &csv,
+    size_t workers,
+    size_t block_size,
+    size_t block_count
+) :
+    workers( workers ? workers : 1 ),
+    block_size( block_size ? block_size : 1 ),
+    block_count( ( block_count > this->workers ) ? block_count : ( this->workers * 4 ) ),
+    _csv( csv )
+{
+    _stop = false;
+}
+
+
+bool CSVdistribute::Run( const Process &process, const Output &output )
+{
+    _stop = false;
+
+    const bool ordered = !!output;
+    distribute_state state( block_count );
+
+    vector<Block> blocks( block_count );
+    for( size_t i = 0; i < blocks.size(); ++i )
+    {
+        blocks[ i ].records.resize( block_size );
+        blocks[ i ].size = 0;
+        state.free_blocks.Push( &blocks[ i ] );
+    }
+
+    vector<thread> threads;
+    for( size_t i = 0; i < workers; ++i )
+    {
+        threads.push_back( thread( worker_thread, &state, &_stop, &process, ordered, i ) );
+    }
+    if( ordered )
+    {
+        threads.push_back( thread( output_thread, &state, &_stop, &output ) );
+    }
+
+    backoff wait;
+    uintmax_t sequence = 0;
+    CSVread::iterator it = _csv.begin(), end = _csv.end();
+
+    while( ( it != end ) && !_stop )
+    {
+        Block *block;
+        if( !state.free_blocks.Pop( block ) )
+        {
+            // All the blocks are in use. Wait for a worker to finish one.
+            wait.Wait();
+            continue;
+        }
+
+        wait.Reset();
+
+        block->size = 0;
+        block->record_num = _csv.record_num;
+        block->sequence = sequence++;
+
+        for( ; ( it != end ) && ( block->size < block_size ); ++it )
+        {
+            // Dereferencing unescapes the fields, and copies the interned fields, since the
+            // workers' records have no Field().
+            block->records[ block->size++ ].swap( *it );
+        }
+
+        // The work queue holds every block so this can't fail.
+        state.work.Push( block );
+        state.blocks_read.store( sequence, memory_order_release );
+    }
+
+    state.reading_done.store( true, memory_order_release );
+
+    for( size_t i = 0; i < threads.size(); ++i )
+    {
+        threads[ i ].join();
+    }
+
+    return !_stop && _csv.eof && ( _csv.record_num == _csv.end_record_num );
+}
+
+
+} // namespace util
+} // namespace jay
@@ -0,0 +1,159 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Usage and design:
+
+class CSVdistribute
+- A class to parse a CSV stream on one thread and process its records on many.
+
+Unlike CSV.hpp this header requires C++11 threads and atomics (Visual Studio 2012 or later).
+
+Records are read by CSVread on the thread that calls Run() and moved, not copied, into blocks of
+records. Each block is handed through a lock-free queue to one of the worker threads, which calls
+your function to process it. A fixed number of blocks is allocated up front and they are reused:
+when a block has been processed it goes back to the reader to be filled again. If all the blocks
+are in use the reader waits, so a slow worker holds back parsing rather than memory growing.
+
+If you pass an output function the blocks are also passed to it, on a separate thread, in the order
+they were read. That's for when the results of processing have to be written in the same order as
+the input.
+
+jay::util::CSVread csv( "filename" );
+jay::util::CSVdistribute dist( csv, 4 ); // 4 worker threads
+bool b = dist.Run(
+    []( jay::util::CSVdistribute::Block &block, size_t worker )
+    {
+        for( size_t i = 0; i < block.size; ++i )
+        {
+            block.records[ i ] is record number block.record_num + i
+        }
+    }
+);
+if( !b ) { handle it. not all records were read, check csv.error_msg }
+*/
+
+#ifndef JAY_UTIL_CSVDISTRIBUTE_HPP_
+#define JAY_UTIL_CSVDISTRIBUTE_HPP_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "CSV.hpp"
+
+
+namespace jay {
+namespace util {
+
+
+class CSVdistribute
+{
+public:
+    // A block of consecutive records.
+    struct Block
+    {
+        /* The records. Only the first 'size' of them are the records of this block, any others are
+        left over from when the block was last used.
+
+        The records may be modified or moved from. The block is refilled by swapping each record
+        with one that was just parsed, so a record left as it is goes back to CSVread and is freed
+        there; nothing is gained by clearing it.
+
+        The fields are unescaped, and those of interned columns copied from the dictionary, so
+        records[i][j] is the field's value whatever the CSVread flags.
+        */
+        std::vector<CSVread::Record> records;
+        size_t size;
+
+        // The record number of records[ 0 ].
+        uintmax_t record_num;
+
+        // The blocks are numbered from 0 in the order they're read.
+        uintmax_t sequence;
+    };
+
+    // Process a block. 'worker' is the index of the worker thread, from 0.
+    typedef std::function<void ( Block &block, size_t worker )> Process;
+
+    // Output a block that has been processed.
+    typedef std::function<void ( Block &block )> Output;
+
+
+    /* Constructor
+
+    [in] 'csv' : The records to read. It must be opened or associated before Run().
+    [in] 'workers' : The number of worker threads. At least 1.
+    [in][opt] 'block_size' : The number of records in a block. The default is 256.
+    [in][opt] 'block_count' : The number of blocks. The default is 4 per worker. At least 1 more
+        than the number of workers.
+    */
+    CSVdistribute( CSVread &csv, size_t workers, size_t block_size = 256, size_t block_count = 0 );
+
+
+    /* CSVdistribute::Run()
+    - Read all remaining records and process them.
+
+    Returns when all the records read have been processed (and output), and the worker and output
+    threads have ended.
+
+    'process' is called concurrently by the worker threads, each with a different block. 'output'
+    is called on one thread, with each block after it's processed and in the order the blocks were
+    read. Neither function may throw.
+
+    [in] 'process' : Called to process each block.
+    [in][opt] 'output' : Called to output each block in order. The default is none.
+    [ret][failure] (false) : Not all records were read. Either Stop() was called, or
+        csv.error_msg has the reason.
+    [ret][success] (true) : The end record was read and all the records were processed.
+    */
+    bool Run( const Process &process, const Output &output = Output() );
+
+
+    /* CSVdistribute::Stop()
+    - Stop reading records.
+
+    This may be called from 'process' or 'output' or any other thread while Run() is running. No
+    more records are read, and the blocks that haven't been processed or output are discarded.
+    */
+    void Stop() { _stop = true; }
+
+    // Stop() was called during the last Run().
+    bool stopped() const { return _stop; }
+
+    const size_t workers;
+    const size_t block_size;
+    const size_t block_count;
+
+private:
+    CSVdistribute( const CSVdistribute & );
+    CSVdistribute & operator=( const CSVdistribute & );
+
+    CSVread &_csv;
+    std::atomic<bool> _stop;
+};
+
+
+} // namespace util
+} // namespace jay
+#endif // JAY_UTIL_CSVDISTRIBUTE_HPP_
@@ -0,0 +1,617 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/** Append records to a file durably, committing them in groups on a background thread.
+
+Documentation is in CSVdurablewrite.hpp.
+*/
+
+#include "CSVdurablewrite.hpp"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <errno.h>
+#include <limits.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "strerror.hpp"
+
+
+using namespace std;
+
+
+namespace jay {
+namespace util {
+
+
+// A streambuf that appends what's written to it to a string.
+class record_streambuf : public streambuf
+{
+public:
+    explicit record_streambuf( string *target ) : _target( target ) {}
+
+protected:
+    streamsize xsputn( const char *s, streamsize n )
+    {
+        _target->append( s, (size_t)n );
+        return n;
+    }
+
+    int_type overflow( int_type c )
+    {
+        if( !traits_type::eq_int_type( c, traits_type::eof() ) )
+        {
+            _target->push_back( traits_type::to_char_type( c ) );
+        }
+
+        return traits_type::not_eof( c );
+    }
+
+private:
+    string *_target;
+};
+
+
+/* The state shared with the commit thread between CSVdurablewrite::Open() and Close(). */
+struct commit_state
+{
+    commit_state() : fd( -1 ), queued_end( 0 ), durable_end( 0 ), waiters( 0 ), stop( false ),
+        failed( false ) {}
+
+    int fd;
+
+    /* The records written and not yet taken by the commit thread, and the ticket of the last one.
+    'queued_since' is when the first of them was queued.
+    */
+    string queue;
+    CSVdurablewrite::Ticket queued_end;
+    chrono::steady_clock::time_point queued_since;
+
+    // The ticket of the last record that's on disk.
+    CSVdurablewrite::Ticket durable_end;
+
+    // The number of callers in WaitDurable().
+    size_t waiters;
+
+    // Close() was called. The commit thread ends when the queue is committed.
+    bool stop;
+
+    // A commit failed. Nothing more is committed.
+    bool failed;
+    string error_msg;
+
+    // 'work' is signaled for the commit thread and 'done' for the callers. All the members above
+    // except 'fd' are only accessed with 'lock' held.
+    mutex lock;
+    condition_variable work;
+    condition_variable done;
+
+    thread committer;
+};
+
+
+/* Write to a file descriptor. A short write is continued and an interrupted one is retried.
+
+[ret][failure] (the errno value)
+[ret][success] (0)
+*/
+static int write_all( int fd, const char *data, size_t size )
+{
+    while( size )
+    {
+#ifdef _WIN32
+        const unsigned count = ( size < INT_MAX ) ? (unsigned)size : INT_MAX;
+        const int written = _write( fd, data, count );
+#else
+        const size_t count = ( size < SSIZE_MAX ) ? size : SSIZE_MAX;
+        const ssize_t written = write( fd, data, count );
+#endif
+
+        if( written < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+
+            return errno;
+        }
+
+        data += written;
+        size -= (size_t)written;
+    }
+
+    return 0;
+}
+
+
+/* Make what's been written to a file descriptor durable.
+
+[ret][failure] (the errno value)
+[ret][success] (0)
+*/
+static int sync_fd( int fd )
+{
+#ifdef _WIN32
+    return _commit( fd ) ? errno : 0;
+#else
+    while( fsync( fd ) )
+    {
+        if( errno != EINTR )
+            return errno;
+    }
+
+    return 0;
+#endif
+}
+
+
+/* Get the size of a file and read up to 'count' bytes from the end of it into 'tail'.
+
+[ret][failure] (the errno value)
+[ret][success] (0)
+*/
+static int read_tail( int fd, size_t count, uint64_t *size, string *tail )
+{
+#ifdef _WIN32
+    const __int64 end = _lseeki64( fd, 0, SEEK_END );
+#else
+    const off_t end = lseek( fd, 0, SEEK_END );
+#endif
+
+    if( end < 0 )
+        return errno;
+
+    *size = (uint64_t)end;
+    tail->resize( ( (uint64_t)count < *size ) ? count : (size_t)*size );
+
+#ifdef _WIN32
+    if( _lseeki64( fd, end - (__int64)tail->size(), SEEK_SET ) < 0 )
+        return errno;
+#else
+    if( lseek( fd, end - (off_t)tail->size(), SEEK_SET ) < 0 )
+        return errno;
+#endif
+
+    size_t done = 0;
+
+    while( done < tail->size() )
+    {
+#ifdef _WIN32
+        const int got = _read( fd, &(*tail)[ done ], (unsigned)( tail->size() - done ) );
+#else
+        const ssize_t got = read( fd, &(*tail)[ done ], tail->size() - done );
+#endif
+
+        if( got < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+
+            return errno;
+        }
+
+        if( !got )
+            return EIO;
+
+        done += (size_t)got;
+    }
+
+    return 0;
+}
+
+
+/* Close a file descriptor.
+
+[ret][failure] (-1) : errno is set.
+[ret][success] (0)
+*/
+static int close_fd( int fd )
+{
+#ifdef _WIN32
+    return _close( fd );
+#else
+    return close( fd );
+#endif
+}
+
+
+
+CSVdurablewrite::CSVdurablewrite() :
+    delimiter( "," ), terminator( "\n" ),
+    commit_bytes( _commit_bytes ), commit_milliseconds( _commit_milliseconds ),
+    error( _error ), error_msg( _error_msg ),
+    _record_buf( new record_streambuf( &_record ) ), _record_stream( _record_buf.get() ),
+    _commit_bytes( 1 << 20 ), _commit_milliseconds( 100 ), _error( false )
+{
+}
+
+
+CSVdurablewrite::CSVdurablewrite( string filename, CSVwrite::Flags flags /* = none */ ) :
+    delimiter( "," ), terminator( "\n" ),
+    commit_bytes( _commit_bytes ), commit_milliseconds( _commit_milliseconds ),
+    error( _error ), error_msg( _error_msg ),
+    _record_buf( new record_streambuf( &_record ) ), _record_stream( _record_buf.get() ),
+    _commit_bytes( 1 << 20 ), _commit_milliseconds( 100 ), _error( false )
+{
+    Open( filename, flags );
+}
+
+
+CSVdurablewrite::~CSVdurablewrite()
+{
+    Close();
+}
+
+
+bool CSVdurablewrite::SetCommit( size_t bytes, unsigned milliseconds )
+{
+    if( _error )
+        return false;
+
+    if( _state )
+    {
+        _error = true;
+        _error_msg = "The commit settings can't be changed while a file is open. Call Close() first.";
+        return false;
+    }
+
+    _commit_bytes = bytes;
+    _commit_milliseconds = milliseconds;
+    return true;
+}
+
+
+bool CSVdurablewrite::Open( string filename, const CSVwrite::Flags flags /* = none */ )
+{
+    if( _error )
+        return false;
+
+    if( _state )
+    {
+        _error = true;
+        _error_msg = "A file is already open. Call Close() first.";
+        return false;
+    }
+
+    if( ( flags & CSVwrite::text_mode ) )
+    {
+        _error = true;
+        _error_msg = "Text mode is not supported. The file is written in binary mode.";
+        return false;
+    }
+
+    // The file is opened for reading too, to check its end record.
+    int oflag = ( ( flags & CSVwrite::truncate ) ) ? O_TRUNC : 0;
+
+#ifdef _WIN32
+    const int fd = _open( filename.c_str(), _O_RDWR | _O_CREAT | _O_APPEND | _O_BINARY | oflag,
+        _S_IREAD | _S_IWRITE );
+#else
+    const int fd = open( filename.c_str(), O_RDWR | O_CREAT | O_APPEND | oflag, 0666 );
+#endif
+
+    if( fd < 0 )
+    {
+        _error = true;
+        _error_msg = "Failed opening " + filename + ": " + errno_strerror( errno );
+        return false;
+    }
+
+    // The end record is terminated if the file ends with the terminator, or with CR or LF, which
+    // CSVread recognizes as terminators. The tail read has room for either, and for a UTF-8 BOM.
+    uint64_t size = 0;
+    string tail;
+    const int err = read_tail( fd, ( terminator.size() > 3 ) ? terminator.size() : 3, &size, &tail );
+
+    if( err )
+    {
+        close_fd( fd );
+        _error = true;
+        _error_msg = "Failed reading the end of " + filename + ": " + errno_strerror( err );
+        return false;
+    }
+
+    const bool terminated = !size
+        || ( ( size == 3 ) && ( tail == "\xEF\xBB\xBF" ) )
+        || ( tail[ tail.size() - 1 ] == '\r' ) || ( tail[ tail.size() - 1 ] == '\n' )
+        || ( !terminator.empty() && ( tail.size() >= terminator.size() )
+            && !tail.compare( tail.size() - terminator.size(), terminator.size(), terminator ) );
+
+    if( !terminated )
+    {
+        close_fd( fd );
+        _error = true;
+        _error_msg = "The end record of " + filename + " is not terminated. Appending to it would "
+            "corrupt it.";
+        return false;
+    }
+
+    _csv.delimiter = delimiter;
+    _csv.terminator = terminator;
+
+    if( !_csv.Associate( &_record_stream, (CSVwrite::Flags)( flags
+        & ( CSVwrite::process_empty_records | CSVwrite::minimal_quoting ) ) ) )
+    {
+        close_fd( fd );
+        _error = true;
+        _error_msg = _csv.error_msg;
+        _csv.Close();
+        return false;
+    }
+
+    // The tickets are positions in the file, so they start where it ends.
+    _state.reset( new commit_state );
+    _state->fd = fd;
+    _state->queued_end = size;
+    _state->durable_end = size;
+    _state->committer = thread( &CSVdurablewrite::Run, this );
+
+    return true;
+}
+
+
+bool CSVdurablewrite::Close()
+{
+    if( !_state )
+    {
+        const bool closed = !_error;
+        _error = false;
+        _error_msg.clear();
+        return closed;
+    }
+
+    // The commit thread commits what's queued before it ends.
+    {
+        lock_guard<mutex> lock( _state->lock );
+        _state->stop = true;
+        _state->work.notify_one();
+    }
+
+    _state->committer.join();
+
+    bool closed = !_error && !_state->failed;
+    string close_error_msg = _error ? _error_msg : _state->error_msg;
+
+    // The callers waiting are all answered once the commit thread has ended. They have to leave
+    // before the state is freed.
+    {
+        unique_lock<mutex> lock( _state->lock );
+
+        while( _state->waiters )
+        {
+            _state->done.wait( lock );
+        }
+    }
+
+    if( close_fd( _state->fd ) && closed )
+    {
+        closed = false;
+        close_error_msg = "Failed closing the file: " + errno_strerror( errno );
+    }
+
+    _state.reset();
+    _csv.Close();
+    _record.clear();
+
+    _error = !closed;
+    _error_msg = closed ? "" : close_error_msg;
+    return closed;
+}
+
+
+bool CSVdurablewrite::WriteRecord( const vector<string> &fields, Ticket *ticket /* = NULL */ )
+{
+    if( _error )
+        return false;
+
+    if( !_state )
+    {
+        _error = true;
+        _error_msg = "A file is not open.";
+        return false;
+    }
+
+    // The record is formatted here, so the commit thread only has whole records to write.
+    _record.clear();
+    if( !_csv.WriteRecord( fields ) || !_csv.Flush() )
+    {
+        _error = true;
+        _error_msg = _csv.error_msg;
+        return false;
+    }
+
+    unique_lock<mutex> lock( _state->lock );
+
+    while( ( _state->queue.size() >= ( _commit_bytes * 4 ) ) && _state->queue.size()
+        && !_state->failed
+    )
+    {
+        _state->done.wait( lock );
+    }
+
+    if( _state->failed )
+    {
+        _error = true;
+        _error_msg = _state->error_msg;
+        return false;
+    }
+
+    const bool first = _state->queue.empty();
+    if( first )
+    {
+        _state->queued_since = chrono::steady_clock::now();
+    }
+
+    _state->queue += _record;
+    _state->queued_end += _record.size();
+
+    if( ticket )
+    {
+        *ticket = _state->queued_end;
+    }
+
+    // The commit thread waits without a deadline when nothing is queued, and with one otherwise.
+    if( first || ( _state->queue.size() >= _commit_bytes ) )
+    {
+        _state->work.notify_one();
+    }
+
+    return true;
+}
+
+
+bool CSVdurablewrite::WaitDurable( const Ticket ticket )
+{
+    commit_state *state = _state.get();
+    if( !state )
+        return false;
+
+    unique_lock<mutex> lock( state->lock );
+
+    if( ticket > state->queued_end )
+        return false;
+
+    ++state->waiters;
+    state->work.notify_one();
+
+    while( ( state->durable_end < ticket ) && !state->failed )
+    {
+        state->done.wait( lock );
+    }
+
+    // The last one to leave after Close() has stopped the commit thread lets it free the state.
+    if( !--state->waiters && state->stop )
+    {
+        state->done.notify_all();
+    }
+
+    return ( state->durable_end >= ticket );
+}
+
+
+bool CSVdurablewrite::Commit()
+{
+    if( _error )
+        return false;
+
+    if( !_state )
+    {
+        _error = true;
+        _error_msg = "A file is not open.";
+        return false;
+    }
+
+    Ticket end;
+    {
+        lock_guard<mutex> lock( _state->lock );
+        end = _state->queued_end;
+    }
+
+    if( WaitDurable( end ) )
+        return true;
+
+    lock_guard<mutex> lock( _state->lock );
+    _error = true;
+    _error_msg = _state->error_msg;
+    return false;
+}
+
+
+void CSVdurablewrite::Run()
+{
+    commit_state *state = _state.get();
+    string records;
+
+    unique_lock<mutex> lock( state->lock );
+
+    while( !state->failed )
+    {
+        if( state->queue.empty() )
+        {
+            if( state->stop )
+                return;
+
+            state->work.wait( lock );
+            continue;
+        }
+
+        // Without a reason to commit now, wait for one or for the oldest record's time to be up.
+        if( !state->stop && !state->waiters && ( state->queue.size() < _commit_bytes ) )
+        {
+            const chrono::steady_clock::time_point deadline = state->queued_since
+                + chrono::milliseconds( _commit_milliseconds );
+
+            if( chrono::steady_clock::now() < deadline )
+            {
+                state->work.wait_until( lock, deadline );
+                continue;
+            }
+        }
+
+        // The queue is swapped, so the writer gets the empty string of the last commit.
+        records.swap( state->queue );
+        const Ticket end = state->queued_end;
+        lock.unlock();
+
+        int err = write_all( state->fd, records.data(), records.size() );
+        const char *what = "writing to";
+
+        if( !err )
+        {
+            err = sync_fd( state->fd );
+            what = "syncing";
+        }
+
+        records.clear();
+        lock.lock();
+
+        if( err )
+        {
+            state->failed = true;
+            state->error_msg = string( "Failed " ) + what + " the file: " + errno_strerror( err );
+        }
+        else
+        {
+            state->durable_end = end;
+        }
+
+        state->done.notify_all();
+    }
+}
+
+
+} // namespace util
+} // namespace jay
@@ -0,0 +1,221 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/** Usage and design:
+
+class CSVdurablewrite
+- A class to append records to a file so that they survive a crash, committing them in groups.
+
+Unlike CSV.hpp this header requires C++11 threads (Visual Studio 2012 or later).
+
+Making each record durable on its own --write it, flush, fsync-- costs a disk round trip per
+record. This class does a group commit instead. WriteRecord() formats the record and queues it, and
+returns a ticket for it. A commit thread writes the queued records to the file and fsyncs it, so one
+fsync covers every record queued since the last one. It commits when:
+- a caller is waiting in WaitDurable(), or
+- 'commit_bytes' are queued, or
+- the oldest queued record has waited 'commit_milliseconds'.
+
+WaitDurable( ticket ) returns once the record with that ticket, and every record before it, is on
+disk. It can be called from any thread, so a writer can hand the ticket of a record to whoever needs
+to know it's safe.
+
+Only whole records are queued and written, each with its terminator, so the file only ever ends in
+the middle of a record if the system crashed during a write. Open() checks for that: appending to a
+file whose end record isn't terminated would corrupt both records, so it's an error. Refer to the
+FAQ in README.md for how to repair such a file.
+
+The file is written with system calls, in binary mode. If it's created by Open() the directory entry
+isn't synced; create the file beforehand if that matters.
+
+jay::util::CSVdurablewrite log( "audit.csv" );
+if( log.error ) { initialization failed, handle it }
+jay::util::CSVdurablewrite::Ticket ticket;
+if( !log.WriteRecord( record, &ticket ) ) { handle it. check log.error_msg }
+if( !log.WaitDurable( ticket ) ) { the record may not be on disk. check log.error_msg }
+if( !log.Close() ) { handle it. check log.error_msg }
+*/
+
+#ifndef JAY_UTIL_CSVDURABLEWRITE_HPP_
+#define JAY_UTIL_CSVDURABLEWRITE_HPP_
+
+#include <stdint.h>
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "CSV.hpp"
+
+
+namespace jay {
+namespace util {
+
+
+class record_streambuf;
+struct commit_state;
+
+
+class CSVdurablewrite
+{
+public:
+    // The position in the file just after a record, which identifies it.
+    typedef uint64_t Ticket;
+
+
+    /* Constructor
+    The constructor also calls Open() if a filename is specified.
+
+    In any case check 'error' to determine whether or not construction succeeded.
+
+    [in] 'filename' : A file to open for appending.
+    [in][opt] 'flags' : Refer to CSVwrite::Flags. The default is no flags are set.
+    */
+    CSVdurablewrite();
+    CSVdurablewrite( std::string filename, CSVwrite::Flags flags = CSVwrite::none );
+
+    // Close() is called when the class destructs. There's no way to report an error then.
+    ~CSVdurablewrite();
+
+
+    /* CSVdurablewrite::Open()
+    - Open a file for appending and start the commit thread.
+
+    The file is appended to unless 'flags' has CSVwrite::truncate. If it's not empty its end record
+    must be terminated, with 'terminator' or with CR or LF. A file that's only a UTF-8 BOM is
+    considered empty.
+
+    'delimiter' and 'terminator' are used from here until Close(), so set them before this.
+
+    [in] 'filename' : A file to open for appending.
+    [in][opt] 'flags' : Refer to CSVwrite::Flags. CSVwrite::text_mode is an error. The default is no
+        flags are set.
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true)
+    */
+    bool Open( std::string filename, CSVwrite::Flags flags = CSVwrite::none );
+
+
+    /* CSVdurablewrite::Close()
+    - Commit every record written, stop the commit thread, and close the file.
+
+    [ret][failure] (false) : The file has been closed but not every record may be on disk, or there
+        was an error before. 'error' and 'error_msg' are set.
+    [ret][success] (true) : Every record written is on disk. 'error' and 'error_msg' are reset.
+    */
+    bool Close();
+
+
+    /* CSVdurablewrite::WriteRecord()
+    - Queue a record to be committed.
+
+    The record is formatted as by CSVwrite::WriteRecord() and is always terminated. If too much is
+    queued, 4 times 'commit_bytes', this waits for the commit thread to catch up.
+
+    [in] 'fields' : The fields of the record.
+    [out][opt] 'ticket' : The ticket of the record, to pass to WaitDurable().
+    [ret][failure] (false) : The record wasn't queued. 'error' and 'error_msg' are set. An error
+        committing records before this one is reported here too.
+    [ret][success] (true)
+    */
+    bool WriteRecord( const std::vector<std::string> &fields, Ticket *ticket = NULL );
+
+
+    /* CSVdurablewrite::WaitDurable()
+    - Wait until a record is on disk.
+
+    The commit thread is told there's a waiter, so it commits without waiting for 'commit_bytes' or
+    'commit_milliseconds'. Unlike the other functions this can be called from any thread, any number
+    at once, while the file is open.
+
+    [in] 'ticket' : The ticket of the record, from WriteRecord().
+    [ret][failure] (false) : The record may not be on disk: committing failed, or the file was closed
+        first, or the ticket is past the last record written. 'error' isn't set by this; the writer
+        finds out from its next call.
+    [ret][success] (true) : The record, and every record before it, is on disk.
+    */
+    bool WaitDurable( Ticket ticket );
+
+
+    /* CSVdurablewrite::Commit()
+    - Wait until every record written so far is on disk.
+
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true)
+    */
+    bool Commit();
+
+
+    /* CSVdurablewrite::SetCommit()
+    - Set when the commit thread commits the records that are queued if no one is waiting.
+
+    This can only be called when a file isn't open. The default is 1MB or 100 milliseconds. Either
+    may be 0, to commit as soon as a record is queued, but then there's no grouping unless the
+    commits are slower than the writer.
+
+    [in] 'bytes' : Commit once this many bytes are queued.
+    [in] 'milliseconds' : Commit once the oldest queued record has waited this long.
+    [ret][failure] (false) : 'error' and 'error_msg' are set.
+    [ret][success] (true)
+    */
+    bool SetCommit( size_t bytes, unsigned milliseconds );
+
+
+    // Refer to CSVwrite.
+    std::string delimiter;
+    std::string terminator;
+
+    const size_t &commit_bytes; // = _commit_bytes
+    const unsigned &commit_milliseconds; // = _commit_milliseconds
+
+    const bool &error; // = _error
+    const std::string &error_msg; // = _error_msg
+
+private:
+    CSVdurablewrite( const CSVdurablewrite & );
+    CSVdurablewrite & operator=( const CSVdurablewrite & );
+
+    // The commit thread.
+    void Run();
+
+    // The records are formatted by _csv into _record, through _record_stream.
+    CSVwrite _csv;
+    std::unique_ptr<record_streambuf> _record_buf;
+    std::ostream _record_stream;
+    std::string _record;
+
+    // The state shared with the commit thread while the file is open.
+    std::unique_ptr<commit_state> _state;
+
+    size_t _commit_bytes;
+    unsigned _commit_milliseconds;
+
+    bool _error;
+    std::string _error_msg;
+};
+
+
+} // namespace util
+} // namespace jay
+#endif // JAY_UTIL_CSVDURABLEWRITE_HPP_
@@ -0,0 +1,341 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Format batches of records on worker threads and write them in order.
+
+Documentation is in CSVparallelwrite.hpp.
+*/
+
+#include "CSVparallelwrite.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using namespace std;
+
+
+namespace jay {
+namespace util {
+
+
+// A streambuf that appends what's written to it to a string.
+class string_streambuf : public streambuf
+{
+public:
+    string_streambuf() : _target( NULL ) {}
+
+    void SetTarget( string *target ) { _target = target; }
+
+protected:
+    streamsize xsputn( const char *s, streamsize n )
+    {
+        _target->append( s, (size_t)n );
+        return n;
+    }
+
+    int_type overflow( int_type c )
+    {
+        if( !traits_type::eq_int_type( c, traits_type::eof() ) )
+        {
+            _target->push_back( traits_type::to_char_type( c ) );
+        }
+
+        return traits_type::not_eof( c );
+    }
+
+private:
+    string *_target;
+};
+
+
+// A batch, and the text it's formatted to.
+struct parallel_job
+{
+    CSVparallelwrite::Batch records;
+    string text;
+    bool formatted;
+};
+
+
+/* The state shared by the threads between the first CSVparallelwrite::Write() and Finish(). */
+struct parallel_state
+{
+    parallel_state() : next_to_format( 0 ), finishing( false ), failed( false ) {}
+
+    // The settings of the CSVwrite, which the workers format with.
+    string delimiter;
+    string terminator;
+    CSVwrite::Flags flags;
+
+    /* The pending batches, in the order they were written. The first 'next_to_format' have been
+    taken by a worker, and the output thread writes them from the front as they're formatted.
+    */
+    deque<parallel_job *> pending;
+    size_t next_to_format;
+
+    // The batches that aren't pending, and all the batches.
+    vector<parallel_job *> free_jobs;
+    vector<unique_ptr<parallel_job>> jobs;
+
+    // Finish() was called. The threads end when there's nothing left to do.
+    bool finishing;
+
+    // A batch couldn't be formatted or written. Nothing more is written.
+    bool failed;
+    string error_msg;
+
+    // 'work' is signaled for the workers, 'formatted' for the output thread and 'space' for Write().
+    // All the members above are only accessed with 'lock' held, after the threads start.
+    mutex lock;
+    condition_variable work;
+    condition_variable formatted;
+    condition_variable space;
+
+    vector<thread> threads;
+};
+
+
+static void worker_thread( parallel_state *state )
+{
+    // Each worker formats with its own CSVwrite, into the text of the batch.
+    string_streambuf buf;
+    ostream stream( &buf );
+    CSVwrite csv;
+    csv.delimiter = state->delimiter;
+    csv.terminator = state->terminator;
+    csv.ResizeBuffer( 65536 );
+
+    unique_lock<mutex> lock( state->lock );
+
+    for( ;; )
+    {
+        while( ( state->next_to_format == state->pending.size() ) && !state->finishing )
+        {
+            state->work.wait( lock );
+        }
+
+        if( state->next_to_format == state->pending.size() )
+            return;
+
+        parallel_job *job = state->pending[ state->next_to_format++ ];
+        const bool failed = state->failed;
+        lock.unlock();
+
+        bool formatted = true;
+        string error_msg;
+
+        if( !failed )
+        {
+            buf.SetTarget( &job->text );
+            formatted = csv.Associate( &stream, state->flags );
+
+            for( size_t i = 0; formatted && ( i < job->records.size() ); ++i )
+            {
+                formatted = csv.WriteRecord( job->records[ i ] );
+            }
+
+            // The error is kept before Close() resets it.
+            formatted = formatted && csv.Flush();
+            error_msg = csv.error_msg;
+            csv.Close();
+        }
+
+        // The records are freed here rather than by the thread that writes the next batch.
+        job->records.clear();
+
+        lock.lock();
+
+        if( !formatted && !state->failed )
+        {
+            state->failed = true;
+            state->error_msg = error_msg;
+        }
+
+        job->formatted = true;
+        state->formatted.notify_one();
+    }
+}
+
+
+
+CSVparallelwrite::CSVparallelwrite( CSVwrite &csv, size_t workers, size_t max_batches ) :
+    workers( workers ? workers : 1 ),
+    max_batches( ( max_batches > this->workers ) ? max_batches : ( this->workers * 2 ) ),
+    _csv( csv )
+{
+}
+
+
+CSVparallelwrite::~CSVparallelwrite()
+{
+    Finish();
+}
+
+
+void CSVparallelwrite::OutputThread()
+{
+    parallel_state *state = _state.get();
+    unique_lock<mutex> lock( state->lock );
+
+    for( ;; )
+    {
+        while( ( state->pending.empty() || !state->pending.front()->formatted )
+            && !( state->finishing && state->pending.empty() )
+        )
+        {
+            state->formatted.wait( lock );
+        }
+
+        if( state->pending.empty() )
+            return;
+
+        parallel_job *job = state->pending.front();
+        state->pending.pop_front();
+        --state->next_to_format;
+        const bool failed = state->failed;
+        lock.unlock();
+
+        // The text is whole records, so a gzip member can end after it and the file can switch
+        // before it.
+        const bool written = failed
+            || ( _csv.Put( job->text.data(), job->text.size() ) && _csv.EndRecord() );
+        job->text.clear();
+
+        lock.lock();
+
+        if( !written )
+        {
+            state->failed = true;
+        }
+
+        state->free_jobs.push_back( job );
+        state->space.notify_one();
+    }
+}
+
+
+bool CSVparallelwrite::Start()
+{
+    if( _csv.error )
+        return false;
+
+    if( !_csv.IsAssociated() )
+    {
+        _csv._error = true;
+        _csv._error_msg = "A stream is not associated with the object.";
+        return false;
+    }
+
+    if( !_csv._is_first_field && !_csv.WriteTerminator() )
+        return false;
+
+    _state.reset( new parallel_state );
+    _state->delimiter = _csv.delimiter;
+    _state->terminator = _csv.terminator;
+    _state->flags = (CSVwrite::Flags)( _csv._flags
+        & ( CSVwrite::process_empty_records | CSVwrite::minimal_quoting ) );
+
+    for( size_t i = 0; i < max_batches; ++i )
+    {
+        _state->jobs.push_back( unique_ptr<parallel_job>( new parallel_job ) );
+        _state->free_jobs.push_back( _state->jobs.back().get() );
+    }
+
+    for( size_t i = 0; i < workers; ++i )
+    {
+        _state->threads.push_back( thread( worker_thread, _state.get() ) );
+    }
+    _state->threads.push_back( thread( &CSVparallelwrite::OutputThread, this ) );
+
+    return true;
+}
+
+
+bool CSVparallelwrite::Write( Batch &batch )
+{
+    if( !_state && !Start() )
+        return false;
+
+    unique_lock<mutex> lock( _state->lock );
+
+    while( _state->free_jobs.empty() && !_state->failed )
+    {
+        _state->space.wait( lock );
+    }
+
+    if( _state->failed )
+        return false;
+
+    parallel_job *job = _state->free_jobs.back();
+    _state->free_jobs.pop_back();
+
+    // The records are swapped, so 'batch' gets the empty vector of a batch written before.
+    job->records.swap( batch );
+    job->formatted = false;
+    _state->pending.push_back( job );
+    _state->work.notify_one();
+
+    return true;
+}
+
+
+bool CSVparallelwrite::Finish()
+{
+    if( !_state )
+        return !_csv.error;
+
+    {
+        lock_guard<mutex> lock( _state->lock );
+        _state->finishing = true;
+        _state->work.notify_all();
+        _state->formatted.notify_all();
+    }
+
+    for( size_t i = 0; i < _state->threads.size(); ++i )
+    {
+        _state->threads[ i ].join();
+    }
+
+    const bool failed = _state->failed;
+
+    // If a batch couldn't be written the error is the CSVwrite's own. Otherwise it's a worker's.
+    if( failed && !_csv.error )
+    {
+        _csv._error = true;
+        _csv._error_msg = _state->error_msg;
+    }
+
+    _state.reset();
+    return !failed;
+}
+
+
+} // namespace util
+} // namespace jay
@@ -0,0 +1,146 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Usage and design:
+
+class CSVparallelwrite
+- A class to format batches of records on many threads and write them in order with CSVwrite.
+
+Unlike CSV.hpp this header requires C++11 threads (Visual Studio 2012 or later).
+
+Formatting is most of the work of writing CSV: each field is scanned, quoted and escaped. This class
+does that on worker threads. Each batch of records you pass to Write() is formatted by one worker,
+with its own CSVwrite that has the same delimiter, terminator and flags as yours, into text of its
+own. An output thread passes the text of each batch to your CSVwrite in the order the batches were
+written, so the output is exactly what WriteRecord() would have written for each record in turn.
+
+Your CSVwrite still does the writing, so its file descriptor, compression etc are all used. Since
+the output thread is the only one writing, with enough workers it's the limit: your CSVwrite's
+stream, or its compression.
+
+A fixed number of batches can be pending at once. If they all are, Write() waits for one to be
+written, so the records submitted can't get far ahead of the output.
+
+jay::util::CSVwrite csv( "filename" );
+if( csv.error ) { initialization failed, handle it }
+jay::util::CSVparallelwrite pw( csv, 4 ); // 4 worker threads
+jay::util::CSVparallelwrite::Batch batch;
+while( more records )
+{
+    batch.push_back( record );
+    if( batch.size() == 10000 && !pw.Write( batch ) ) { handle it. call Finish(), check csv.error_msg }
+}
+if( !pw.Write( batch ) || !pw.Finish() || !csv.Close() ) { handle it. check csv.error_msg }
+*/
+
+#ifndef JAY_UTIL_CSVPARALLELWRITE_HPP_
+#define JAY_UTIL_CSVPARALLELWRITE_HPP_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CSV.hpp"
+
+
+namespace jay {
+namespace util {
+
+
+struct parallel_state;
+
+
+class CSVparallelwrite
+{
+public:
+    // A batch of records.
+    typedef std::vector<std::vector<std::string>> Batch;
+
+
+    /* Constructor
+
+    The threads aren't started until the first Write().
+
+    [in] 'csv' : The CSVwrite to write the records to. It must be opened or associated before the
+        first Write(), and you must not use it from the first Write() until Finish().
+    [in] 'workers' : The number of worker threads. At least 1.
+    [in][opt] 'max_batches' : The number of batches that can be pending, ie waiting to be
+        formatted, being formatted or waiting to be written. The default is 2 per worker. At least 1
+        more than the number of workers.
+    */
+    CSVparallelwrite( CSVwrite &csv, size_t workers, size_t max_batches = 0 );
+
+    // Finish() is called when the class destructs. There's no way to report an error then.
+    ~CSVparallelwrite();
+
+
+    /* CSVparallelwrite::Write()
+    - Write a batch of records.
+
+    The records are moved out of 'batch', which is left empty, and each record is written as by
+    csv.WriteRecord( record ). A batch should have enough records that formatting it takes much
+    longer than passing it between threads, eg thousands.
+
+    If a previous record written with csv.WriteField() wasn't terminated then it's terminated first.
+
+    [in] 'batch' : The records.
+    [ret][failure] (false) : The batch wasn't written. Call Finish() and then csv.error_msg has the
+        reason.
+    [ret][success] (true) : The batch is pending.
+    */
+    bool Write( Batch &batch );
+
+
+    /* CSVparallelwrite::Finish()
+    - Wait until all the pending batches have been written, and stop the threads.
+
+    The records have then been written to your CSVwrite, which you may use again. Its buffer isn't
+    flushed; call csv.Flush() or csv.Close() for that.
+
+    [ret][failure] (false) : Not all the batches were written. 'csv.error' and 'csv.error_msg' are set.
+    [ret][success] (true)
+    */
+    bool Finish();
+
+    const size_t workers;
+    const size_t max_batches;
+
+private:
+    CSVparallelwrite( const CSVparallelwrite & );
+    CSVparallelwrite & operator=( const CSVparallelwrite & );
+
+    // Start the threads.
+    bool Start();
+
+    // The output thread, which writes the formatted batches to _csv in order.
+    void OutputThread();
+
+    CSVwrite &_csv;
+
+    // The state shared with the threads while they run.
+    std::unique_ptr<parallel_state> _state;
+};
+
+
+} // namespace util
+} // namespace jay
+#endif // JAY_UTIL_CSVPARALLELWRITE_HPP_
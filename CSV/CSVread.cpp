@@ -28,7 +28,10 @@ Documentation is in CSV.hpp.
 #include "CSV.hpp"
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include <algorithm>
 #include <fstream>
 #include <limits>
 #include <list>
@@ -38,7 +41,10 @@ Documentation is in CSV.hpp.
 
 #include "csv.h"
 
+#include "dialect.hpp"
+#include "number.hpp"
 #include "strerror.hpp"
+#include "unicode.hpp"
 
 
 using namespace std;
@@ -52,22 +58,44 @@ struct cb_stuff
 {
     cb_stuff(
         list<vector<string>> &_cache,
+        list<CSVread::cache_info> &_info_cache,
+        const vector<bool> &_interned,
+        CSVdictionary &_dictionary,
         CSVread::Flags &_flags,
         bool &_error_pending,
         std::string &_error_msg,
         bool &_end_record_not_terminated,
+        bool &_cr_terminated,
+        bool &_null_seen,
+        unsigned char &_quote,
+        const struct csv_parser *_parser,
+        const uint64_t &_chunk_offset,
+        const uint64_t &_line_offset,
         uintmax_t &pending,
         uintmax_t &requested
     ) :
-        _cache( _cache ), _flags( _flags ), _error_pending( _error_pending ), _error_msg( _error_msg ),
+        _cache( _cache ), _info_cache( _info_cache ), _interned( _interned ),
+            _dictionary( _dictionary ), _flags( _flags ), _error_pending( _error_pending ),
+            _error_msg( _error_msg ),
             _end_record_not_terminated( _end_record_not_terminated ),
-            pending( pending ), requested( requested )
+            _cr_terminated( _cr_terminated ), _null_seen( _null_seen ), _quote( _quote ),
+            _parser( _parser ), _chunk_offset( _chunk_offset ), _line_offset( _line_offset ),
+            pending( pending ), requested( requested ), escaped( false )
     {
     }
 
     // A reference to the CSVread::_cache list.
     list<vector<string>> &_cache;
 
+    // A reference to the CSVread::_info_cache list.
+    list<CSVread::cache_info> &_info_cache;
+
+    // A reference to CSVread::_interned.
+    const vector<bool> &_interned;
+
+    // A reference to CSVread::_dictionary.
+    CSVdictionary &_dictionary;
+
     // A reference to the CSVread::_flags.
     const CSVread::Flags &_flags;
 
@@ -80,18 +108,103 @@ struct cb_stuff
     // A reference to CSVread::_end_record_not_terminated.
     bool &_end_record_not_terminated;
 
+    // A reference to CSVread::_cr_terminated.
+    const bool &_cr_terminated;
+
+    // A reference to CSVread::_null_seen.
+    const bool &_null_seen;
+
+    // A reference to CSVread::_quote.
+    const unsigned char &_quote;
+
+    // The parser, whose 'row_end' is where the last line ending in the chunk ends, if it's set.
+    const struct csv_parser *_parser;
+
+    // A reference to CSVread::_chunk_offset.
+    const uint64_t &_chunk_offset;
+
+    // A reference to CSVread::_line_offset.
+    const uint64_t &_line_offset;
+
     // A reference to the record number of the pending record.
     uintmax_t &pending;
 
     // A reference to the record number of the requested record.
     const uintmax_t &requested;
 
+    // Whether or not the next field is passed escaped. Refer to flag 'lazy_unescape'.
+    bool escaped;
+
+    // Push a vector to the back of the lists to make a new pending record.
+    void PushPendingRecord()
+    {
+        _cache.push_back( vector<string>() );
+        _info_cache.push_back( CSVread::cache_info() );
+    }
+
+    /* Set the offset of the pending record, if it's not set, to the start of the line it begins on.
+    This is called for the first field or terminator of the record, before the parser sets 'row_end'
+    past the record's own line ending.
+    */
+    void SetPendingOffset()
+    {
+        uint64_t &offset = _info_cache.back().offset;
+
+        if( offset == CSVread::cache_info::no_offset )
+        {
+            offset = _parser->row_end ? ( _chunk_offset + _parser->row_end ) : _line_offset;
+        }
+    }
+
 private:
     cb_stuff( const cb_stuff & );
     cb_stuff & operator=( const cb_stuff & );
 };
 
 
+/* Unescape a field that's escaped as it is in the stream: remove the quotes around it and replace
+each pair of quotes in it with one quote.
+*/
+static void unescape_field( string &field, const char quote )
+{
+    size_t size = 0;
+
+    for( size_t i = 1; ( i + 1 ) < field.size(); ++i )
+    {
+        field[ size++ ] = field[ i ];
+
+        if( field[ i ] == quote )
+        {
+            ++i;
+        }
+    }
+
+    field.resize( size );
+}
+
+
+// Escape a field as it would be in the stream. This is the reverse of unescape_field().
+static string escape_field( const char *data, const size_t size, const char quote )
+{
+    string field;
+    field.reserve( size + 2 );
+    field += quote;
+
+    for( size_t i = 0; i < size; ++i )
+    {
+        field += data[ i ];
+
+        if( data[ i ] == quote )
+        {
+            field += quote;
+        }
+    }
+
+    field += quote;
+    return field;
+}
+
+
 // Called by libcsv when a new field has been parsed for the pending record.
 // The pending record is the back element in the cache list. If the record number of the pending
 // record is less than the record number of the requested record then it's ignored.
@@ -99,6 +212,9 @@ static void Callback_Field( void *data, size_t data_size, void *userptr )
 {
     cb_stuff *s = (cb_stuff *)userptr;
 
+    bool escaped = s->escaped;
+    s->escaped = false;
+
     if( s->_error_pending )
     {
         return;
@@ -106,19 +222,97 @@ static void Callback_Field( void *data, size_t data_size, void *userptr )
 
     if( s->pending >= s->requested )
     {
-        // Push the field to the back of the pending record.
-        s->_cache.back().push_back( string( (const char *)data, data_size ) );
+        s->SetPendingOffset();
 
-        if( ( s->_flags & CSVread::error_on_null_in_field )
-            && ( s->_cache.back().back().find_first_of( '\0' ) != string::npos )
+        const size_t column = s->_cache.back().size();
+        const bool interned = ( column < s->_interned.size() ) && s->_interned[ column ];
+
+        /* A field that's passed escaped is unescaped now if it's to be checked, so the byte offset
+        of an error is in the unescaped field, or if it's to be interned.
+        */
+        string unescaped;
+
+        if( escaped
+            && ( ( s->_null_seen && ( s->_flags & CSVread::error_on_null_in_field ) )
+                || ( s->_flags & CSVread::validate_utf8 )
+                || interned )
         )
         {
-            s->_error_pending = true;
-            ostringstream ss;
-            ss << "Record #" << s->pending << " Field #" << s->_cache.back().size()
-                << " is invalid due to NULL byte in field.";
-            s->_error_msg = ss.str();
-            return;
+            unescaped.assign( (const char *)data, data_size );
+            unescape_field( unescaped, (char)s->_quote );
+            data = (void *)unescaped.data();
+            data_size = unescaped.size();
+            escaped = false;
+        }
+
+        /* A field can only contain a null byte if one was found by ParseChunk(), so usually this
+        check costs nothing even if flag error_on_null_in_field is set.
+        */
+        if( s->_null_seen && ( s->_flags & CSVread::error_on_null_in_field ) )
+        {
+            const char *null = (const char *)memchr( data, '\0', data_size );
+            if( null )
+            {
+                s->_error_pending = true;
+                ostringstream ss;
+                ss << "Record #" << s->pending << " Field #" << ( s->_cache.back().size() + 1 )
+                    << " is invalid due to NULL byte at byte offset " << ( null - (const char *)data )
+                    << " in field.";
+                s->_error_msg = ss.str();
+                return;
+            }
+        }
+
+        if( s->_flags & CSVread::validate_utf8 )
+        {
+            size_t offset = utf8_invalid_offset( (const char *)data, data_size );
+            if( offset != data_size )
+            {
+                s->_error_pending = true;
+                ostringstream ss;
+                ss << "Record #" << s->pending << " Field #" << ( s->_cache.back().size() + 1 )
+                    << " is invalid due to invalid UTF-8 sequence at byte offset " << offset
+                    << " in field.";
+                s->_error_msg = ss.str();
+                return;
+            }
+        }
+
+        /* A field of an interned column is interned from the parser's buffer, so it's not copied
+        to a string at all. An empty field is pushed in its place. If the dictionary is full it's
+        pushed as usual.
+        */
+        if( interned )
+        {
+            uint32_t code = s->_dictionary.Intern( (const char *)data, data_size );
+
+            if( code != CSVdictionary::no_code )
+            {
+                vector<uint32_t> &codes = s->_info_cache.back().codes;
+                codes.resize( column + 1, CSVdictionary::no_code );
+                codes[ column ] = code;
+
+                s->_cache.back().push_back( string() );
+                return;
+            }
+        }
+
+        /* Push the field to the back of the pending record.
+
+        With flag 'lazy_unescape' a field in the cache that begins with the quote character is
+        escaped, so a field that was unescaped and begins with it is escaped again.
+        */
+        if( !escaped
+            && ( s->_flags & CSVread::lazy_unescape )
+            && data_size
+            && ( *(const char *)data == (char)s->_quote )
+        )
+        {
+            s->_cache.back().push_back( escape_field( (const char *)data, data_size, (char)s->_quote ) );
+        }
+        else
+        {
+            s->_cache.back().push_back( string( (const char *)data, data_size ) );
         }
     }
 }
@@ -131,8 +325,28 @@ static void Callback_Record( int terminator, void *userptr )
 {
     cb_stuff *s = (cb_stuff *)userptr;
 
-    if( s->_error_pending
-        || ( ( terminator == CSV_CR ) && ( s->_flags & CSVread::process_empty_records ) )
+    // The next field is passed escaped. This isn't the end of a record.
+    if( terminator == dialect_escaped_field )
+    {
+        s->escaped = true;
+        return;
+    }
+
+    if( s->_error_pending )
+    {
+        return;
+    }
+
+    // An empty record has no field, so its offset is set by its terminator. A CR that's ignored
+    // may be the first of CRLF, so it's the same.
+    if( s->pending >= s->requested )
+    {
+        s->SetPendingOffset();
+    }
+
+    if( ( terminator == CSV_CR )
+        && ( s->_flags & CSVread::process_empty_records )
+        && !s->_cr_terminated
     )
     {
         return;
@@ -145,18 +359,203 @@ static void Callback_Record( int terminator, void *userptr )
 
     if( s->pending >= s->requested )
     {
-        // Push a vector to the back of the list to make a new pending record.
-        s->_cache.push_back( vector<string>() );
+        s->PushPendingRecord();
     }
 
     ++s->pending;
 }
 
 
+
+
+/* A read-only stream buffer for the byte range [begin, end) of another stream buffer.
+
+Positions are relative to 'begin' so to CSVread the range looks like a whole stream, and seeking to
+position 0 in Reset() seeks to the beginning of the range. The absolute positions are 64-bit so that
+ranges of files larger than 4GB work even if size_t is 32-bit.
+*/
+class range_streambuf : public streambuf
+{
+public:
+    range_streambuf( streambuf *source, uint64_t begin, uint64_t end, uint64_t source_size ) :
+        _source( source ), _begin( begin ), _end( end ), _pos( begin ), _source_size( source_size )
+    {
+        setg( _buf, _buf, _buf );
+    }
+
+    // Whether or not the range ends before the end of the source, ie there's a range after it.
+    bool ends_before_source() const
+    {
+        return _end < _source_size;
+    }
+
+protected:
+    int_type underflow()
+    {
+        if( gptr() < egptr() )
+            return traits_type::to_int_type( *gptr() );
+
+        streamsize n = Fill( _buf, sizeof _buf );
+        if( n <= 0 )
+            return traits_type::eof();
+
+        setg( _buf, _buf, _buf + n );
+        return traits_type::to_int_type( *gptr() );
+    }
+
+    // istream::read() calls this. Whatever is left of the get area is copied first and the rest is
+    // read from the source directly.
+    streamsize xsgetn( char *s, streamsize count )
+    {
+        streamsize n = min<streamsize>( count, egptr() - gptr() );
+        if( n > 0 )
+        {
+            memcpy( s, gptr(), (size_t)n );
+            gbump( (int)n );
+        }
+
+        if( n < count )
+        {
+            streamsize len = Fill( s + n, count - n );
+            if( len > 0 )
+            {
+                n += len;
+            }
+        }
+
+        return n;
+    }
+
+    pos_type seekoff( off_type off, ios_base::seekdir dir, ios_base::openmode which )
+    {
+        uint64_t base;
+        if( dir == ios_base::beg )
+            base = 0;
+        else if( dir == ios_base::cur )
+            base = _pos - _begin - (uint64_t)( egptr() - gptr() );
+        else
+            base = _end - _begin;
+
+        if( ( ( off < 0 ) && ( (uint64_t)-off > base ) )
+            || ( ( off > 0 ) && ( (uint64_t)off > ( _end - _begin - base ) ) )
+        )
+        {
+            return pos_type( off_type( -1 ) );
+        }
+
+        return seekpos( pos_type( off_type( base + off ) ), which );
+    }
+
+    pos_type seekpos( pos_type pos, ios_base::openmode which )
+    {
+        const off_type off = pos;
+
+        if( !( which & ios_base::in ) || ( off < 0 ) || ( (uint64_t)off > ( _end - _begin ) ) )
+            return pos_type( off_type( -1 ) );
+
+        if( _source->pubseekpos( pos_type( off_type( _begin + off ) ), ios_base::in )
+            == pos_type( off_type( -1 ) )
+        )
+        {
+            return pos_type( off_type( -1 ) );
+        }
+
+        _pos = _begin + off;
+        setg( _buf, _buf, _buf );
+        return pos;
+    }
+
+private:
+    range_streambuf( const range_streambuf & );
+    range_streambuf & operator=( const range_streambuf & );
+
+    // Read up to 'count' bytes from the source, but not past the end of the range.
+    streamsize Fill( char *s, streamsize count )
+    {
+        if( (uint64_t)count > ( _end - _pos ) )
+        {
+            count = (streamsize)( _end - _pos );
+        }
+
+        if( count <= 0 )
+            return 0;
+
+        streamsize n = _source->sgetn( s, count );
+        if( n > 0 )
+        {
+            _pos += n;
+        }
+
+        return n;
+    }
+
+    streambuf *_source;
+    uint64_t _begin;
+    uint64_t _end;
+    // The position of the source.
+    uint64_t _pos;
+    uint64_t _source_size;
+    char _buf[ 4096 ];
+};
+
+
+/* Find the first line start at or after byte offset 'pos' of a stream of 'size' bytes.
+
+A line start is byte 0 or a byte after LF, CRLF or a CR not followed by LF. If there's no line start
+at or after 'pos' then 'start' is 'size'. Since both sides of a boundary between ranges call this
+with the same offset they agree on which range each record belongs to.
+
+[ret][failure] (false) : The stream could not be seeked.
+[ret][success] (true) : 'start' is the line start.
+*/
+static bool find_line_start( streambuf *sb, uint64_t pos, uint64_t size, uint64_t &start )
+{
+    if( !pos || ( pos >= size ) )
+    {
+        start = pos ? size : 0;
+        return true;
+    }
+
+    // The byte before 'pos' is included since a line ending there makes 'pos' a line start.
+    if( sb->pubseekpos( streamoff( pos - 1 ), ios_base::in ) == streampos( streamoff( -1 ) ) )
+    {
+        return false;
+    }
+
+    for( uint64_t i = pos - 1;; ++i )
+    {
+        const int c = sb->sbumpc();
+
+        if( c == char_traits<char>::eof() )
+        {
+            start = size;
+            return true;
+        }
+
+        if( c == '\n' )
+        {
+            start = i + 1;
+            return true;
+        }
+
+        if( c == '\r' )
+        {
+            start = ( sb->sgetc() == '\n' ) ? ( i + 2 ) : ( i + 1 );
+            return true;
+        }
+    }
+}
+
+
+
+
 CSVread::CSVread() :
     buffer_size( _buffer_size), eof( _eof ), error( _error ), error_msg( _error_msg ),
-        has_utf8_bom( _has_utf8_bom), record_num( _record_num ), end_record_num( _end_record_num ),
-        end_record_not_terminated( _end_record_not_terminated ), fields( _fields )
+        has_utf8_bom( _has_utf8_bom), has_utf16_bom( _has_utf16_bom ), range_begin( _range_begin ),
+        range_end( _range_end ), record_num( _record_num ),
+        record_offset( _record_offset ), end_record_num( _end_record_num ),
+        end_record_not_terminated( _end_record_not_terminated ), fields( _fields ), codes( _codes ),
+        dictionary( _dictionary )
 {
     if( !Init() )
         return;
@@ -165,8 +564,11 @@ CSVread::CSVread() :
 
 CSVread::CSVread( string filename, Flags flags /* = none */ ) :
     buffer_size( _buffer_size), eof( _eof ), error( _error ), error_msg( _error_msg ),
-        has_utf8_bom( _has_utf8_bom), record_num( _record_num ), end_record_num( _end_record_num ),
-        end_record_not_terminated( _end_record_not_terminated ), fields( _fields )
+        has_utf8_bom( _has_utf8_bom), has_utf16_bom( _has_utf16_bom ), range_begin( _range_begin ),
+        range_end( _range_end ), record_num( _record_num ),
+        record_offset( _record_offset ), end_record_num( _end_record_num ),
+        end_record_not_terminated( _end_record_not_terminated ), fields( _fields ), codes( _codes ),
+        dictionary( _dictionary )
 {
     if( !Init() )
         return;
@@ -177,8 +579,11 @@ CSVread::CSVread( string filename, Flags flags /* = none */ ) :
 
 CSVread::CSVread( istream *stream, Flags flags /* = none */ ) :
     buffer_size( _buffer_size), eof( _eof ), error( _error ), error_msg( _error_msg ),
-        has_utf8_bom( _has_utf8_bom), record_num( _record_num ), end_record_num( _end_record_num ),
-        end_record_not_terminated( _end_record_not_terminated ), fields( _fields )
+        has_utf8_bom( _has_utf8_bom), has_utf16_bom( _has_utf16_bom ), range_begin( _range_begin ),
+        range_end( _range_end ), record_num( _record_num ),
+        record_offset( _record_offset ), end_record_num( _end_record_num ),
+        end_record_not_terminated( _end_record_not_terminated ), fields( _fields ), codes( _codes ),
+        dictionary( _dictionary )
 {
     if( !Init() )
         return;
@@ -195,6 +600,9 @@ CSVread::~CSVread()
         delete parse_obj;
     }
     free( _buffer );
+    delete _utf16;
+    delete _range_stream;
+    delete _range_buf;
 }
 
 
@@ -224,8 +632,11 @@ bool CSVshared_ResizeBuffer(
         return false;
     }
 
-    // CSV classes may cast 'buffer_size' to a size_t at any point so it can't be larger than that.
-    if( bytes > (numeric_limits<size_t>::max)() )
+    /* CSV classes may cast 'buffer_size' to a size_t at any point so it can't be larger than that.
+    'bytes' is positive here so it's compared unsigned, since a signed comparison would convert
+    the max size_t to streamsize and it may not fit.
+    */
+    if( (uintmax_t)bytes > (uintmax_t)(numeric_limits<size_t>::max)() )
     {
         _error = true;
         _error_msg = "buffer allocation failed. size of bytes is > numeric_limits<size_t>::max.";
@@ -286,6 +697,7 @@ bool CSVread::ResetParser()
     }
 
     SetDelimiter( _delimiter );
+    SetQuote( _quote );
     return true;
 }
 
@@ -293,6 +705,7 @@ bool CSVread::ResetParser()
 void CSVread::ResetCache()
 {
     _cache = list<vector<string>>( 1, vector<string>() );
+    _info_cache = list<cache_info>( 1, cache_info() );
 }
 
 
@@ -313,7 +726,7 @@ bool CSVread::Reset( bool partial_reset /* = false */ )
     if( _input_ptr )
     {
         _input_ptr->clear();
-        _input_ptr->seekg( _has_utf8_bom ? 3 : 0 );
+        _input_ptr->seekg( BOMSize() );
         _eof = _input_ptr->eof();
     }
     else
@@ -321,11 +734,22 @@ bool CSVread::Reset( bool partial_reset /* = false */ )
         _flags = CSVread::none;
         _eof = false;
         _has_utf8_bom = false;
+        _has_utf16_bom = false;
+        _cr_terminated = false;
+        _sniff_pending = false;
+        _columns.clear();
     }
 
+    _utf16->Reset( _utf16->big_endian() );
+    _null_seen = false;
+    _chunk_offset = _range_begin + BOMSize();
+    _line_offset = _range_begin;
+
     csv_set_opts( parse_obj, ( ( _flags & process_empty_records ) ? CSV_REPALL_NL : 0 )
             | ( ( _flags & strict_mode ) ? ( CSV_STRICT | CSV_STRICT_FINI ) : 0 )
+            | ( ( _flags & lazy_unescape ) ? dialect_raw_escapes : 0 )
     );
+    SelectParser();
 
     _error = false;
     _error_pending = false;
@@ -334,9 +758,12 @@ bool CSVread::Reset( bool partial_reset /* = false */ )
     if( !partial_reset )
     {
         _record_num = 0;
+        _record_offset = 0;
         _end_record_num = 0;
         _end_record_not_terminated = false;
         _fields = vector<string>();
+        _unescaped.clear();
+        _codes = vector<uint32_t>();
     }
 
     return true;
@@ -350,6 +777,13 @@ bool CSVread::Close()
         _file.close();
     }
 
+    delete _range_stream;
+    _range_stream = NULL;
+    delete _range_buf;
+    _range_buf = NULL;
+    _range_begin = 0;
+    _range_end = 0;
+
     _input_ptr =  NULL;
 
     return Reset();
@@ -363,9 +797,16 @@ bool CSVread::Init()
     _buffer = NULL;
     _buffer_size = 0;
     parse_obj = NULL;
+    _parse = csv_parse;
     _input_ptr =  NULL;
+    _range_buf = NULL;
+    _range_stream = NULL;
+    _range_begin = 0;
+    _range_end = 0;
+    _utf16 = new utf16_transcoder;
 
     _delimiter = (unsigned char)CSV_COMMA;
+    _quote = (unsigned char)CSV_QUOTE;
 
     return Reset();
 }
@@ -410,16 +851,23 @@ bool CSVread::Associate( istream *stream, const Flags flags /* = none */ )
         return false;
     }
 
+    // The dialect is sniffed from the first chunk parsed. Refer to ParseChunk().
+    _sniff_pending = !!( _flags & sniff_dialect );
+
     csv_set_opts( parse_obj, ( ( _flags & process_empty_records ) ? CSV_REPALL_NL : 0 )
             | ( ( _flags & strict_mode ) ? ( CSV_STRICT | CSV_STRICT_FINI ) : 0 )
+            | ( ( _flags & lazy_unescape ) ? dialect_raw_escapes : 0 )
     );
+    SelectParser();
 
     uintmax_t pending = 1;
     uintmax_t requested = 1;
 
     bool parsed_end_record = false;
 
-    cb_stuff args( _cache, _flags, _error_pending, _error_msg, _end_record_not_terminated, pending, requested );
+    cb_stuff args( _cache, _info_cache, _interned, _dictionary, _flags, _error_pending, _error_msg,
+        _end_record_not_terminated, _cr_terminated, _null_seen, _quote, parse_obj, _chunk_offset,
+        _line_offset, pending, requested );
 
     /* At least 3 bytes need to be read to detect the UTF-8 BOM. If the _buffer has a size of less
     than 3 then use temporary buffer a[] instead.
@@ -441,30 +889,23 @@ bool CSVread::Associate( istream *stream, const Flags flags /* = none */ )
         {
             _has_utf8_bom = true;
         }
-
-        if( !_has_utf8_bom || ( len > 3 ) )
+        else if( ( _flags & transcode_utf16 )
+            && ( len >= 2 )
+            && ( ( ( p[ 0 ] == '\xFF' ) && ( p[ 1 ] == '\xFE' ) )
+                || ( ( p[ 0 ] == '\xFE' ) && ( p[ 1 ] == '\xFF' ) ) )
+        )
         {
-            char *adjusted_p = &p[ _has_utf8_bom ? 3 : 0 ];
-            size_t adjusted_len = (size_t)( _has_utf8_bom ? ( len - 3 ) : len );
+            _has_utf16_bom = true;
+            _utf16->Reset( p[ 0 ] == '\xFE' );
+        }
+
+        _chunk_offset = _range_begin + BOMSize();
+        _line_offset = _range_begin;
 
+        if( len > BOMSize() )
+        {
             // REM the callbacks can modify most of the 'args'
-            if( csv_parse(
-                    parse_obj,
-                    adjusted_p,
-                    adjusted_len,
-                    Callback_Field,
-                    Callback_Record,
-                    &args
-                ) != adjusted_len
-            )
-            {
-                if( !_error_pending )
-                {
-                    _error_pending = true;
-                    _error_msg = "libcsv: ";
-                    _error_msg += csv_strerror( csv_error( parse_obj ) );
-                }
-            }
+            ParseChunk( &p[ BOMSize() ], (size_t)( len - BOMSize() ), args );
         }
     }
 
@@ -473,8 +914,19 @@ bool CSVread::Associate( istream *stream, const Flags flags /* = none */ )
     {
         if( !_input_ptr->good() || ( len != p_size ) )
         {
+            if( _has_utf16_bom && !_utf16->Complete() )
+            {
+                _error_msg = "UTF-16 stream ends in an incomplete code unit or surrogate pair.";
+            }
+            else if( RangeEndsInQuotedField() )
+            {
+                ostringstream ss;
+                ss << "Record #" << pending << " is split by the end of the range, which is inside "
+                    "a quoted field.";
+                _error_msg = ss.str();
+            }
             // REM the callbacks can modify most of the 'args'
-            if( csv_fini( parse_obj, Callback_Field, Callback_Record, &args ) )
+            else if( csv_fini( parse_obj, Callback_Field, Callback_Record, &args ) )
             {
                 _error_msg = "libcsv: ";
                 _error_msg += csv_strerror( csv_error( parse_obj ) );
@@ -542,73 +994,511 @@ bool CSVread::Open( string filename, const Flags flags /* = none */ )
 }
 
 
-
-
-unsigned char CSVread::GetDelimiter()
-{
-    return _delimiter;
-}
-
-
-void CSVread::SetDelimiter( unsigned char delim )
+bool CSVread::OpenRange( string filename, uint64_t begin, uint64_t end, Flags flags /* = none */ )
 {
-    _delimiter = delim;
+    if( _error )
+        return false;
 
-    if( parse_obj )
+    if( _file.is_open() )
     {
-        csv_set_delim( parse_obj, _delimiter );
+        _error = true;
+        _error_msg = "A file is already open. Call Close() to close the file.";
+        return false;
     }
-}
-
-
 
+    if( _input_ptr )
+    {
+        _error = true;
+        _error_msg = "A stream is already associated. Call Close() to dissociate.";
+        return false;
+    }
 
-bool CSVread::ReadRecord( const uintmax_t requested_record_num /* = 0 */ )
-{
-    if( _error )
+    if( flags & ( text_mode | transcode_utf16 ) )
+    {
+        _error = true;
+        _error_msg = "Flags text_mode and transcode_utf16 are not valid for a range.";
         return false;
+    }
 
-    if( !_input_ptr )
+    if( begin > end )
     {
         _error = true;
-        _error_msg = "A stream is not associated with the object.";
+        _error_msg = "The beginning of the range is after the end.";
         return false;
     }
 
-    if( !_cache.size() )
+    _file.open( filename, ios::binary );
+    if( !_file )
     {
         _error = true;
-        _error_msg = "The cache list does not contain any elements";
+        _error_msg = "Failed opening " + filename;
         return false;
     }
 
-    _eof = _input_ptr->eof();
-    uintmax_t pending = _record_num + _cache.size();
-    uintmax_t requested = requested_record_num;
+    streambuf *sb = _file.rdbuf();
+    const streamoff size = sb->pubseekoff( 0, ios::end, ios::in );
+    uint64_t start = 0, stop = 0;
 
-    if( !requested )
+    if( ( size < 0 )
+        || !find_line_start( sb, begin, (uint64_t)size, start )
+        || !find_line_start( sb, end, (uint64_t)size, stop )
+        || ( sb->pubseekpos( streamoff( start ), ios::in ) == streampos( streamoff( -1 ) ) )
+    )
     {
-        if( _record_num == SIZE_MAX )
-        {
-            _error = true;
-            _error_msg = "The maximum number of lines have been read (SIZE_MAX)";
-            return false;
-        }
-        requested = _record_num + 1;
+        _error = true;
+        _error_msg = "Failed seeking in " + filename;
+        return false;
     }
 
-    if( requested > _record_num )
+    _range_buf = new range_streambuf( sb, start, stop, (uint64_t)size );
+    _range_stream = new istream( _range_buf );
+    _range_begin = start;
+    _range_end = stop;
+
+    // Only the beginning of the file can have a BOM.
+    if( start )
     {
-        if( requested < pending ) // the requested record is already in the cache
-        {
-            for( uintmax_t i = requested - _record_num - 1; i; --i )
-            {
-                _cache.pop_front();
+        flags |= skip_utf8_bom_check;
+    }
+
+    return Associate( _range_stream, flags );
+}
+
+
+
+
+/* Count the fields in each record of 'data' as it would be parsed using 'delim' and 'quote'.
+
+Only complete records are counted; the last record is assumed to continue past the end of 'data'
+unless it's the only record. Empty records are not counted. The terminators outside of quoted
+fields are counted in 'crlf', 'lf' and 'cr'.
+*/
+static void SniffFieldCounts(
+    const unsigned char *data,   // IN
+    size_t size,   // IN
+    unsigned char delim,   // IN
+    unsigned char quote,   // IN
+    vector<size_t> &counts,   // OUT
+    size_t &crlf,   // OUT
+    size_t &lf,   // OUT
+    size_t &cr   // OUT
+)
+{
+    counts.clear();
+    crlf = lf = cr = 0;
+
+    size_t fields = 1;
+    bool quoted = false, field_begun = false, record_empty = true;
+
+    for( size_t i = 0; i < size; ++i )
+    {
+        const unsigned char c = data[ i ];
+
+        if( quoted )
+        {
+            if( c == quote )
+            {
+                if( ( ( i + 1 ) < size ) && ( data[ i + 1 ] == quote ) )
+                {
+                    ++i;
+                }
+                else
+                {
+                    quoted = false;
+                }
+            }
+        }
+        else if( ( c == CSV_CR ) || ( c == CSV_LF ) )
+        {
+            if( c == CSV_LF )
+                ++lf;
+            else if( ( ( i + 1 ) < size ) && ( data[ i + 1 ] == CSV_LF ) )
+                ++crlf, ++i;
+            else
+                ++cr;
+
+            if( !record_empty )
+            {
+                counts.push_back( fields );
+            }
+
+            fields = 1;
+            field_begun = false;
+            record_empty = true;
+        }
+        else if( c == delim )
+        {
+            ++fields;
+            field_begun = false;
+            record_empty = false;
+        }
+        else if( ( c == quote ) && !field_begun )
+        {
+            quoted = true;
+            field_begun = true;
+            record_empty = false;
+        }
+        else if( ( c != CSV_SPACE ) && ( c != CSV_TAB ) )
+        {
+            field_begun = true;
+            record_empty = false;
+        }
+    }
+
+    if( !record_empty && !counts.size() )
+    {
+        counts.push_back( fields );
+    }
+}
+
+
+/* Sniff the dialect of a sample of CSV data.
+
+Each combination of the common delimiters , ; \t | and the quotes " ' is tried, and the one that
+parses the sample into the most consistent number of fields (more than one) per record wins. The
+candidates' parse is the same as libcsv's as far as fields and records go, but it does not honor
+any advanced settings.
+
+'cr_terminated' is set if the records in the sample are terminated only by CR.
+
+[ret] (false) : No candidate parses the sample into more than one field per record. The OUT
+    parameters are unchanged.
+[ret] (true) : 'delim', 'quote' and 'cr_terminated' are set.
+*/
+static bool SniffDialect(
+    const char *data,   // IN
+    size_t size,   // IN
+    unsigned char &delim,   // OUT
+    unsigned char &quote,   // OUT
+    bool &cr_terminated   // OUT
+)
+{
+    static const unsigned char delims[] = { CSV_COMMA, ';', CSV_TAB, '|' };
+    static const unsigned char quotes[] = { CSV_QUOTE, '\'' };
+
+    // The sample is capped so that sniffing a large buffer doesn't cost more than it's worth.
+    const size_t max_sample = 65536;
+    if( size > max_sample )
+    {
+        size = max_sample;
+    }
+
+    double best_score = 0;
+    size_t best_fields = 0;
+    vector<size_t> counts;
+
+    for( size_t d = 0; d < sizeof delims; ++d )
+    {
+        for( size_t q = 0; q < sizeof quotes; ++q )
+        {
+            size_t crlf, lf, cr;
+
+            SniffFieldCounts( (const unsigned char *)data, size, delims[ d ], quotes[ q ],
+                counts, crlf, lf, cr );
+
+            // The most common number of fields per record and how many records have it.
+            size_t mode = 0, mode_freq = 0;
+
+            sort( counts.begin(), counts.end() );
+
+            for( size_t i = 0, freq = 0; i < counts.size(); ++i )
+            {
+                freq = ( i && ( counts[ i ] == counts[ i - 1 ] ) ) ? ( freq + 1 ) : 1;
+
+                if( freq >= mode_freq )
+                {
+                    mode = counts[ i ];
+                    mode_freq = freq;
+                }
+            }
+
+            if( mode < 2 )
+            {
+                continue;
+            }
+
+            double score = (double)mode_freq / counts.size();
+
+            /* On a tie between quote characters the one that parses into fewer fields wins, since
+            it's the one that quotes delimiters. On a tie between delimiters the first one wins.
+            */
+            if( ( score > best_score )
+                || ( ( score == best_score ) && ( delim == delims[ d ] ) && ( mode < best_fields ) )
+            )
+            {
+                best_score = score;
+                best_fields = mode;
+                delim = delims[ d ];
+                quote = quotes[ q ];
+                cr_terminated = ( cr && !crlf && !lf );
+            }
+        }
+    }
+
+    return ( best_fields != 0 );
+}
+
+
+bool CSVread::RangeEndsInQuotedField() const
+{
+    return _range_buf
+        && _range_buf->ends_before_source()
+        && ( parse_obj->pstate == dialect_field_begun )
+        && parse_obj->quoted;
+}
+
+
+streamoff CSVread::BOMSize() const
+{
+    return _has_utf8_bom ? 3 : ( _has_utf16_bom ? 2 : 0 );
+}
+
+
+void CSVread::ParseChunk( const char *data, size_t size, cb_stuff &args )
+{
+    if( _has_utf16_bom )
+    {
+        _transcoded.clear();
+
+        if( !_utf16->Transcode( data, size, _transcoded ) )
+        {
+            _error_pending = true;
+
+            ostringstream ss;
+            ss << "UTF-16 stream is invalid due to unpaired surrogate at byte offset "
+                << ( _utf16->error_offset + 2 ) << ".";
+            _error_msg = ss.str();
+
+            return;
+        }
+
+        data = _transcoded.data();
+        size = _transcoded.size();
+    }
+
+    if( _sniff_pending )
+    {
+        unsigned char delim = _delimiter, quote = _quote;
+
+        if( SniffDialect( data, size, delim, quote, _cr_terminated ) )
+        {
+            SetDelimiter( delim );
+            SetQuote( quote );
+        }
+
+        _sniff_pending = false;
+    }
+
+    /* The chunk is searched for a null byte once, rather than each field as it's parsed. A field
+    may continue into later chunks, so once a null byte is found Callback_Field() checks every
+    field until the stream is reset.
+    */
+    if( ( _flags & error_on_null_in_field ) && !_null_seen && memchr( data, '\0', size ) )
+    {
+        _null_seen = true;
+    }
+
+    /* The parser sets 'row_end' at each line ending, which the callbacks use for the offset of a
+    record that begins in this chunk. Refer to cb_stuff::SetPendingOffset().
+    */
+    parse_obj->row_end = 0;
+
+    // REM the callbacks can modify most of the 'args'
+    if( _parse( parse_obj, data, size, Callback_Field, Callback_Record, &args ) != size )
+    {
+        if( !_error_pending )
+        {
+            _error_pending = true;
+            _error_msg = "libcsv: ";
+            _error_msg += csv_strerror( csv_error( parse_obj ) );
+        }
+    }
+
+    if( parse_obj->row_end )
+    {
+        _line_offset = _chunk_offset + parse_obj->row_end;
+        parse_obj->row_end = 0;
+    }
+
+    _chunk_offset += size;
+}
+
+
+void CSVread::SelectParser()
+{
+    _parse = dialect_parser( _delimiter, _quote, (unsigned char)csv_get_opts( parse_obj ) );
+}
+
+
+
+
+unsigned char CSVread::GetDelimiter()
+{
+    return _delimiter;
+}
+
+
+void CSVread::SetDelimiter( unsigned char delim )
+{
+    _delimiter = delim;
+
+    if( parse_obj )
+    {
+        csv_set_delim( parse_obj, _delimiter );
+        SelectParser();
+    }
+}
+
+
+unsigned char CSVread::GetQuote()
+{
+    return _quote;
+}
+
+
+void CSVread::SetQuote( unsigned char quote )
+{
+    _quote = quote;
+
+    if( parse_obj )
+    {
+        csv_set_quote( parse_obj, _quote );
+        SelectParser();
+    }
+}
+
+
+void CSVread::SetInterned( size_t column, bool interned /* = true */ )
+{
+    if( column >= _interned.size() )
+    {
+        if( !interned )
+        {
+            return;
+        }
+
+        _interned.resize( column + 1, false );
+    }
+
+    _interned[ column ] = interned;
+
+    // Trailing columns that aren't interned are removed so that an empty list means none are.
+    while( _interned.size() && !_interned.back() )
+    {
+        _interned.pop_back();
+    }
+
+    if( !_interned.size() )
+    {
+        // The fields have no codes after this so those that are only in the dictionary are copied.
+        CopyInternedFields();
+        _codes = vector<uint32_t>();
+    }
+}
+
+
+bool CSVread::IsInterned( size_t column ) const
+{
+    return ( column < _interned.size() ) && _interned[ column ];
+}
+
+
+void CSVread::ClearDictionary()
+{
+    // The codes are invalidated so the fields that are only in the dictionary are copied first,
+    // including those of the records in the cache.
+    CopyInternedFields();
+
+    list<vector<string>>::iterator record = _cache.begin();
+
+    for( list<cache_info>::iterator info = _info_cache.begin();
+        info != _info_cache.end();
+        ++info, ++record )
+    {
+        const vector<uint32_t> &codes = info->codes;
+
+        for( size_t i = 0; i < codes.size(); ++i )
+        {
+            if( codes[ i ] == CSVdictionary::no_code )
+            {
+                continue;
+            }
+
+            // With flag 'lazy_unescape' a field in the cache that begins with the quote character
+            // is escaped. Refer to Callback_Field().
+            const string &field = _dictionary[ codes[ i ] ];
+
+            if( ( _flags & lazy_unescape ) && field.size() && ( field[ 0 ] == (char)_quote ) )
+            {
+                ( *record )[ i ] = escape_field( field.data(), field.size(), (char)_quote );
+            }
+            else
+            {
+                ( *record )[ i ] = field;
+            }
+        }
+
+        info->codes.clear();
+    }
+
+    _dictionary.Clear();
+    _codes = vector<uint32_t>();
+}
+
+
+
+
+bool CSVread::ReadRecord( const uintmax_t requested_record_num /* = 0 */ )
+{
+    if( _error )
+        return false;
+
+    if( !_input_ptr )
+    {
+        _error = true;
+        _error_msg = "A stream is not associated with the object.";
+        return false;
+    }
+
+    if( !_cache.size() )
+    {
+        _error = true;
+        _error_msg = "The cache list does not contain any elements";
+        return false;
+    }
+
+    _eof = _input_ptr->eof();
+    uintmax_t pending = _record_num + _cache.size();
+    uintmax_t requested = requested_record_num;
+
+    if( !requested )
+    {
+        if( _record_num == (numeric_limits<uintmax_t>::max)() )
+        {
+            _error = true;
+            _error_msg = "The maximum number of records have been read (UINTMAX_MAX)";
+            return false;
+        }
+        requested = _record_num + 1;
+    }
+
+    if( requested > _record_num )
+    {
+        if( requested < pending ) // the requested record is already in the cache
+        {
+            for( uintmax_t i = requested - _record_num - 1; i; --i )
+            {
+                _cache.pop_front();
+                _info_cache.pop_front();
             }
 
             _record_num = requested;
+            _record_offset = _info_cache.front().offset;
             _fields.swap( _cache.front() );
+            _unescaped.clear();
             _cache.pop_front();
+            InternFields( _info_cache.front().codes );
+            _info_cache.pop_front();
             return true;
         }
         else if( requested > pending ) // the requested record is not in the cache
@@ -620,9 +1510,11 @@ bool CSVread::ReadRecord( const uintmax_t requested_record_num /* = 0 */ )
         {
             // Discard all except the pending record.
             vector<string> temp;
+            cache_info temp_info = _info_cache.back();
             temp.swap( _cache.back() );
             ResetCache();
             temp.swap( _cache.back() );
+            _info_cache.back() = temp_info;
         }
     }
     else if( requested < _record_num )
@@ -682,7 +1574,9 @@ bool CSVread::ReadRecord( const uintmax_t requested_record_num /* = 0 */ )
 
     bool parsed_end_record = false;
 
-    cb_stuff args( _cache, _flags, _error_pending, _error_msg, _end_record_not_terminated, pending, requested );
+    cb_stuff args( _cache, _info_cache, _interned, _dictionary, _flags, _error_pending, _error_msg,
+        _end_record_not_terminated, _cr_terminated, _null_seen, _quote, parse_obj, _chunk_offset,
+        _line_offset, pending, requested );
 
     while( ( _cache.size() == 1 ) && !_error_pending )
     {
@@ -693,15 +1587,7 @@ bool CSVread::ReadRecord( const uintmax_t requested_record_num /* = 0 */ )
         if( len > 0 )
         {
             // REM the callbacks can modify most of the 'args'
-            if( csv_parse( parse_obj, _buffer, (size_t)len, Callback_Field, Callback_Record, &args ) != len )
-            {
-                if( !_error_pending )
-                {
-                    _error_pending = true;
-                    _error_msg = "libcsv: ";
-                    _error_msg += csv_strerror( csv_error( parse_obj ) );
-                }
-            }
+            ParseChunk( _buffer, (size_t)len, args );
         }
 
         // REM this block of code is duplicated in Associate()
@@ -709,8 +1595,19 @@ bool CSVread::ReadRecord( const uintmax_t requested_record_num /* = 0 */ )
         {
             if( !_input_ptr->good() || ( len != _buffer_size ) )
             {
+                if( _has_utf16_bom && !_utf16->Complete() )
+                {
+                    _error_msg = "UTF-16 stream ends in an incomplete code unit or surrogate pair.";
+                }
+                else if( RangeEndsInQuotedField() )
+                {
+                    ostringstream ss;
+                    ss << "Record #" << pending << " is split by the end of the range, which is "
+                        "inside a quoted field.";
+                    _error_msg = ss.str();
+                }
                 // REM the callback can modify most of the 'args'
-                if( csv_fini( parse_obj, Callback_Field, Callback_Record, &args ) )
+                else if( csv_fini( parse_obj, Callback_Field, Callback_Record, &args ) )
                 {
                     _error_msg = "libcsv: ";
                     _error_msg += csv_strerror( csv_error( parse_obj ) );
@@ -753,12 +1650,409 @@ bool CSVread::ReadRecord( const uintmax_t requested_record_num /* = 0 */ )
     }
 
     _record_num = requested;
+    _record_offset = _info_cache.front().offset;
     _fields.swap( _cache.front() );
+    _unescaped.clear();
     _cache.pop_front();
+    InternFields( _info_cache.front().codes );
+    _info_cache.pop_front();
+
+    return true;
+}
+
+
+void CSVread::InternFields( const vector<uint32_t> &cached )
+{
+    if( !_interned.size() && !cached.size() )
+    {
+        return;
+    }
+
+    _codes.assign( _fields.size(), CSVdictionary::no_code );
+
+    for( size_t i = 0; i < _fields.size(); ++i )
+    {
+        const uint32_t code = ( i < cached.size() ) ? cached[ i ] : CSVdictionary::no_code;
+
+        if( code != CSVdictionary::no_code )
+        {
+            // The field was interned as it was parsed. If the column isn't interned anymore then
+            // Field() copies it from the dictionary now, since it has no code after.
+            _codes[ i ] = code;
+
+            if( !IsInterned( i ) )
+            {
+                Field( i );
+                _codes[ i ] = CSVdictionary::no_code;
+            }
+        }
+        else if( IsInterned( i ) )
+        {
+            // The field was parsed before the column was interned, or the dictionary was full.
+            const string &field = Field( i );
+            _codes[ i ] = _dictionary.Intern( field.data(), field.size() );
+        }
+    }
+
+    if( !_interned.size() )
+    {
+        _codes = vector<uint32_t>();
+    }
+}
+
+
+void CSVread::CopyInternedFields()
+{
+    for( size_t i = 0; ( i < _codes.size() ) && ( i < _fields.size() ); ++i )
+    {
+        Field( i );
+    }
+}
+
+
+const string &CSVread::Field( const size_t index )
+{
+    string &field = _fields[ index ];
+
+    // An interned field is empty until it's copied from the dictionary, where it's unescaped.
+    const bool copied = field.empty()
+        && ( index < _codes.size() )
+        && ( _codes[ index ] != CSVdictionary::no_code );
+
+    if( copied )
+    {
+        field = _dictionary[ _codes[ index ] ];
+    }
+
+    if( ( _flags & lazy_unescape )
+        && !field.empty()
+        && ( field[ 0 ] == (char)_quote )
+        && ( ( index >= _unescaped.size() ) || !_unescaped[ index ] )
+    )
+    {
+        if( !copied )
+        {
+            unescape_field( field, (char)_quote );
+        }
+
+        if( index >= _unescaped.size() )
+        {
+            _unescaped.resize( _fields.size() );
+        }
+
+        _unescaped[ index ] = true;
+    }
+
+    return field;
+}
+
+
+void CSVread::UnescapeFields()
+{
+    if( ( _flags & lazy_unescape ) || _codes.size() )
+    {
+        for( size_t i = 0; i < _fields.size(); ++i )
+        {
+            Field( i );
+        }
+    }
+}
+
+
+void CSVread::ReleaseFields( Record &record )
+{
+    // The record has no Field() so its fields are unescaped first.
+    UnescapeFields();
+
+    Record().swap( record );
+    record.swap( _fields );
+    _unescaped.clear();
+}
+
+
+
+
+void CSVread::BindColumn( const size_t index, const char *name )
+{
+    ostringstream ss;
+
+    if( !name )
+    {
+        ss << "Member #" << ( index + 1 ) << " has no name to bind to a column of the header.";
+        _error = true;
+        _error_msg = ss.str();
+        return;
+    }
+
+    size_t column = 0;
+    while( ( column < _fields.size() ) && ( Field( column ) != name ) )
+    {
+        ++column;
+    }
+
+    if( column == _fields.size() )
+    {
+        ss << "The header has no column named \"" << name << "\".";
+        _error = true;
+        _error_msg = ss.str();
+        return;
+    }
+
+    _columns.push_back( column );
+}
+
+
+bool CSVread::FieldOf( const size_t index, const char *name, const char *&data, size_t &size )
+{
+    const size_t column = _columns.empty() ? index : _columns[ index ];
+
+    if( column < _fields.size() )
+    {
+        const string &field = _fields[ column ];
+
+        // An interned field that hasn't been copied is read from the dictionary.
+        if( field.empty()
+            && ( column < _codes.size() )
+            && ( _codes[ column ] != CSVdictionary::no_code )
+        )
+        {
+            const string &interned = _dictionary[ _codes[ column ] ];
+            data = interned.data();
+            size = interned.size();
+            return true;
+        }
+
+        // A field that's still escaped is read from inside its quotes, unless it has a quote in it.
+        const bool escaped = ( _flags & lazy_unescape )
+            && ( field.size() >= 2 )
+            && ( field[ 0 ] == (char)_quote )
+            && ( ( column >= _unescaped.size() ) || !_unescaped[ column ] );
+
+        if( escaped && !memchr( field.data() + 1, _quote, field.size() - 2 ) )
+        {
+            data = field.data() + 1;
+            size = field.size() - 2;
+            return true;
+        }
+
+        const string &unescaped = Field( column );
+        data = unescaped.data();
+        size = unescaped.size();
+        return true;
+    }
+
+    ostringstream ss;
+    ss << "Record #" << _record_num << " Field #" << ( column + 1 );
+    if( name )
+    {
+        ss << " (" << name << ")";
+    }
+    ss << " is missing. The record has " << _fields.size() << " fields.";
+
+    _error = true;
+    _error_msg = ss.str();
+    return false;
+}
+
+
+void CSVread::FieldInvalid( const size_t index, const char *name, const char *data, size_t size )
+{
+    const size_t column = _columns.empty() ? index : _columns[ index ];
+
+    ostringstream ss;
+    ss << "Record #" << _record_num << " Field #" << ( column + 1 );
+    if( name )
+    {
+        ss << " (" << name << ")";
+    }
+    ss << " is invalid for its member: \"" << string( data, size ) << "\"";
+
+    _error = true;
+    _error_msg = ss.str();
+}
+
+
+/* Parse a field that's an integer: an optional sign and then digits, and nothing else.
+
+[in] 'max_positive', 'max_negative' : The largest magnitudes allowed, positive and negative. A
+    'max_negative' of 0 allows only "-0".
+[ret][failure] (false) : The field isn't an integer or is out of range.
+[ret][success] (true) : 'magnitude' and 'negative' are set.
+*/
+static bool parse_integer(
+    const char *data,
+    const size_t size,
+    const unsigned long long max_positive,
+    const unsigned long long max_negative,
+    unsigned long long &magnitude,
+    bool &negative
+)
+{
+    const char *p = data;
+    const char *const end = p + size;
+
+    negative = ( p != end ) && ( *p == '-' );
+
+    if( ( p != end ) && ( ( *p == '-' ) || ( *p == '+' ) ) )
+    {
+        ++p;
+    }
+
+    if( p == end )
+        return false;
+
+    const unsigned long long max = negative ? max_negative : max_positive;
+    magnitude = 0;
+
+    for( ; p != end; ++p )
+    {
+        const unsigned digit = (unsigned)( (unsigned char)*p - '0' );
+
+        if( ( digit > 9 ) || ( digit > max ) || ( magnitude > ( ( max - digit ) / 10 ) ) )
+            return false;
+
+        magnitude = ( magnitude * 10 ) + digit;
+    }
+
+    return true;
+}
+
+
+template< class T >
+static bool convert_signed( const char *data, const size_t size, T &value )
+{
+    const unsigned long long max = (unsigned long long)numeric_limits<T>::max();
+    unsigned long long magnitude;
+    bool negative;
+
+    if( !parse_integer( data, size, max, max + 1, magnitude, negative ) )
+        return false;
+
+    // The magnitude of the minimum doesn't fit in T, so it's negated before the last subtraction.
+    value = ( negative && magnitude ) ? (T)( -(T)( magnitude - 1 ) - 1 ) : (T)magnitude;
+    return true;
+}
+
+
+template< class T >
+static bool convert_unsigned( const char *data, const size_t size, T &value )
+{
+    unsigned long long magnitude;
+    bool negative;
+
+    if( !parse_integer( data, size, numeric_limits<T>::max(), 0, magnitude, negative ) )
+        return false;
 
+    value = (T)magnitude;
     return true;
 }
 
 
+string CSVread::DecimalPoint()
+{
+    return c_decimal_point();
+}
+
+
+bool CSVread::ConvertField(
+    const char *data,
+    const size_t size,
+    const string &,
+    string &value
+)
+{
+    value.assign( data, size );
+    return true;
+}
+
+
+bool CSVread::ConvertField(
+    const char *data,
+    const size_t size,
+    const string &,
+    int &value
+)
+{
+    return convert_signed( data, size, value );
+}
+
+
+bool CSVread::ConvertField(
+    const char *data,
+    const size_t size,
+    const string &,
+    long &value
+)
+{
+    return convert_signed( data, size, value );
+}
+
+
+bool CSVread::ConvertField(
+    const char *data,
+    const size_t size,
+    const string &,
+    long long &value
+)
+{
+    return convert_signed( data, size, value );
+}
+
+
+bool CSVread::ConvertField(
+    const char *data,
+    const size_t size,
+    const string &,
+    unsigned &value
+)
+{
+    return convert_unsigned( data, size, value );
+}
+
+
+bool CSVread::ConvertField(
+    const char *data,
+    const size_t size,
+    const string &,
+    unsigned long &value
+)
+{
+    return convert_unsigned( data, size, value );
+}
+
+
+bool CSVread::ConvertField(
+    const char *data,
+    const size_t size,
+    const string &,
+    unsigned long long &value
+)
+{
+    return convert_unsigned( data, size, value );
+}
+
+
+bool CSVread::ConvertField(
+    const char *data,
+    const size_t size,
+    const string &point,
+    float &value
+)
+{
+    return parse_float( data, size, point, value );
+}
+
+
+bool CSVread::ConvertField(
+    const char *data,
+    const size_t size,
+    const string &point,
+    double &value
+)
+{
+    return parse_double( data, size, point, value );
+}
+
+
 } // namespace util
 } // namespace jay
@@ -27,12 +27,44 @@ Documentation is in CSV.hpp.
 
 #include "CSV.hpp"
 
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include <errno.h>
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
 #include <fstream>
-#include <list>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#ifdef JAY_UTIL_CSV_ZLIB
+#include <zlib.h>
+#endif
+
+/* Whether or not std::to_chars() for floating point is available (C++17, libstdc++ 11, VS2019 16.4).
+WriteField( double ) uses it to count the shortest digits instead of trying each precision.
+*/
+#if ( __cplusplus >= 201703L ) || ( defined( _MSVC_LANG ) && ( _MSVC_LANG >= 201703L ) )
+#include <charconv>
+#ifdef __cpp_lib_to_chars
+#define JAY_UTIL_CSV_TO_CHARS
+#endif
+#endif
+
 #include "strerror.hpp"
 
 
@@ -43,8 +75,144 @@ namespace jay {
 namespace util {
 
 
+/* Write to a file descriptor. A short write is continued and an interrupted one is retried.
+
+[ret][failure] (the errno value)
+[ret][success] (0)
+*/
+static int write_fd( int fd, const char *data, size_t size )
+{
+    while( size )
+    {
+#ifdef _WIN32
+        const unsigned count = ( size < INT_MAX ) ? (unsigned)size : INT_MAX;
+        const int written = _write( fd, data, count );
+#else
+        const size_t count = ( size < SSIZE_MAX ) ? size : SSIZE_MAX;
+        const ssize_t written = write( fd, data, count );
+#endif
+
+        if( written < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+
+            return errno;
+        }
+
+        data += written;
+        size -= (size_t)written;
+    }
+
+    return 0;
+}
+
+
+/* Write two pieces of data to a file descriptor, in one system call if it's possible.
+
+[ret][failure] (the errno value)
+[ret][success] (0)
+*/
+static int write_fd( int fd, const char *data1, size_t size1, const char *data2, size_t size2 )
+{
+#ifdef _WIN32
+    const int err = write_fd( fd, data1, size1 );
+    return err ? err : write_fd( fd, data2, size2 );
+#else
+    while( size1 && size2 )
+    {
+        struct iovec iov[ 2 ];
+        iov[ 0 ].iov_base = (void *)data1;
+        iov[ 0 ].iov_len = size1;
+        iov[ 1 ].iov_base = (void *)data2;
+        iov[ 1 ].iov_len = size2;
+
+        const ssize_t written = writev( fd, iov, 2 );
+
+        if( written < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+
+            return errno;
+        }
+
+        if( (size_t)written < size1 )
+        {
+            data1 += written;
+            size1 -= (size_t)written;
+        }
+        else
+        {
+            data2 += written - size1;
+            size2 -= written - size1;
+            size1 = 0;
+        }
+    }
+
+    const int err = write_fd( fd, data1, size1 );
+    return err ? err : write_fd( fd, data2, size2 );
+#endif
+}
+
+
+/* Close a file descriptor.
+
+[ret][failure] (-1) : errno is set.
+[ret][success] (0)
+*/
+static int close_fd( int fd )
+{
+#ifdef _WIN32
+    return _close( fd );
+#else
+    return close( fd );
+#endif
+}
+
+
+/* Create a file that doesn't exist yet, and close it.
+
+[ret][failure] (the errno value) : EEXIST if the file exists.
+[ret][success] (0)
+*/
+static int create_new_file( const string &filename )
+{
+#ifdef _WIN32
+    const int fd = _open( filename.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL, _S_IREAD | _S_IWRITE );
+#else
+    const int fd = open( filename.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666 );
+#endif
+
+    if( fd < 0 )
+        return errno;
+
+    close_fd( fd );
+    return 0;
+}
+
+
+#ifdef JAY_UTIL_CSV_ZLIB
+// The state of the gzip compression of the output.
+struct gzip_state
+{
+    z_stream stream;
+
+    // The compressed data before it's written.
+    char out[ 65536 ];
+
+    // The number of bytes compressed into the current gzip member.
+    uint64_t member_in;
+};
+#else
+// Flush modes, so the calls to CSVwrite::Deflate() compile. It's never called without zlib.
+enum { Z_NO_FLUSH, Z_SYNC_FLUSH, Z_FINISH };
+#endif
+
+
+
 CSVwrite::CSVwrite() :
-    buffer_size( _buffer_size), error( _error ), error_msg( _error_msg )
+    buffer_size( _buffer_size), error( _error ), error_msg( _error_msg ), filename( _filename )
 {
     if( !Init() )
         return;
@@ -52,7 +220,7 @@ CSVwrite::CSVwrite() :
 
 
 CSVwrite::CSVwrite( string filename, Flags flags /* = none */ ) :
-    buffer_size( _buffer_size), error( _error ), error_msg( _error_msg )
+    buffer_size( _buffer_size), error( _error ), error_msg( _error_msg ), filename( _filename )
 {
     if( !Init() )
         return;
@@ -62,7 +230,7 @@ CSVwrite::CSVwrite( string filename, Flags flags /* = none */ ) :
 
 
 CSVwrite::CSVwrite( ostream *stream, Flags flags /* = none */ ) :
-    buffer_size( _buffer_size), error( _error ), error_msg( _error_msg )
+    buffer_size( _buffer_size), error( _error ), error_msg( _error_msg ), filename( _filename )
 {
     if( !Init() )
         return;
@@ -73,6 +241,19 @@ CSVwrite::CSVwrite( ostream *stream, Flags flags /* = none */ ) :
 
 CSVwrite::~CSVwrite()
 {
+    // Whatever is left in the buffer is written. There's no way to report an error here.
+    if( IsAssociated() && !_error && EndGzip() )
+    {
+        WriteBuffer();
+    }
+
+    if( _fd_owned )
+    {
+        close_fd( _fd );
+    }
+
+    FreeGzip();
+
     free( _buffer );
 }
 
@@ -88,6 +269,10 @@ bool CSVshared_ResizeBuffer(
 
 bool CSVwrite::ResizeBuffer( const streamsize bytes )
 {
+    // The data in the buffer is written first since the new size may be smaller.
+    if( _buffer_used && !WriteBuffer() )
+        return false;
+
     return CSVshared_ResizeBuffer( bytes, _buffer, _buffer_size, _error, _error_msg );
 }
 
@@ -95,7 +280,7 @@ bool CSVwrite::ResizeBuffer( const streamsize bytes )
 // REM This function is also called by Init() for initialization
 bool CSVwrite::Reset()
 {
-    if( _output_ptr )
+    if( IsAssociated() )
     {
         _error = true;
         _error_msg = "Not implemented";
@@ -111,7 +296,14 @@ bool CSVwrite::Reset()
     _flags = CSVwrite::none;
     _error = false;
     _error_msg = "";
+    _filename = "";
+    _rotation_base = "";
+    _file_number = 0;
+    _file_bytes = 0;
+    _rotating = false;
+    _in_record = false;
     _is_first_field = true;
+    _buffer_used = 0;
 
     return true;
 }
@@ -119,14 +311,41 @@ bool CSVwrite::Reset()
 
 bool CSVwrite::Close()
 {
+    // Whatever is in the buffer is written before the stream is closed or dissociated, and the gzip
+    // stream is finished.
+    bool flushed = !IsAssociated() || _error || ( EndGzip() && Flush() );
+    string flush_error_msg = _error_msg;
+
+    FreeGzip();
+
     if( _file.is_open() )
     {
         _file.close();
     }
 
+    // A file descriptor is only closed if it was opened by this class. The data written to it may
+    // not have reached the file until it's closed, so the error is reported.
+    if( _fd_owned && close_fd( _fd ) && flushed )
+    {
+        flushed = false;
+        flush_error_msg = "Failed closing the file descriptor: " + errno_strerror( errno );
+    }
+
     _output_ptr =  NULL;
+    _fd = -1;
+    _fd_owned = false;
 
-    return Reset();
+    if( !Reset() )
+        return false;
+
+    if( !flushed )
+    {
+        _error = true;
+        _error_msg = flush_error_msg;
+        return false;
+    }
+
+    return true;
 }
 
 
@@ -136,7 +355,18 @@ bool CSVwrite::Init()
     // The vars here must be zeroed before any possible error aborts the initialization.
     _buffer = NULL;
     _buffer_size = 0;
+    _buffer_used = 0;
     _output_ptr =  NULL;
+    _fd = -1;
+    _fd_owned = false;
+    _special_valid = false;
+    _gzip = NULL;
+    _gzip_level = 0;
+    _gzip_member_size = 0;
+    _rotation_bytes = 0;
+    _rotation_seconds = 0;
+    _rotation_bom = false;
+    _file_opened = 0;
 
     delimiter = ",";
     terminator = "\n";
@@ -159,7 +389,7 @@ bool CSVwrite::Associate( ostream *stream, const Flags flags /* = none */ )
         return false;
     }
 
-    if( _output_ptr )
+    if( IsAssociated() )
     {
         _error = true;
         _error_msg = "A stream is already associated. Call Close() to dissociate.";
@@ -174,6 +404,13 @@ bool CSVwrite::Associate( ostream *stream, const Flags flags /* = none */ )
         return false;
     }
 
+    if( ( _rotation_bytes || _rotation_seconds ) && ( stream != &_file ) )
+    {
+        _error = true;
+        _error_msg = "Rotation is only valid for files opened by this class.";
+        return false;
+    }
+
     _flags = flags;
     _output_ptr = stream;
 
@@ -184,7 +421,7 @@ bool CSVwrite::Associate( ostream *stream, const Flags flags /* = none */ )
         return false;
     }
 
-    return true;
+    return StartGzip();
 }
 
 
@@ -200,67 +437,203 @@ bool CSVwrite::Open( string filename, const Flags flags /* = none */ )
         return false;
     }
 
-    if( _output_ptr )
+    if( IsAssociated() )
     {
         _error = true;
         _error_msg = "A stream is already associated. Call Close() to dissociate.";
         return false;
     }
 
-    ios::openmode mode = ( ( flags & text_mode ) ) ? 0 : ios::binary;
-    mode |= ( ( flags & truncate ) ) ? ios::trunc : ios::app;
+    if( !OpenFile( filename, flags, false ) )
+        return false;
+
+    _rotation_base = filename;
+    return Associate( &_file, flags );
+}
+
+
+bool CSVwrite::AssociateFD( const int fd, const Flags flags /* = none */ )
+{
+    if( _error )
+        return false;
+
+    if( fd < 0 )
+    {
+        _error = true;
+        _error_msg = "The file descriptor parameter is invalid.";
+        return false;
+    }
 
-    _file.open( filename, mode );
-    if( !_file )
+    if( IsAssociated() )
     {
         _error = true;
-        _error_msg = "Failed opening " + filename;
+        _error_msg = "A stream is already associated. Call Close() to dissociate.";
         return false;
     }
 
-    return Associate( &_file, flags );
-}
+    if( ( flags & ( truncate | text_mode ) ) )
+    {
+        // The mode of a file descriptor is decided when it's opened.
+        _error = true;
+        _error_msg = "Truncate and text mode are only valid for files opened by this class.";
+        return false;
+    }
 
+    if( _rotation_bytes || _rotation_seconds )
+    {
+        _error = true;
+        _error_msg = "Rotation is only valid for files opened by this class.";
+        return false;
+    }
 
+    _flags = flags;
+    _fd = fd;
+    return StartGzip();
+}
 
 
-bool CSVwrite::WriteUTF8BOM()
+bool CSVwrite::OpenFD( string filename, const Flags flags /* = none */ )
 {
     if( _error )
         return false;
 
-    if( !_output_ptr )
+    if( IsAssociated() )
     {
         _error = true;
-        _error_msg = "A stream is not associated with the object.";
+        _error_msg = "A stream is already associated. Call Close() to dissociate.";
         return false;
     }
 
-    _output_ptr->write( "\xEF\xBB\xBF", 3 );
-    if( !_output_ptr->good() )
+    if( !OpenFile( filename, flags, true ) )
+        return false;
+
+    _rotation_base = filename;
+    _flags = flags;
+    return StartGzip();
+}
+
+
+/* Open a file for output, as _file or as an owned file descriptor, and start counting its bytes
+from its size.
+
+It's opened in append mode unless 'flags' has 'truncate'.
+
+[ret][failure] (false) : 'error' and 'error_msg' are set.
+[ret][success] (true)
+*/
+bool CSVwrite::OpenFile( const string &filename, const Flags flags, const bool fd )
+{
+    if( fd )
+    {
+        int oflag = ( ( flags & truncate ) ) ? O_TRUNC : O_APPEND;
+
+#ifdef _WIN32
+        oflag |= ( ( flags & text_mode ) ) ? _O_TEXT : _O_BINARY;
+        _fd = _open( filename.c_str(), _O_WRONLY | _O_CREAT | oflag, _S_IREAD | _S_IWRITE );
+#else
+        // There is no text mode translation on POSIX.
+        _fd = open( filename.c_str(), O_WRONLY | O_CREAT | oflag, 0666 );
+#endif
+
+        if( _fd < 0 )
+        {
+            _fd = -1;
+            _error = true;
+            _error_msg = "Failed opening " + filename + ": " + errno_strerror( errno );
+            return false;
+        }
+
+        _fd_owned = true;
+
+#ifdef _WIN32
+        const __int64 size = _lseeki64( _fd, 0, SEEK_END );
+#else
+        const off_t size = lseek( _fd, 0, SEEK_END );
+#endif
+
+        if( size < 0 )
+        {
+            _error = true;
+            _error_msg = "Failed getting the size of " + filename + ": " + errno_strerror( errno );
+            return false;
+        }
+
+        _file_bytes = (uint64_t)size;
+    }
+    else
+    {
+        ios::openmode mode = ( ( flags & text_mode ) ) ? 0 : ios::binary;
+        mode |= ( ( flags & truncate ) ) ? ios::trunc : ios::app;
+
+        _file.open( filename, mode );
+        if( !_file )
+        {
+            _error = true;
+            _error_msg = "Failed opening " + filename;
+            return false;
+        }
+
+        _file.seekp( 0, ios::end );
+        const streamoff size = _file.tellp();
+
+        if( size < 0 )
+        {
+            _error = true;
+            _error_msg = "Failed getting the size of " + filename;
+            return false;
+        }
+
+        _file_bytes = (uint64_t)size;
+    }
+
+    _filename = filename;
+    _file_opened = time( NULL );
+    return true;
+}
+
+
+
+
+bool CSVwrite::WriteUTF8BOM()
+{
+    if( _error )
+        return false;
+
+    if( !IsAssociated() )
     {
         _error = true;
-        _error_msg = "ostream: " + ios_strerror( _output_ptr->rdstate() );
+        _error_msg = "A stream is not associated with the object.";
         return false;
     }
 
-    return true;
+    return Put( "\xEF\xBB\xBF", 3 );
 }
 
 
-bool CSVwrite::WriteTerminator()
+bool CSVwrite::Flush()
 {
     if( _error )
         return false;
 
-    if( !_output_ptr )
+    if( !IsAssociated() )
     {
         _error = true;
         _error_msg = "A stream is not associated with the object.";
         return false;
     }
 
-    _output_ptr->write( terminator.c_str(), terminator.length() );
+    if( !WriteBuffer() )
+        return false;
+
+    // The compressed data so far is completed to a byte boundary, so it can all be decompressed.
+    if( _gzip && !Deflate( NULL, 0, Z_SYNC_FLUSH ) )
+        return false;
+
+    // The data written to a file descriptor is already with the OS, there's nothing to flush.
+    if( !_output_ptr )
+        return true;
+
+    _output_ptr->flush();
     if( !_output_ptr->good() )
     {
         _error = true;
@@ -268,139 +641,853 @@ bool CSVwrite::WriteTerminator()
         return false;
     }
 
-    _is_first_field = true;
     return true;
 }
 
 
-bool CSVwrite::WriteField( const string &field, bool terminate /* = false */ )
+bool CSVwrite::WriteTerminator()
 {
     if( _error )
         return false;
 
-    if( !_output_ptr )
+    if( !IsAssociated() )
     {
         _error = true;
         _error_msg = "A stream is not associated with the object.";
         return false;
     }
 
-    char *p = _buffer;
-    const char *const buffer_end = _buffer + (size_t)_buffer_size;
+    if( !PutTerminator() )
+        return false;
+
+    _is_first_field = true;
+    return true;
+}
 
-    list<char> prepend, append;
 
-    if( !_is_first_field )
-    {
-        prepend.assign( delimiter.begin(), delimiter.end() );
-    }
+/* Copy data to the buffer, writing the buffer to the stream whenever it's full.
 
-    if( terminate )
+[ret][failure] (false) : 'error' and 'error_msg' are set.
+[ret][success] (true)
+*/
+bool CSVwrite::Put( const char *data, size_t size )
+{
+    if( !size )
+        return true;
+
+    // The file is switched before the first byte of a record rather than after the last byte of the
+    // one before it, so that the last record doesn't leave a new empty file behind.
+    if( !_in_record && !_rotating && ( _rotation_bytes || _rotation_seconds ) && RotationDue() )
     {
-        append.assign( terminator.begin(), terminator.end() );
+        if( !Rotate() )
+            return false;
     }
 
-    // All fields are qualified with double quotes since that is what libcsv write functions do
-    prepend.push_back( '"' );
-    append.push_front( '"' );
+    _in_record = true;
+
+    const size_t capacity = (size_t)_buffer_size;
+
+    // Data that would fill the buffer at least once is written to a file descriptor along with the
+    // buffer, instead of being copied to it. When compressing it's all compressed from the buffer.
+    if( ( _fd != -1 ) && !_gzip && ( size >= capacity ) )
+    {
+        const int err = write_fd( _fd, _buffer, _buffer_used, data, size );
+        _file_bytes += _buffer_used + size;
+        _buffer_used = 0;
 
-    // This is set when there is a quote that needs to be escaped but there's no room in the buffer
-    bool quote = false;
+        if( err )
+        {
+            _error = true;
+            _error_msg = "Failed writing to the file descriptor: " + errno_strerror( err );
+            return false;
+        }
 
-    // This is set when the buffer needs to be written to the stream even if the buffer is not full
-    bool flush = false;
+        return true;
+    }
 
-    for( string::const_iterator it = field.begin();; )
+    while( size )
     {
-        if( flush || ( p == buffer_end ) )
+        if( _buffer_used == capacity )
         {
-            _output_ptr->write( _buffer, ( p - _buffer ) );
-            if( !_output_ptr->good() )
-            {
-                _error = true;
-                _error_msg = "ostream: " + ios_strerror( _output_ptr->rdstate() );
+            if( !WriteBuffer() )
                 return false;
-            }
+        }
 
-            if( flush && ( it == field.end() ) )
-            {
-                break;
-            }
+        const size_t room = capacity - _buffer_used;
+        const size_t n = ( size < room ) ? size : room;
+        memcpy( _buffer + _buffer_used, data, n );
+        _buffer_used += n;
+        data += n;
+        size -= n;
+    }
 
-            p = _buffer;
-        }
+    return true;
+}
 
-        if( it == field.begin() )
-        {
-            while( prepend.size() && ( p != buffer_end ) )
-            {
-                *p++ = *prepend.begin();
-                prepend.pop_front();
-            }
 
-            if( p == buffer_end )
-            {
-                continue;
-            }
-        }
+// Copy the terminator to the buffer, and end the record.
+bool CSVwrite::PutTerminator()
+{
+    return Put( terminator.data(), terminator.size() ) && EndRecord();
+}
 
-        if( quote )
-        {
-            *p++ = '"';
-            quote = false;
 
-            if( p == buffer_end )
-            {
-                continue;
-            }
-        }
+/* End the gzip member if it's big enough. This must only be called at the end of a record. If the
+file is big or old enough it's switched when the next record starts. Refer to Put().
+*/
+bool CSVwrite::EndRecord()
+{
+    _in_record = false;
+    return CheckGzipMember();
+}
 
-        if( it == field.end() )
-        {
-            while( append.size() && ( p != buffer_end ) )
-            {
-                *p++ = *append.begin();
-                append.pop_front();
-            }
 
-            if( !append.size() || ( p != buffer_end ) )
-            {
-                flush = true;
-            }
+// Whether or not the file is big or old enough to switch to the next one. Refer to SetRotation().
+bool CSVwrite::RotationDue() const
+{
+    // The data in the buffer is counted unless it's still to be compressed.
+    return ( _rotation_bytes
+            && ( ( _file_bytes + ( _gzip ? 0 : _buffer_used ) ) >= _rotation_bytes ) )
+        || ( _rotation_seconds && ( difftime( time( NULL ), _file_opened ) >= _rotation_seconds ) );
+}
 
-            continue;
-        }
 
-        while( ( p != buffer_end ) && ( it != field.end() ) )
-        {
-            *p = *it++;
-            if( *p++ == '"' )
-            {
-                if( p == buffer_end )
-                {
-                    quote = true;
-                    break;
-                }
+// End the gzip member if it's big enough. This must only be called at the end of a record.
+bool CSVwrite::CheckGzipMember()
+{
+#ifdef JAY_UTIL_CSV_ZLIB
+    if( _gzip && _gzip_member_size
+        && ( ( _gzip->member_in + _buffer_used ) >= _gzip_member_size )
+    )
+    {
+        if( !WriteBuffer() || !Deflate( NULL, 0, Z_FINISH ) )
+            return false;
 
-                *p++ = '"';
-            }
-        }
+        // The next data compressed starts a new member, with its own gzip header.
+        deflateReset( &_gzip->stream );
+        _gzip->member_in = 0;
     }
+#endif
 
-    _is_first_field = terminate;
     return true;
 }
 
 
-bool CSVwrite::WriteRecord( const vector<string> &fields, bool terminate /* = true */ )
+// Write the data in the buffer to the stream or file descriptor, or compress it, and empty the
+// buffer.
+bool CSVwrite::WriteBuffer()
 {
-    if( _error )
-        return false;
+    if( !_buffer_used )
+        return true;
 
-    if( !_output_ptr )
-    {
-        _error = true;
-        _error_msg = "A stream is not associated with the object.";
+    const size_t size = _buffer_used;
+    _buffer_used = 0;
+
+    return _gzip ? Deflate( _buffer, size, Z_NO_FLUSH ) : WriteRaw( _buffer, size );
+}
+
+
+// Write data to the stream or file descriptor.
+bool CSVwrite::WriteRaw( const char *data, size_t size )
+{
+    if( _fd != -1 )
+    {
+        const int err = write_fd( _fd, data, size );
+
+        if( err )
+        {
+            _error = true;
+            _error_msg = "Failed writing to the file descriptor: " + errno_strerror( err );
+            return false;
+        }
+
+        _file_bytes += size;
+        return true;
+    }
+
+    _output_ptr->write( data, (streamsize)size );
+
+    if( !_output_ptr->good() )
+    {
+        _error = true;
+        _error_msg = "ostream: " + ios_strerror( _output_ptr->rdstate() );
+        return false;
+    }
+
+    _file_bytes += size;
+    return true;
+}
+
+
+
+
+/* The name of a file after the first in a rotation: the name of the first with the number inserted
+before the extension, eg out.csv and 2 is out.2.csv. A name without an extension gets the number at
+the end.
+*/
+static string rotated_filename( const string &first, const unsigned long number )
+{
+    const size_t slash = first.find_last_of( "/\\" );
+    const size_t name = ( slash == string::npos ) ? 0 : ( slash + 1 );
+    size_t dot = first.rfind( '.' );
+
+    // A dot at the start of the name, eg .csv, isn't an extension.
+    if( ( dot == string::npos ) || ( dot <= name ) )
+    {
+        dot = first.size();
+    }
+
+    ostringstream ss;
+    ss << first.substr( 0, dot ) << '.' << number << first.substr( dot );
+    return ss.str();
+}
+
+
+bool CSVwrite::SetRotation(
+    const uint64_t max_bytes,
+    const unsigned max_seconds,
+    const vector<string> &header /* = vector<string>() */,
+    const bool utf8bom /* = false */
+)
+{
+    if( _error )
+        return false;
+
+    if( IsAssociated() )
+    {
+        _error = true;
+        _error_msg = "Rotation can't be changed while a stream is associated. Call Close() first.";
+        return false;
+    }
+
+    _rotation_bytes = max_bytes;
+    _rotation_seconds = max_seconds;
+    _rotation_header = header;
+    _rotation_bom = utf8bom;
+    return true;
+}
+
+
+/* Close the file and open the next one, before the first byte of a record.
+
+The file is finished as by Close(), so if compressing it's a complete gzip file. The next one is
+opened the same way, stream or file descriptor, with the same flags, and starts with the BOM and
+header if they were set and it's empty.
+
+[ret][failure] (false) : 'error' and 'error_msg' are set.
+[ret][success] (true)
+*/
+bool CSVwrite::Rotate()
+{
+    if( !EndGzip() || !WriteBuffer() )
+        return false;
+
+    const bool fd = _fd_owned;
+
+    if( fd )
+    {
+        const int closed = close_fd( _fd );
+        _fd = -1;
+        _fd_owned = false;
+
+        if( closed )
+        {
+            _error = true;
+            _error_msg = "Failed closing " + _filename + ": " + errno_strerror( errno );
+            return false;
+        }
+    }
+    else
+    {
+        _file.close();
+
+        if( !_file )
+        {
+            _error = true;
+            _error_msg = "Failed closing " + _filename;
+            return false;
+        }
+    }
+
+    /* The next file is a new one. A number whose file exists, eg from an earlier run that appended
+    to the first file, is skipped so that the records aren't appended to it. With flag 'truncate' it's
+    truncated instead, like the first file.
+    */
+    string next;
+    for( ;; )
+    {
+        next = rotated_filename( _rotation_base, ++_file_number );
+
+        if( ( _flags & truncate ) )
+            break;
+
+        const int err = create_new_file( next );
+
+        if( !err )
+            break;
+
+        if( err != EEXIST )
+        {
+            _error = true;
+            _error_msg = "Failed creating " + next + ": " + errno_strerror( err );
+            return false;
+        }
+    }
+
+    if( !OpenFile( next, _flags, fd ) || !StartGzip() )
+        return false;
+
+    // The file is empty unless something else wrote to it after it was created.
+    if( _file_bytes )
+        return true;
+
+    _rotating = true;
+
+    bool written = !_rotation_bom || Put( "\xEF\xBB\xBF", 3 );
+
+    if( written && !_rotation_header.empty() )
+    {
+        written = WriteRecord( _rotation_header );
+    }
+
+    _rotating = false;
+    return written;
+}
+
+
+
+
+bool CSVwrite::SetGzip( const int level, const uint64_t member_size /* = 0 */ )
+{
+    if( _error )
+        return false;
+
+    if( IsAssociated() )
+    {
+        _error = true;
+        _error_msg = "Compression can't be changed while a stream is associated. Call Close() first.";
+        return false;
+    }
+
+    if( ( level < 0 ) || ( level > 9 ) )
+    {
+        _error = true;
+        _error_msg = "The compression level must be from 0 to 9.";
+        return false;
+    }
+
+#ifndef JAY_UTIL_CSV_ZLIB
+    if( level )
+    {
+        _error = true;
+        _error_msg = "Compression is not available. Define JAY_UTIL_CSV_ZLIB and link with zlib.";
+        return false;
+    }
+#endif
+
+    _gzip_level = level;
+    _gzip_member_size = member_size;
+    return true;
+}
+
+
+// Start compressing if SetGzip() was called. Called when a stream or file descriptor is associated.
+bool CSVwrite::StartGzip()
+{
+#ifdef JAY_UTIL_CSV_ZLIB
+    if( !_gzip_level )
+        return true;
+
+    if( ( _flags & text_mode ) )
+    {
+        _error = true;
+        _error_msg = "Text mode can't be used with compression.";
+        return false;
+    }
+
+    _gzip = new gzip_state;
+    memset( &_gzip->stream, 0, sizeof _gzip->stream );
+    _gzip->member_in = 0;
+
+    // A window of 15 bits + 16 is the gzip format rather than zlib.
+    const int ret = deflateInit2( &_gzip->stream, _gzip_level, Z_DEFLATED, 15 + 16, 8,
+        Z_DEFAULT_STRATEGY );
+
+    if( ret != Z_OK )
+    {
+        delete _gzip;
+        _gzip = NULL;
+
+        ostringstream ss;
+        ss << "Failed initializing zlib, error " << ret << ".";
+
+        _error = true;
+        _error_msg = ss.str();
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+
+/* Write the buffer and finish the gzip stream, if compressing.
+
+Nothing more can be compressed after this. The gzip state isn't freed until FreeGzip().
+*/
+bool CSVwrite::EndGzip()
+{
+    if( !_gzip )
+        return true;
+
+    if( !WriteBuffer() || !Deflate( NULL, 0, Z_FINISH ) )
+        return false;
+
+    FreeGzip();
+    return true;
+}
+
+
+// Free the gzip state, whether or not the gzip stream was finished.
+void CSVwrite::FreeGzip()
+{
+#ifdef JAY_UTIL_CSV_ZLIB
+    if( _gzip )
+    {
+        deflateEnd( &_gzip->stream );
+        delete _gzip;
+        _gzip = NULL;
+    }
+#endif
+}
+
+
+/* Compress data and write the compressed data that's ready.
+
+'mode' is the zlib flush mode: Z_NO_FLUSH, or Z_SYNC_FLUSH or Z_FINISH to write all of it.
+*/
+bool CSVwrite::Deflate( const char *data, size_t size, const int mode )
+{
+#ifdef JAY_UTIL_CSV_ZLIB
+    z_stream &z = _gzip->stream;
+    _gzip->member_in += size;
+
+    for( ;; )
+    {
+        // avail_in is 32 bits, so a larger size is compressed in pieces.
+        const uInt piece = ( size < UINT_MAX ) ? (uInt)size : UINT_MAX;
+        z.next_in = (Bytef *)data;
+        z.avail_in = piece;
+        data += piece;
+        size -= piece;
+
+        const int flush = size ? Z_NO_FLUSH : mode;
+        int ret;
+
+        do
+        {
+            z.next_out = (Bytef *)_gzip->out;
+            z.avail_out = sizeof _gzip->out;
+
+            ret = deflate( &z, flush );
+            if( ret == Z_STREAM_ERROR )
+            {
+                _error = true;
+                _error_msg = "zlib failed compressing.";
+                return false;
+            }
+
+            const size_t have = sizeof _gzip->out - z.avail_out;
+            if( have && !WriteRaw( _gzip->out, have ) )
+                return false;
+
+        // All output is done once deflate() leaves room in the output buffer, except for Z_FINISH
+        // which is done when the stream ends.
+        } while( ( flush == Z_FINISH ) ? ( ret != Z_STREAM_END ) : !z.avail_out );
+
+        if( !size )
+            return true;
+    }
+#else
+    (void)data;
+    (void)size;
+    (void)mode;
+    return true;
+#endif
+}
+
+
+/* Mark the characters of a delimiter or terminator as special.
+
+Whitespace around the delimiter or terminator is trimmed by CSVread so it doesn't need quotes,
+unless that's all there is (eg a tab delimiter).
+*/
+static void mark_special( bool *special, const string &s )
+{
+    const bool blank = ( s.find_first_not_of( " \t" ) == string::npos );
+
+    for( size_t i = 0; i < s.size(); ++i )
+    {
+        if( blank || ( ( s[ i ] != ' ' ) && ( s[ i ] != '\t' ) ) )
+        {
+            special[ (unsigned char)s[ i ] ] = true;
+        }
+    }
+}
+
+
+const char *CSVwrite::FindSpecial( const char *data, const char *end )
+{
+    // The table is rebuilt if the delimiter or terminator changed since it was last built.
+    if( !_special_valid
+        || ( _special_delimiter != delimiter )
+        || ( _special_terminator != terminator )
+    )
+    {
+        memset( _special, 0, sizeof _special );
+        _special[ (unsigned char)'"' ] = true;
+        _special[ (unsigned char)'\r' ] = true;
+        _special[ (unsigned char)'\n' ] = true;
+        mark_special( _special, delimiter );
+        mark_special( _special, terminator );
+
+        _special_delimiter = delimiter;
+        _special_terminator = terminator;
+        _special_valid = true;
+    }
+
+    while( ( data != end ) && !_special[ (unsigned char)*data ] )
+    {
+        ++data;
+    }
+
+    return data;
+}
+
+
+bool CSVwrite::WriteField( const string &field, bool terminate /* = false */ )
+{
+    return WriteData( field.data(), field.size(), terminate );
+}
+
+
+bool CSVwrite::WriteField( const char *field, bool terminate /* = false */ )
+{
+    return WriteData( field, strlen( field ), terminate );
+}
+
+
+bool CSVwrite::WriteData( const char *data, size_t size, bool terminate )
+{
+    if( _error )
+        return false;
+
+    if( !IsAssociated() )
+    {
+        _error = true;
+        _error_msg = "A stream is not associated with the object.";
+        return false;
+    }
+
+    if( !_is_first_field )
+    {
+        if( !Put( delimiter.data(), delimiter.size() ) )
+            return false;
+    }
+
+    const char *const end = data + size;
+
+    // All fields are qualified with double quotes since that is what libcsv write functions do,
+    // unless minimal_quoting.
+    bool quoted = true;
+
+    if( _flags & CSVwrite::minimal_quoting )
+    {
+        /* The field is scanned only up to the first byte that needs quotes. There's no quote before
+        that byte so the run up to it is copied as is, and escaping continues from there.
+        */
+        const char *special = FindSpecial( data, end );
+
+        if( data == end )
+        {
+            quoted = _is_first_field;
+        }
+        else
+        {
+            quoted = ( special != end )
+                || ( *data == ' ' ) || ( *data == '\t' ) || ( *data == '\xEF' )
+                || ( end[ -1 ] == ' ' ) || ( end[ -1 ] == '\t' );
+        }
+
+        if( quoted && !Put( "\"", 1 ) )
+            return false;
+
+        if( !Put( data, (size_t)( special - data ) ) )
+            return false;
+
+        data = special;
+    }
+    else
+    {
+        if( !Put( "\"", 1 ) )
+            return false;
+    }
+
+    /* Quotes in the field are escaped by doubling them. Each run of the field up to and including a
+    quote is copied at once and then the quote is copied again.
+    */
+    while( data != end )
+    {
+        const char *quote = (const char *)memchr( data, '"', (size_t)( end - data ) );
+        const char *run_end = quote ? ( quote + 1 ) : end;
+
+        if( !Put( data, (size_t)( run_end - data ) ) )
+            return false;
+
+        if( quote && !Put( "\"", 1 ) )
+            return false;
+
+        data = run_end;
+    }
+
+    if( quoted && !Put( "\"", 1 ) )
+        return false;
+
+    if( terminate )
+    {
+        if( !PutTerminator() )
+            return false;
+    }
+
+    _is_first_field = terminate;
+    return true;
+}
+
+
+/* Format the digits of 'value' so that they end at 'end'.
+
+[ret] A pointer to the first digit.
+*/
+static char *format_digits( char *end, unsigned long long value )
+{
+    do
+    {
+        *--end = (char)( '0' + ( value % 10 ) );
+        value /= 10;
+    } while( value );
+
+    return end;
+}
+
+
+bool CSVwrite::WriteSigned( long long value, bool terminate )
+{
+    char text[ 24 ];
+    char *const end = text + sizeof text;
+
+    // The magnitude is computed this way so that the minimum value doesn't overflow.
+    char *p = format_digits( end,
+        ( value < 0 ) ? ( (unsigned long long)-( value + 1 ) + 1 ) : (unsigned long long)value );
+
+    if( value < 0 )
+    {
+        *--p = '-';
+    }
+
+    return WriteNumber( p, (size_t)( end - p ), terminate );
+}
+
+
+bool CSVwrite::WriteUnsigned( unsigned long long value, bool terminate )
+{
+    char text[ 24 ];
+    char *const end = text + sizeof text;
+    char *p = format_digits( end, value );
+
+    return WriteNumber( p, (size_t)( end - p ), terminate );
+}
+
+
+bool CSVwrite::WriteField( double value, bool terminate /* = false */ )
+{
+    char text[ 32 ];
+    int len = 0;
+
+    /* 17 significant digits are always enough for a double to read back the same, but usually
+    fewer are, and the shortest is what a person would write (0.1 instead of 0.10000000000000001).
+    Any decimal of up to 15 (DBL_DIG) digits reads back from a double as itself, so if the shortest
+    has 15 digits or fewer then it's the rounding to 15 digits, which %g writes without the zeros
+    that follow it. Otherwise the rounding to 16 digits is tried, and then 17 which always reads
+    back. That's at most 3 formats and 2 parses. A denormal has fewer digits of precision than
+    that, eg the smallest is 4.94065645841247e-324 to 15 digits but 5e-324 reads back the same,
+    so for those the search starts at 1 digit.
+
+    If std::to_chars() is available it gives the shortest digits directly, so their count is the
+    precision and usually there's only the one format.
+    */
+    const bool denormal = ( value != 0 ) && ( fabs( value ) < DBL_MIN );
+    int precision = ( denormal ? 1 : DBL_DIG );
+    int last = 17;
+
+#ifdef JAY_UTIL_CSV_TO_CHARS
+    if( ( value == value ) && ( value - value == 0 ) )
+    {
+        // The shortest digits in scientific notation, eg -1.2345e+67
+        const std::to_chars_result shortest =
+            std::to_chars( text, text + sizeof text, value, std::chars_format::scientific );
+
+        if( shortest.ec == std::errc() )
+        {
+            int digits = 0;
+            for( const char *p = text; ( p != shortest.ptr ) && ( *p != 'e' ); ++p )
+            {
+                digits += ( ( *p >= '0' ) && ( *p <= '9' ) );
+            }
+
+            if( digits > precision )
+            {
+                precision = digits;
+            }
+
+            /* The rounding to that many digits is as close as the shortest digits so it reads back
+            too, except maybe for a power of 2: the next double down is closer than the next one
+            up, so a rounding below it may not read back when the shortest digits above it do.
+            */
+            int exponent;
+            if( frexp( value, &exponent ) != ( ( value < 0 ) ? -0.5 : 0.5 ) )
+            {
+                last = precision;
+            }
+        }
+    }
+#endif
+
+    for( ; precision <= 17; ++precision )
+    {
+#ifdef _MSC_VER
+        len = _snprintf_s( text, sizeof text, _TRUNCATE, "%.*g", precision, value );
+#else
+        len = snprintf( text, sizeof text, "%.*g", precision, value );
+#endif
+        if( ( len <= 0 ) || ( len >= (int)sizeof text ) )
+        {
+            _error = true;
+            _error_msg = "Failed formatting a floating point number.";
+            return false;
+        }
+
+        if( ( precision >= last ) || ( value != value ) || ( strtod( text, NULL ) == value ) )
+        {
+            break;
+        }
+    }
+
+    // The decimal point of the C locale may not be a period, and it's the only other character.
+    for( int i = 0; i < len; ++i )
+    {
+        if( !strchr( "0123456789+-eEinfaINFA", text[ i ] ) )
+        {
+            text[ i ] = '.';
+        }
+    }
+
+    return WriteNumber( text, (size_t)len, terminate );
+}
+
+
+bool CSVwrite::WriteField( const Decimal &value, bool terminate /* = false */ )
+{
+    if( value.scale > 30 )
+    {
+        _error = true;
+        _error_msg = "The scale of the decimal number is more than 30.";
+        return false;
+    }
+
+    // The digits are formatted at the end of 'text', then padded with zeros so there's at least one
+    // before the decimal point, which is then inserted by moving the digits before it.
+    char text[ 56 ];
+    char *const end = text + sizeof text;
+    char *p = format_digits( end, ( value.units < 0 )
+        ? ( (unsigned long long)-( value.units + 1 ) + 1 ) : (unsigned long long)value.units );
+
+    if( value.scale )
+    {
+        while( (size_t)( end - p ) <= value.scale )
+        {
+            *--p = '0';
+        }
+
+        const size_t integer_digits = (size_t)( end - p ) - value.scale;
+        memmove( p - 1, p, integer_digits );
+        --p;
+        p[ integer_digits ] = '.';
+    }
+
+    if( value.units < 0 )
+    {
+        *--p = '-';
+    }
+
+    return WriteNumber( p, (size_t)( end - p ), terminate );
+}
+
+
+bool CSVwrite::WriteNumber( const char *text, size_t size, bool terminate )
+{
+    if( _error )
+        return false;
+
+    if( !IsAssociated() )
+    {
+        _error = true;
+        _error_msg = "A stream is not associated with the object.";
+        return false;
+    }
+
+    if( !_is_first_field )
+    {
+        if( !Put( delimiter.data(), delimiter.size() ) )
+            return false;
+    }
+
+    /* A number doesn't have whitespace, a quote, CR or LF, so in minimal_quoting mode it's only
+    quoted if it has a character of the delimiter or terminator (eg a delimiter of '.').
+    */
+    const bool quoted = !( _flags & CSVwrite::minimal_quoting )
+        || ( FindSpecial( text, text + size ) != ( text + size ) );
+
+    if( quoted && !Put( "\"", 1 ) )
+        return false;
+
+    if( !Put( text, size ) )
+        return false;
+
+    if( quoted && !Put( "\"", 1 ) )
+        return false;
+
+    if( terminate )
+    {
+        if( !PutTerminator() )
+            return false;
+    }
+
+    _is_first_field = terminate;
+    return true;
+}
+
+
+bool CSVwrite::StartRecord( const bool empty, bool &write )
+{
+    write = false;
+
+    if( _error )
+        return false;
+
+    if( !IsAssociated() )
+    {
+        _error = true;
+        _error_msg = "A stream is not associated with the object.";
         return false;
     }
 
@@ -412,7 +1499,18 @@ bool CSVwrite::WriteRecord( const vector<string> &fields, bool terminate /* = tr
         }
     }
 
-    if( !fields.size() && !(( _flags & CSVwrite::process_empty_records )) )
+    write = !empty || (( _flags & CSVwrite::process_empty_records ));
+    return true;
+}
+
+
+bool CSVwrite::WriteRecord( const vector<string> &fields, bool terminate /* = true */ )
+{
+    bool write;
+    if( !StartRecord( !fields.size(), write ) )
+        return false;
+
+    if( !write )
     {
         return true;
     }
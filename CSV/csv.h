@@ -55,6 +55,9 @@ struct csv_parser {
   void *(*malloc_func)(size_t);
   void *(*realloc_func)(void *, size_t);
   void (*free_func)(void *);
+  size_t row_end;     /* The number of characters of the input processed by csv_parse() up to the
+                         end of the last unquoted line ending, ie where the next row begins. It's
+                         only ever set, so the caller can clear it to tell if it's been set. */
 };
 
 /* Function Prototypes */
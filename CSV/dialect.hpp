@@ -0,0 +1,532 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Parsers for the common dialects, specialized at compile time.
+
+libcsv's csv_parse() loads the delimiter, the quote character and the options from the parser object
+and tests each byte against them, and calls the space and terminator functions if any are set.
+parse_dialect<>() is the same parser with the delimiter, quote character and options as template
+parameters, so each instantiation is a loop that tests bytes against constants. Also it copies a
+field that can't be passed as a slice of the input to the entry buffer in runs rather than byte by
+byte.
+
+It parses into the same csv_parser object with the same states as csv_parse(), so the two can parse
+alternate chunks of a stream and csv_fini() ends either. Its output is the same as csv_parse()'s,
+unless option dialect_raw_escapes is set.
+*/
+
+#ifndef JAY_UTIL_DIALECT_HPP_
+#define JAY_UTIL_DIALECT_HPP_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "csv.h"
+
+
+namespace jay {
+namespace util {
+
+
+// The signature of csv_parse() and parse_dialect<>().
+typedef size_t ( *parse_function )( struct csv_parser *p, const void *s, size_t len,
+    void ( *cb1 )( void *, size_t, void * ), void ( *cb2 )( int, void * ), void *data );
+
+
+/* An option of the parser object, which libcsv ignores: a quoted field that has escaped quotes is
+passed to cb1 as it is in the input, including the quotes around it, rather than unescaped. cb2 is
+called with dialect_escaped_field before that so the callbacks can tell it's escaped.
+
+Only a field that's entirely in the chunk and whose closing quote is followed by the delimiter or a
+terminator is passed escaped. Any other field is unescaped as usual, and so is every field that
+csv_parse() parses.
+*/
+const unsigned char dialect_raw_escapes = 0x80;
+const int dialect_escaped_field = -2;
+
+
+// The states of the parser. These are libcsv's and must match those in libcsv.c.
+enum
+{
+    dialect_row_not_begun = 0,
+    dialect_field_not_begun = 1,
+    dialect_field_begun = 2,
+    dialect_field_might_have_ended = 3
+};
+
+
+/* Make the entry buffer of the parser at least 'size' bytes.
+[ret][failure] (false) : The status of the parser is set.
+*/
+inline bool dialect_reserve( struct csv_parser *p, size_t size )
+{
+    if( size <= p->entry_size )
+        return true;
+
+    // The buffer at least doubles so a field that spans many chunks isn't reallocated for each.
+    size_t grown = ( p->entry_size > ( (size_t)-1 / 2 ) ) ? (size_t)-1 : ( p->entry_size * 2 );
+    if( grown < p->blk_size )
+    {
+        grown = p->blk_size;
+    }
+    if( grown < size )
+    {
+        grown = size;
+    }
+
+    void *vp = p->realloc_func( p->entry_buf, grown );
+    if( !vp )
+    {
+        p->status = CSV_ENOMEM;
+        return false;
+    }
+
+    p->entry_buf = (unsigned char *)vp;
+    p->entry_size = grown;
+    return true;
+}
+
+
+// The character classes of a dialect.
+template<unsigned char delim, unsigned char quote>
+struct dialect
+{
+    // A space or tab.
+    static bool is_blank( unsigned char c )
+    {
+        return ( c == CSV_SPACE ) | ( c == CSV_TAB );
+    }
+
+    // A space or tab that isn't the delimiter, which is skipped before a field.
+    static bool is_space( unsigned char c )
+    {
+        return is_blank( c ) & ( c != delim );
+    }
+
+    // A record terminator.
+    static bool is_term( unsigned char c )
+    {
+        return ( c == CSV_CR ) | ( c == CSV_LF );
+    }
+
+    // A character that ends a run of an unquoted field.
+    static bool ends_run( unsigned char c )
+    {
+        return ( c == delim ) | ( c == quote ) | is_term( c );
+    }
+};
+
+
+/* Parse a chunk as csv_parse() would, for a parser object set to the dialect of the template.
+
+If the parser object isn't set to the dialect, eg a space function was set or the options are
+different, then this is a call to csv_parse().
+
+The entry buffer is grown where a field begins to be copied to it, by enough for the rest of the
+chunk, so the bytes after that are copied without checking its size.
+*/
+template<unsigned char delim, unsigned char quote, unsigned char options>
+size_t parse_dialect( struct csv_parser *p, const void *s, size_t len,
+    void ( *cb1 )( void *, size_t, void * ), void ( *cb2 )( int, void * ), void *data )
+{
+    if( p->is_space || p->is_term || ( p->options != options )
+        || ( p->delim_char != delim ) || ( p->quote_char != quote )
+    )
+    {
+        return csv_parse( p, s, len, cb1, cb2, data );
+    }
+
+    typedef dialect<delim, quote> d;
+
+    const unsigned char *us = (const unsigned char *)s;
+    size_t pos = 0;
+    int quoted = p->quoted;
+    int pstate = p->pstate;
+    size_t spaces = p->spaces;
+    size_t entry_pos = p->entry_pos;
+
+    // An empty field is passed as the entry buffer so it must be allocated, like csv_parse() does.
+    if( !len || !dialect_reserve( p, ( pstate >= dialect_field_begun ) ? ( entry_pos + len ) : 1 ) )
+        return 0;
+
+    unsigned char *entry_buf = p->entry_buf;
+
+    while( pos < len )
+    {
+        unsigned char c = us[ pos++ ];
+
+        switch( pstate )
+        {
+        case dialect_row_not_begun:
+        case dialect_field_not_begun:
+            if( d::is_space( c ) )
+            {
+                continue;
+            }
+            else if( d::is_term( c ) )
+            {
+                if( pstate == dialect_field_not_begun )
+                {
+                    if( cb1 )
+                        cb1( entry_buf, 0, data );
+                    if( cb2 )
+                        cb2( c, data );
+                    pstate = dialect_row_not_begun;
+                }
+                else if( ( options & CSV_REPALL_NL ) && cb2 )
+                {
+                    cb2( c, data );
+                }
+
+                p->row_end = pos;
+            }
+            else if( c == delim )
+            {
+                if( cb1 )
+                    cb1( entry_buf, 0, data );
+                pstate = dialect_field_not_begun;
+            }
+            else if( c == quote )
+            {
+                // A quoted field that has no escaped quotes is the input up to the next quote, if
+                // it's followed by the delimiter or a terminator.
+                const unsigned char *end = (const unsigned char *)memchr( us + pos, quote, len - pos );
+                if( end && ( ( end + 1 ) < ( us + len ) )
+                    && ( ( end[ 1 ] == delim ) | d::is_term( end[ 1 ] ) )
+                )
+                {
+                    if( cb1 )
+                        cb1( (void *)( us + pos ), (size_t)( end - ( us + pos ) ), data );
+
+                    c = end[ 1 ];
+                    pos = (size_t)( end - us ) + 2;
+                    pstate = dialect_field_not_begun;
+
+                    if( c != delim )
+                    {
+                        if( cb2 )
+                            cb2( c, data );
+                        pstate = dialect_row_not_begun;
+                        p->row_end = pos;
+                    }
+
+                    continue;
+                }
+
+                // A quoted field whose quotes are all escaped, ie in pairs, is passed as it is.
+                if( options & dialect_raw_escapes )
+                {
+                    while( end && ( ( end + 1 ) < ( us + len ) ) && ( end[ 1 ] == quote ) )
+                    {
+                        end = (const unsigned char *)memchr( end + 2, quote, ( us + len ) - ( end + 2 ) );
+                    }
+
+                    if( end && ( ( end + 1 ) < ( us + len ) )
+                        && ( ( end[ 1 ] == delim ) | d::is_term( end[ 1 ] ) )
+                    )
+                    {
+                        if( cb2 )
+                            cb2( dialect_escaped_field, data );
+                        if( cb1 )
+                            cb1( (void *)( us + pos - 1 ), (size_t)( end - ( us + pos ) ) + 2, data );
+
+                        c = end[ 1 ];
+                        pos = (size_t)( end - us ) + 2;
+                        pstate = dialect_field_not_begun;
+
+                        if( c != delim )
+                        {
+                            if( cb2 )
+                                cb2( c, data );
+                            pstate = dialect_row_not_begun;
+                            p->row_end = pos;
+                        }
+
+                        continue;
+                    }
+                }
+
+                if( !dialect_reserve( p, len - pos ) )
+                {
+                    p->quoted = quoted, p->pstate = pstate, p->spaces = spaces, p->entry_pos = entry_pos;
+                    return pos - 1;
+                }
+
+                entry_buf = p->entry_buf;
+                pstate = dialect_field_begun;
+                quoted = 1;
+            }
+            else
+            {
+                // An unquoted field is the input up to the next delimiter or terminator, less
+                // trailing spaces. c is not a space so the trim stops there at the latest.
+                size_t start = pos - 1, end = pos;
+                while( ( end < len ) && !d::ends_run( us[ end ] ) )
+                {
+                    ++end;
+                }
+
+                size_t trimmed = end;
+                while( d::is_blank( us[ trimmed - 1 ] ) )
+                {
+                    --trimmed;
+                }
+
+                if( ( end < len ) && ( us[ end ] != quote ) )
+                {
+                    if( cb1 )
+                        cb1( (void *)( us + start ), trimmed - start, data );
+
+                    c = us[ end ];
+                    pos = end + 1;
+                    pstate = dialect_field_not_begun;
+
+                    if( c != delim )
+                    {
+                        if( cb2 )
+                            cb2( c, data );
+                        pstate = dialect_row_not_begun;
+                        p->row_end = pos;
+                    }
+
+                    continue;
+                }
+
+                // The field continues past the input or has a quote in it, so the part found is
+                // copied and the field goes on from there.
+                if( !dialect_reserve( p, len - start ) )
+                {
+                    p->quoted = quoted, p->pstate = pstate, p->spaces = spaces, p->entry_pos = entry_pos;
+                    return start;
+                }
+
+                entry_buf = p->entry_buf;
+                memcpy( entry_buf, us + start, end - start );
+                pstate = dialect_field_begun;
+                quoted = 0;
+                entry_pos = end - start;
+                spaces = end - trimmed;
+                pos = end;
+            }
+            break;
+
+        case dialect_field_begun:
+            if( c == quote )
+            {
+                if( quoted )
+                {
+                    entry_buf[ entry_pos++ ] = c;
+                    pstate = dialect_field_might_have_ended;
+                }
+                else
+                {
+                    // STRICT ERROR - quote inside a non-quoted field
+                    if( options & CSV_STRICT )
+                    {
+                        p->status = CSV_EPARSE;
+                        p->quoted = quoted, p->pstate = pstate, p->spaces = spaces, p->entry_pos = entry_pos;
+                        return pos - 1;
+                    }
+
+                    entry_buf[ entry_pos++ ] = c;
+                    spaces = 0;
+                }
+            }
+            else if( quoted )
+            {
+                // Everything up to the next quote is part of the field.
+                const unsigned char *end = (const unsigned char *)memchr( us + pos, quote, len - pos );
+                if( !end )
+                {
+                    end = us + len;
+                }
+
+                const size_t n = (size_t)( end - us ) - ( pos - 1 );
+                memcpy( entry_buf + entry_pos, us + pos - 1, n );
+                entry_pos += n;
+                spaces = 0;
+                pos = (size_t)( end - us );
+            }
+            else if( ( c == delim ) || d::is_term( c ) )
+            {
+                entry_pos -= spaces;
+                if( cb1 )
+                    cb1( entry_buf, entry_pos, data );
+                pstate = dialect_field_not_begun;
+                entry_pos = spaces = 0;
+
+                if( c != delim )
+                {
+                    if( cb2 )
+                        cb2( c, data );
+                    pstate = dialect_row_not_begun;
+                    p->row_end = pos;
+                }
+            }
+            else
+            {
+                // Copy the run up to the next delimiter, quote or terminator. If it's all spaces
+                // they're added to the trailing spaces before it.
+                size_t start = pos - 1, end = pos;
+                while( ( end < len ) && !d::ends_run( us[ end ] ) )
+                {
+                    ++end;
+                }
+
+                memcpy( entry_buf + entry_pos, us + start, end - start );
+                entry_pos += end - start;
+
+                size_t trimmed = end;
+                while( ( trimmed > start ) && d::is_blank( us[ trimmed - 1 ] ) )
+                {
+                    --trimmed;
+                }
+
+                spaces = ( trimmed == start ) ? ( spaces + ( end - start ) ) : ( end - trimmed );
+                pos = end;
+            }
+            break;
+
+        case dialect_field_might_have_ended:
+            // The previous character was a quote in a quoted field. The field has either ended or
+            // the quote is escaped.
+            if( ( c == delim ) || d::is_term( c ) )
+            {
+                // Drop the spaces and the quote.
+                entry_pos -= spaces + 1;
+                if( cb1 )
+                    cb1( entry_buf, entry_pos, data );
+                pstate = dialect_field_not_begun;
+                entry_pos = quoted = 0;
+                spaces = 0;
+
+                if( c != delim )
+                {
+                    if( cb2 )
+                        cb2( c, data );
+                    pstate = dialect_row_not_begun;
+                    p->row_end = pos;
+                }
+            }
+            else if( d::is_blank( c ) )
+            {
+                entry_buf[ entry_pos++ ] = c;
+                ++spaces;
+            }
+            else if( ( c == quote ) && !spaces )
+            {
+                // Two quotes in a row
+                pstate = dialect_field_begun;
+            }
+            else
+            {
+                // STRICT ERROR - unescaped quote
+                if( options & CSV_STRICT )
+                {
+                    p->status = CSV_EPARSE;
+                    p->quoted = quoted, p->pstate = pstate, p->spaces = spaces, p->entry_pos = entry_pos;
+                    return pos - 1;
+                }
+
+                // A quote after spaces is part of the field, which might still end after it.
+                if( c != quote )
+                {
+                    pstate = dialect_field_begun;
+                }
+
+                entry_buf[ entry_pos++ ] = c;
+                spaces = 0;
+            }
+            break;
+        }
+    }
+
+    p->quoted = quoted, p->pstate = pstate, p->spaces = spaces, p->entry_pos = entry_pos;
+    return pos;
+}
+
+
+// The parser for a dialect with the options 'options', or csv_parse() if there isn't one. 'raw' is
+// dialect_raw_escapes if that option is set, otherwise 0.
+template<unsigned char delim, unsigned char quote, unsigned char raw>
+parse_function dialect_options_parser( unsigned char options )
+{
+    switch( options & ~raw )
+    {
+    case 0:
+        return parse_dialect<delim, quote, raw>;
+    case CSV_REPALL_NL:
+        return parse_dialect<delim, quote, raw | CSV_REPALL_NL>;
+    case CSV_STRICT | CSV_STRICT_FINI:
+        return parse_dialect<delim, quote, raw | CSV_STRICT | CSV_STRICT_FINI>;
+    case CSV_REPALL_NL | CSV_STRICT | CSV_STRICT_FINI:
+        return parse_dialect<delim, quote, raw | CSV_REPALL_NL | CSV_STRICT | CSV_STRICT_FINI>;
+    }
+
+    return csv_parse;
+}
+
+
+// The parser for a dialect, for each setting of option dialect_raw_escapes.
+template<unsigned char delim, unsigned char quote>
+parse_function dialect_raw_parser( unsigned char options )
+{
+    if( options & dialect_raw_escapes )
+        return dialect_options_parser<delim, quote, dialect_raw_escapes>( options );
+
+    return dialect_options_parser<delim, quote, 0>( options );
+}
+
+
+/* The parser for a dialect.
+
+The delimiters comma, semicolon and tab with the double quote as the quote character, and the
+options CSVread sets with or without dialect_raw_escapes, have a parse_dialect<>() instantiation.
+Any other dialect is parsed by csv_parse().
+
+[in] 'delim' : The delimiter of the parser object.
+[in] 'quote' : The quote character of the parser object.
+[in] 'options' : The options of the parser object.
+[ret] The parser.
+*/
+inline parse_function dialect_parser( unsigned char delim, unsigned char quote, unsigned char options )
+{
+    if( quote == CSV_QUOTE )
+    {
+        switch( delim )
+        {
+        case CSV_COMMA:
+            return dialect_raw_parser<CSV_COMMA, CSV_QUOTE>( options );
+        case ';':
+            return dialect_raw_parser<';', CSV_QUOTE>( options );
+        case CSV_TAB:
+            return dialect_raw_parser<CSV_TAB, CSV_QUOTE>( options );
+        }
+    }
+
+    return csv_parse;
+}
+
+
+} // namespace util
+} // namespace jay
+#endif // JAY_UTIL_DIALECT_HPP_
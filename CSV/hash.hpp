@@ -0,0 +1,73 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef JAY_UTIL_HASH_HPP_
+#define JAY_UTIL_HASH_HPP_
+
+#include <stdint.h>
+#include <string.h>
+
+
+namespace jay {
+namespace util {
+
+
+/* Hash a run of bytes, eg the raw bytes of a field.
+
+The bytes are consumed 8 at a time and mixed with a multiply, then the result goes through the
+MurmurHash3 finalizer. It's fast for the short keys typical of CSV fields and distributes well
+enough for the power of 2 sized open addressing tables it's used with. It is not a cryptographic
+hash; don't use it on keys chosen by an attacker if that matters to you.
+*/
+inline uint64_t hash_bytes( const void *data, size_t size )
+{
+    const unsigned char *p = (const unsigned char *)data;
+    const uint64_t m = 0x9E3779B97F4A7C15ULL;
+    uint64_t h = size * m;
+
+    for( ; size >= 8; p += 8, size -= 8 )
+    {
+        uint64_t word;
+        memcpy( &word, p, 8 );
+        h = ( h ^ word ) * m;
+        h ^= h >> 32;
+    }
+
+    if( size )
+    {
+        uint64_t word = 0;
+        memcpy( &word, p, size );
+        h = ( h ^ word ) * m;
+    }
+
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+
+} // namespace util
+} // namespace jay
+#endif // JAY_UTIL_HASH_HPP_
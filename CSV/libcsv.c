@@ -23,6 +23,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #  define SIZE_MAX ((size_t)-1) /* C89 doesn't have stdint.h or SIZE_MAX */
 #endif
 
+#include <string.h>
+
 #include "csv.h"
 
 #define VERSION "3.0.3"
@@ -62,6 +64,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
   do { \
     if (cb2) \
       cb2(c, data); \
+    p->row_end = pos; \
     pstate = ROW_NOT_BEGUN; \
     entry_pos = quoted = spaces = 0; \
   } while (0)
@@ -135,6 +138,7 @@ csv_init(struct csv_parser *p, unsigned char options)
   p->malloc_func = NULL;
   p->realloc_func = realloc;
   p->free_func = free;
+  p->row_end = 0;
 
   return 0;
 }
@@ -183,7 +187,8 @@ csv_fini(struct csv_parser *p, void (*cb1)(void *, size_t, void *), void (*cb2)(
       quoted = p->quoted, pstate = p->pstate;
       spaces = p->spaces, entry_pos = p->entry_pos;
       SUBMIT_FIELD(p);
-      SUBMIT_ROW(p, -1);
+      if (cb2)
+        cb2(-1, data);
     case ROW_NOT_BEGUN: /* Already ended properly */
       ;
   }
@@ -300,6 +305,28 @@ csv_increase_buffer(struct csv_parser *p)
   p->entry_size += to_add;
   return 0;
 }
+
+static int
+csv_reserve_buffer(struct csv_parser *p, size_t size)
+{
+  /* Increase the size of the entry buffer to at least size bytes in a single
+   * allocation, for when a run of characters is copied at once.
+   */
+
+  void *vp;
+
+  if (size <= p->entry_size)
+    return 0;
+
+  if ((vp = p->realloc_func(p->entry_buf, size)) == NULL) {
+    p->status = CSV_ENOMEM;
+    return -1;
+  }
+
+  p->entry_buf = vp;
+  p->entry_size = size;
+  return 0;
+}
  
 size_t
 csv_parse(struct csv_parser *p, const void *s, size_t len, void (*cb1)(void *, size_t, void *), void (*cb2)(int c, void *), void *data)
@@ -318,6 +345,13 @@ csv_parse(struct csv_parser *p, const void *s, size_t len, void (*cb1)(void *, s
   size_t spaces = p->spaces;
   size_t entry_pos = p->entry_pos;
 
+  /* Whether fields can be passed to cb1 as slices of the input instead of being
+   * copied to entry_buf. That's only possible if the input doesn't have to be
+   * null terminated and spaces and terminators are the defaults. cb1 must not
+   * modify the field in that case, since it's the caller's input.
+   */
+  int slices = !is_space && !is_term && !(p->options & CSV_APPEND_NULL);
+
 
   if (!p->entry_buf && pos < len) {
     /* Buffer hasn't been allocated yet and len > 0 */
@@ -352,14 +386,72 @@ csv_parse(struct csv_parser *p, const void *s, size_t len, void (*cb1)(void *, s
             if (p->options & CSV_REPALL_NL) {
               SUBMIT_ROW(p, (unsigned char)c);
             }
+            p->row_end = pos;
           }
           continue;
         } else if (c == delim) { /* Comma */
           SUBMIT_FIELD(p);
           break;
         } else if (c == quote) { /* Quote */
+          if (slices) {
+            /* Fast path: A quoted field that has no escaped quotes is the input
+               up to the next quote, if it's followed by a comma or terminator */
+            const unsigned char *end = memchr(us + pos, quote, len - pos);
+            if (end && end + 1 < us + len
+                && (end[1] == delim || end[1] == CSV_CR || end[1] == CSV_LF)) {
+              if (cb1)
+                cb1((void *)(us + pos), (size_t)(end - (us + pos)), data);
+              c = end[1];
+              pos = (size_t)(end - us) + 2;
+              pstate = FIELD_NOT_BEGUN;
+              entry_pos = quoted = spaces = 0;
+              if (c != delim) {
+                SUBMIT_ROW(p, c);
+              }
+              continue;
+            }
+          }
           pstate = FIELD_BEGUN;
           quoted = 1;
+        } else if (slices) {   /* Anything else, fast path */
+          /* An unquoted field is the input up to the next comma or terminator,
+             less trailing spaces. If the field continues past the input or has a
+             quote in it then the part found is copied and the slow path goes on
+             from there. */
+          size_t start = pos - 1, end = pos, trimmed;
+
+          while (end < len && us[end] != delim && us[end] != quote
+                 && us[end] != CSV_CR && us[end] != CSV_LF)
+            end++;
+
+          /* us[start] is not a space so this stops there at the latest */
+          for (trimmed = end; us[trimmed - 1] == CSV_SPACE || us[trimmed - 1] == CSV_TAB; trimmed--)
+            ;
+
+          if (end < len && us[end] != quote) {
+            if (cb1)
+              cb1((void *)(us + start), trimmed - start, data);
+            c = us[end];
+            pos = end + 1;
+            pstate = FIELD_NOT_BEGUN;
+            entry_pos = quoted = spaces = 0;
+            if (c != delim) {
+              SUBMIT_ROW(p, c);
+            }
+            continue;
+          }
+
+          if (csv_reserve_buffer(p, end - start) != 0) {
+            p->quoted = quoted, p->pstate = pstate, p->spaces = spaces, p->entry_pos = entry_pos;
+            return start;
+          }
+
+          memcpy(p->entry_buf, us + start, end - start);
+          pstate = FIELD_BEGUN;
+          quoted = 0;
+          entry_pos = end - start;
+          spaces = end - trimmed;
+          pos = end;
         } else {               /* Anything else */
           pstate = FIELD_BEGUN;
           quoted = 0;
@@ -0,0 +1,160 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Locale independent number parsing
+*/
+
+#include "number.hpp"
+
+#include <ctype.h>
+#include <errno.h>
+#include <float.h>
+#include <locale.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+
+using namespace std;
+
+
+namespace jay {
+namespace util {
+
+
+string c_decimal_point()
+{
+    const char *const point = localeconv()->decimal_point;
+    return ( point && *point ) ? point : ".";
+}
+
+
+// A field copied for strtod() or strtof(). Most numbers fit on the stack.
+struct number_text
+{
+    char stack[ 64 ];
+    vector<char> heap;
+
+    // The copy and its null terminator.
+    char *begin;
+    char *end;
+};
+
+
+/* strtod() and strtof() need a null terminated string and use the decimal point of the C locale.
+So the field is copied with each period replaced by 'point', and a field that has 'point' when it
+isn't a period is invalid. Leading whitespace, which they skip, isn't allowed.
+
+[ret][failure] (false) : The field isn't a number.
+[ret][success] (true) : 'text' is the copy.
+*/
+static bool localize( const char *data, size_t size, const string &point, number_text &text )
+{
+    if( !size || isspace( (unsigned char)*data ) )
+        return false;
+
+    text.begin = text.stack;
+
+    if( ( ( size * point.size() ) + 1 ) > sizeof text.stack )
+    {
+        text.heap.resize( ( size * point.size() ) + 1 );
+        text.begin = &text.heap[ 0 ];
+    }
+
+    char *q = text.begin;
+    for( size_t i = 0; i < size; ++i )
+    {
+        if( data[ i ] == '.' )
+        {
+            memcpy( q, point.data(), point.size() );
+            q += point.size();
+        }
+        else if( data[ i ] == point[ 0 ] )
+        {
+            return false;
+        }
+        else
+        {
+            *q++ = data[ i ];
+        }
+    }
+    *q = '\0';
+
+    text.end = q;
+    return true;
+}
+
+
+bool parse_double( const char *data, size_t size, const string &point, double &value )
+{
+    number_text text;
+    if( !localize( data, size, point, text ) )
+        return false;
+
+    char *end;
+    errno = 0;
+    value = strtod( text.begin, &end );
+
+    return ( end == text.end )
+        && !( ( errno == ERANGE ) && ( ( value == HUGE_VAL ) || ( value == -HUGE_VAL ) ) );
+}
+
+
+bool parse_float( const char *data, size_t size, const string &point, float &value )
+{
+#if defined( _MSC_VER ) && ( _MSC_VER < 1800 )
+    /* Visual Studio 2012 and before don't have strtof(), so the number is parsed as a double and
+    rounded to a float. That rounds twice, so in the last bit it may differ from strtof().
+    */
+    double d;
+    if( !parse_double( data, size, point, d ) )
+        return false;
+
+    // A finite number is too big for a float from halfway between FLT_MAX and the next power of 2,
+    // where it would round to infinity.
+    const double limit = (double)FLT_MAX + ldexp( 1.0, FLT_MAX_EXP - FLT_MANT_DIG - 1 );
+    if( ( ( d >= limit ) && ( d != HUGE_VAL ) ) || ( ( d <= -limit ) && ( d != -HUGE_VAL ) ) )
+        return false;
+
+    value = (float)d;
+    return true;
+#else
+    // strtof() rounds the decimal straight to a float, rather than to a double and then to a float.
+    number_text text;
+    if( !localize( data, size, point, text ) )
+        return false;
+
+    char *end;
+    errno = 0;
+    value = strtof( text.begin, &end );
+
+    return ( end == text.end )
+        && !( ( errno == ERANGE ) && ( ( value == HUGE_VALF ) || ( value == -HUGE_VALF ) ) );
+#endif
+}
+
+
+} // namespace util
+} // namespace jay
@@ -0,0 +1,60 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef JAY_UTIL_NUMBER_HPP_
+#define JAY_UTIL_NUMBER_HPP_
+
+#include <stddef.h>
+
+#include <string>
+
+
+namespace jay {
+namespace util {
+
+
+/* Returns the decimal point of the C locale, eg "." or ",".
+
+localeconv() isn't cheap and isn't thread safe, so this is called once for a batch of numbers, eg
+once per CSVread::ReadStruct(), and the result passed to parse_double() and parse_float().
+*/
+std::string c_decimal_point();
+
+/* Parse the bytes of a field as a double or a float, with a period for the decimal point whatever
+the C locale's is, so that what CSVwrite writes reads back the same in any locale.
+
+The number must be the whole field, as strtod() or strtof() parses it, with no whitespace. A field
+that has the C locale's decimal point when it isn't a period is invalid. A finite number too big
+for the type is invalid; infinity and NaN are valid.
+
+[in] 'data', 'size' : The field. It doesn't need to be null terminated.
+[in] 'point' : The C locale's decimal point, from c_decimal_point().
+[ret][failure] (false) : The field isn't a number of the type.
+[ret][success] (true) : 'value' is set.
+*/
+bool parse_double( const char *data, size_t size, const std::string &point, double &value );
+bool parse_float( const char *data, size_t size, const std::string &point, float &value );
+
+
+} // namespace util
+} // namespace jay
+#endif // JAY_UTIL_NUMBER_HPP_
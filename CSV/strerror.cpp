@@ -25,6 +25,12 @@ along with jay::util. If not, see <http://www.gnu.org/licenses/>.
 
 #include "strerror.hpp"
 
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include <string.h>
+
 #include <fstream>
 #include <list>
 #include <sstream>
@@ -77,5 +83,48 @@ string ios_strerror( ios::iostate state )
 }
 
 
+string errno_strerror( int errnum )
+{
+    ostringstream ss;
+
+#ifdef _MSC_VER
+    char buf[ 256 ];
+    if( !strerror_s( buf, sizeof buf, errnum ) )
+        ss << buf;
+    else
+        ss << "Unknown error";
+#else
+    ss << strerror( errnum );
+#endif
+
+    ss << " (errno " << errnum << ")";
+    return ss.str();
+}
+
+
+#ifdef _WIN32
+string win32_strerror( unsigned long code )
+{
+    ostringstream ss;
+    char buf[ 256 ];
+
+    DWORD len = FormatMessageA( FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, NULL,
+        code, 0, buf, sizeof buf, NULL );
+
+    // The message ends in CRLF.
+    while( len && ( ( buf[ len - 1 ] == '\r' ) || ( buf[ len - 1 ] == '\n' ) ) )
+        --len;
+
+    if( len )
+        ss << string( buf, len );
+    else
+        ss << "Unknown error";
+
+    ss << " (error " << code << ")";
+    return ss.str();
+}
+#endif
+
+
 } // namespace util
 } // namespace jay
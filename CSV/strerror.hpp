@@ -34,6 +34,14 @@ namespace util {
 // Returns an iostate error message.
 std::string ios_strerror( std::ios::iostate state );
 
+// Returns an error message for an errno value, eg "No such file or directory (errno 2)".
+std::string errno_strerror( int errnum );
+
+#ifdef _WIN32
+// Returns an error message for a Windows error code from GetLastError().
+std::string win32_strerror( unsigned long code );
+#endif
+
 
 } // namespace util
 } // namespace jay
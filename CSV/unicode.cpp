@@ -0,0 +1,273 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** UTF-8 validation and UTF-16 to UTF-8 transcoding
+*/
+
+#include "unicode.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && ( _M_IX86_FP >= 2 ) )
+#define JAY_UTIL_UNICODE_SSE2
+#include <emmintrin.h>
+#endif
+
+
+using namespace std;
+
+
+namespace jay {
+namespace util {
+
+
+// Returns the number of bytes from 'p' up to the first byte that is not ASCII, or up to 'end'.
+static size_t ascii_run( const unsigned char *p, const unsigned char *end )
+{
+    const unsigned char *const start = p;
+
+#ifdef JAY_UTIL_UNICODE_SSE2
+    while( ( end - p ) >= 16 )
+    {
+        if( _mm_movemask_epi8( _mm_loadu_si128( (const __m128i *)p ) ) )
+        {
+            break;
+        }
+        p += 16;
+    }
+#endif
+
+    // A word at a time. The high bit of any byte being set means that byte is not ASCII.
+    const size_t high_bits = ( ~(size_t)0 / 0xFF ) * 0x80;
+
+    while( ( end - p ) >= (ptrdiff_t)sizeof( size_t ) )
+    {
+        size_t word;
+        memcpy( &word, p, sizeof word );
+        if( word & high_bits )
+        {
+            break;
+        }
+        p += sizeof word;
+    }
+
+    while( ( p != end ) && ( *p < 0x80 ) )
+    {
+        ++p;
+    }
+
+    return (size_t)( p - start );
+}
+
+
+size_t utf8_invalid_offset( const char *data, size_t size )
+{
+    const unsigned char *const begin = (const unsigned char *)data;
+    const unsigned char *const end = begin + size;
+    const unsigned char *p = begin;
+
+    for( ;; )
+    {
+        p += ascii_run( p, end );
+        if( p == end )
+        {
+            return size;
+        }
+
+        // Well-formed byte sequences per table 3-7 of the Unicode Standard.
+        const unsigned char c = *p;
+        unsigned char lo = 0x80, hi = 0xBF;
+        size_t trail;
+
+        if( ( c >= 0xC2 ) && ( c <= 0xDF ) )
+        {
+            trail = 1;
+        }
+        else if( ( c >= 0xE0 ) && ( c <= 0xEF ) )
+        {
+            trail = 2;
+            if( c == 0xE0 )
+                lo = 0xA0;
+            else if( c == 0xED )
+                hi = 0x9F;
+        }
+        else if( ( c >= 0xF0 ) && ( c <= 0xF4 ) )
+        {
+            trail = 3;
+            if( c == 0xF0 )
+                lo = 0x90;
+            else if( c == 0xF4 )
+                hi = 0x8F;
+        }
+        else
+        {
+            return (size_t)( p - begin );
+        }
+
+        if( (size_t)( end - p ) <= trail )
+        {
+            return (size_t)( p - begin );
+        }
+
+        if( ( p[ 1 ] < lo ) || ( p[ 1 ] > hi ) )
+        {
+            return (size_t)( p - begin );
+        }
+
+        for( size_t i = 2; i <= trail; ++i )
+        {
+            if( ( p[ i ] & 0xC0 ) != 0x80 )
+            {
+                return (size_t)( p - begin );
+            }
+        }
+
+        p += trail + 1;
+    }
+}
+
+
+void utf16_transcoder::Reset( bool big_endian )
+{
+    error_offset = 0;
+    _big_endian = big_endian;
+    _have_byte = false;
+    _byte = 0;
+    _high_surrogate = 0;
+    _offset = 0;
+}
+
+
+bool utf16_transcoder::Put( unsigned unit, char *&q )
+{
+    if( _high_surrogate )
+    {
+        if( ( unit < 0xDC00 ) || ( unit > 0xDFFF ) )
+        {
+            error_offset = _offset - 2;
+            return false;
+        }
+
+        unsigned cp = 0x10000 + ( ( _high_surrogate - 0xD800 ) << 10 ) + ( unit - 0xDC00 );
+        _high_surrogate = 0;
+
+        *q++ = (char)( 0xF0 | ( cp >> 18 ) );
+        *q++ = (char)( 0x80 | ( ( cp >> 12 ) & 0x3F ) );
+        *q++ = (char)( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+        *q++ = (char)( 0x80 | ( cp & 0x3F ) );
+    }
+    else if( unit < 0x80 )
+    {
+        *q++ = (char)unit;
+    }
+    else if( unit < 0x800 )
+    {
+        *q++ = (char)( 0xC0 | ( unit >> 6 ) );
+        *q++ = (char)( 0x80 | ( unit & 0x3F ) );
+    }
+    else if( ( unit >= 0xD800 ) && ( unit <= 0xDBFF ) )
+    {
+        _high_surrogate = unit;
+    }
+    else if( ( unit >= 0xDC00 ) && ( unit <= 0xDFFF ) )
+    {
+        error_offset = _offset;
+        return false;
+    }
+    else
+    {
+        *q++ = (char)( 0xE0 | ( unit >> 12 ) );
+        *q++ = (char)( 0x80 | ( ( unit >> 6 ) & 0x3F ) );
+        *q++ = (char)( 0x80 | ( unit & 0x3F ) );
+    }
+
+    _offset += 2;
+    return true;
+}
+
+
+bool utf16_transcoder::Transcode( const char *data, size_t size, string &out )
+{
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *const end = p + size;
+
+    if( !size )
+    {
+        return true;
+    }
+
+    /* Each code unit is at most 3 bytes of UTF-8, and a surrogate pair is 4 bytes for 2 units. The
+    extra 4 bytes are for a code unit completed by this chunk or a pair started by the last chunk.
+    */
+    const size_t start = out.size();
+    out.resize( start + ( ( size / 2 ) * 3 ) + 4 );
+    char *q = &out[ start ];
+
+    const int hi = _big_endian ? 0 : 1;
+    const int lo = _big_endian ? 1 : 0;
+
+    if( _have_byte )
+    {
+        unsigned char unit_bytes[ 2 ] = { _byte, *p++ };
+        _have_byte = false;
+
+        if( !Put( ( (unsigned)unit_bytes[ hi ] << 8 ) | unit_bytes[ lo ], q ) )
+        {
+            out.resize( start );
+            return false;
+        }
+    }
+
+    while( ( end - p ) >= 2 )
+    {
+        // ASCII is by far the most common in CSV so it's handled inline.
+        if( !p[ hi ] && ( p[ lo ] < 0x80 ) && !_high_surrogate )
+        {
+            *q++ = (char)p[ lo ];
+            _offset += 2;
+        }
+        else if( !Put( ( (unsigned)p[ hi ] << 8 ) | p[ lo ], q ) )
+        {
+            out.resize( start );
+            return false;
+        }
+
+        p += 2;
+    }
+
+    if( p != end )
+    {
+        _have_byte = true;
+        _byte = *p;
+    }
+
+    out.resize( (size_t)( q - &out[ 0 ] ) );
+    return true;
+}
+
+
+} // namespace util
+} // namespace jay
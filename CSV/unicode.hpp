@@ -0,0 +1,95 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef JAY_UTIL_UNICODE_HPP_
+#define JAY_UTIL_UNICODE_HPP_
+
+#include <stdint.h>
+
+#include <string>
+
+
+namespace jay {
+namespace util {
+
+
+/* Validate UTF-8.
+
+Runs of ASCII are skipped a block at a time (SSE2 when the compiler targets it, otherwise a machine
+word at a time) and only the multibyte sequences are decoded. Overlong encodings, surrogates, code
+points > U+10FFFF and truncated sequences are invalid.
+
+[ret] The byte offset of the first invalid sequence, or 'size' if all of 'data' is valid UTF-8.
+*/
+size_t utf8_invalid_offset( const char *data, size_t size );
+
+
+/* Transcode a UTF-16 stream to UTF-8.
+
+The stream may be passed in chunks of any size, including odd sizes and chunks that split a
+surrogate pair; the incomplete code unit or pair is held until the next call.
+*/
+class utf16_transcoder
+{
+public:
+    utf16_transcoder() { Reset( false ); }
+
+    // Start a new stream. 'big_endian' is the byte order of the stream's code units.
+    void Reset( bool big_endian );
+
+    /* Transcode a chunk and append the UTF-8 to 'out'.
+
+    [ret][failure] (false) : There is an unpaired surrogate in the stream. 'error_offset' is set.
+    [ret][success] (true)
+    */
+    bool Transcode( const char *data, size_t size, std::string &out );
+
+    // The byte order of the stream's code units.
+    bool big_endian() const { return _big_endian; }
+
+    // Returns false if the stream ended in the middle of a code unit or surrogate pair.
+    bool Complete() const { return !_have_byte && !_high_surrogate; }
+
+    // The byte offset in the stream of the code unit in error.
+    uintmax_t error_offset;
+
+private:
+    // Append the UTF-8 for a code unit at 'q'. Returns false on an unpaired surrogate.
+    bool Put( unsigned unit, char *&q );
+
+    bool _big_endian;
+
+    // The first byte of a code unit split between chunks.
+    bool _have_byte;
+    unsigned char _byte;
+
+    // A high surrogate waiting for its low surrogate, or 0.
+    unsigned _high_surrogate;
+
+    // The number of bytes of the stream transcoded so far.
+    uintmax_t _offset;
+};
+
+
+} // namespace util
+} // namespace jay
+#endif // JAY_UTIL_UNICODE_HPP_
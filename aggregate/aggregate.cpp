@@ -0,0 +1,445 @@
+/*
+Copyright (C) 2014 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of aggregate/CSV/jay::util.
+
+https://github.com/jay/CSV
+
+jay::util is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+jay::util is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with jay::util. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Group-by aggregation of a CSV file, and a benchmark of CSVaggregate.
+
+Usage: aggregate [-d <delimiter>] [-s] [-H] <file> <key column> <value column>
+       aggregate -b [<records> [<threads>]]
+
+The first form writes one record per distinct key to stdout:
+key,count,numbers,sum,min,max,mean
+
+Columns are numbered from 1. If -H is passed the first record is a header and a column may be given
+by its name instead. -s sniffs the delimiter and quote character. -d sets the delimiter, eg -d ;
+
+The second form generates CSV data in memory and compares the time taken to aggregate it by a
+hand-written std::map loop, by CSVaggregate, and by CSVaggregate in several threads whose partial
+results are merged. The default is 1000000 records and 4 threads. It then compares the time taken to
+write as many random doubles by CSVwrite::WriteField( double ), which writes the shortest digits
+that read back the same, and by formatting them to 17 digits with std::ostringstream.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CSV.hpp"
+
+
+using namespace std;
+using namespace jay::util;
+
+
+static void usage()
+{
+    cerr << "Usage: aggregate [-d <delimiter>] [-s] [-H] <file> <key column> <value column>" << endl
+        << "       aggregate -b [<records> [<threads>]]" << endl;
+    exit( 1 );
+}
+
+
+// Resolve a column given on the command line, either a number from 1 or a header name.
+static bool resolve_column( const string &arg, const vector<string> &header, size_t &column )
+{
+    vector<string>::const_iterator it = find( header.begin(), header.end(), arg );
+    if( it != header.end() )
+    {
+        column = (size_t)( it - header.begin() );
+        return true;
+    }
+
+    char *end;
+    unsigned long n = strtoul( arg.c_str(), &end, 10 );
+    if( arg.empty() || *end || !n )
+    {
+        return false;
+    }
+
+    column = n - 1;
+    return true;
+}
+
+
+static int aggregate( int argc, char *argv[] )
+{
+    CSVread::Flags flags = CSVread::none;
+    bool has_header = false;
+    unsigned char delimiter = ',';
+    int i = 1;
+
+    for( ; ( i < argc ) && ( argv[ i ][ 0 ] == '-' ) && argv[ i ][ 1 ]; ++i )
+    {
+        const string opt = argv[ i ];
+
+        if( ( opt == "-d" ) && ( ( i + 1 ) < argc ) && ( strlen( argv[ i + 1 ] ) == 1 ) )
+            delimiter = (unsigned char)argv[ ++i ][ 0 ];
+        else if( opt == "-s" )
+            flags |= CSVread::sniff_dialect;
+        else if( opt == "-H" )
+            has_header = true;
+        else
+            usage();
+    }
+
+    if( ( argc - i ) != 3 )
+    {
+        usage();
+    }
+
+    CSVread csv;
+    csv.SetDelimiter( delimiter );
+    if( !csv.Open( argv[ i ], flags ) )
+    {
+        cerr << "CSVread failed: " << csv.error_msg << endl;
+        return 1;
+    }
+
+    vector<string> header;
+    if( has_header && csv.ReadRecord() )
+    {
+        csv.ReleaseFields( header );
+    }
+
+    size_t key_column, value_column;
+    if( !resolve_column( argv[ i + 1 ], header, key_column ) )
+    {
+        cerr << "Unknown key column: " << argv[ i + 1 ] << endl;
+        return 1;
+    }
+    if( !resolve_column( argv[ i + 2 ], header, value_column ) )
+    {
+        cerr << "Unknown value column: " << argv[ i + 2 ] << endl;
+        return 1;
+    }
+
+    CSVaggregate agg( key_column, value_column );
+    if( !agg.Consume( csv ) )
+    {
+        cerr << "Error: " << csv.error_msg << endl;
+        return 1;
+    }
+
+    if( agg.skipped )
+    {
+        cerr << "WARNING: " << agg.skipped << " records were missing the key or value column."
+            << endl;
+    }
+
+    // The groups are written in order of key.
+    vector<pair<string, uint32_t>> order;
+    for( uint32_t g = 0; g < agg.size(); ++g )
+    {
+        order.push_back( make_pair( agg.Key( g ), g ) );
+    }
+    sort( order.begin(), order.end() );
+
+    CSVwrite out( &cout );
+    vector<string> record;
+    record.push_back( "key" );
+    record.push_back( "count" );
+    record.push_back( "numbers" );
+    record.push_back( "sum" );
+    record.push_back( "min" );
+    record.push_back( "max" );
+    record.push_back( "mean" );
+    out.WriteRecord( record );
+
+    for( size_t g = 0; g < order.size(); ++g )
+    {
+        const CSVaggregate::Group &group = agg[ order[ g ].second ];
+
+        out.WriteField( order[ g ].first );
+        out.WriteField( group.count );
+        out.WriteField( group.numbers );
+
+        // A group without numbers has no sum, min, max or mean.
+        if( !group.numbers )
+        {
+            for( int i = 0; i < 4; ++i )
+            {
+                out.WriteField( "", ( i == 3 ) );
+            }
+            continue;
+        }
+
+        if( group.integral )
+            out.WriteField( group.int_sum );
+        else
+            out.WriteField( group.sum );
+
+        out.WriteField( group.min );
+        out.WriteField( group.max );
+        out.WriteField( group.sum / group.numbers, true );
+    }
+
+    if( !out.Flush() )
+    {
+        cerr << "CSVwrite failed: " << out.error_msg << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+
+/* Generate 'records' records of 4 columns: id,key,value,comment
+
+There are 750 distinct keys, skewed so that the lower numbered keys are much more common than the
+higher. The values are integers, except every 8th which has 2 decimal places.
+*/
+static string generate( uintmax_t records, uint32_t seed )
+{
+    ostringstream ss;
+    CSVwrite csv( &ss );
+    vector<string> record( 4 );
+    uint32_t x = seed | 1;
+
+    for( uintmax_t n = 0; n < records; ++n )
+    {
+        // xorshift32
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+
+        ostringstream id, key, value;
+        id << n;
+        key << "key" << ( ( x % 1000 ) * ( x % 1000 ) / 1000 );
+        if( n % 8 )
+            value << (int)( x % 20001 ) - 10000;
+        else
+            value << ( x % 100000 ) / 100 << "." << setw( 2 ) << setfill( '0' ) << x % 100;
+
+        record[ 0 ] = id.str();
+        record[ 1 ] = key.str();
+        record[ 2 ] = value.str();
+        record[ 3 ] = "the quick brown fox";
+        csv.WriteRecord( record );
+    }
+
+    csv.Flush();
+    return ss.str();
+}
+
+
+// The loop CSVaggregate replaces.
+struct MapGroup
+{
+    MapGroup() : count( 0 ), sum( 0 ), min( 0 ), max( 0 ) {}
+    uintmax_t count;
+    double sum, min, max;
+};
+
+static size_t map_aggregate( const string &data )
+{
+    istringstream ss( data );
+    CSVread csv( &ss );
+    map<string, MapGroup> groups;
+
+    while( csv.ReadRecord() )
+    {
+        MapGroup &group = groups[ csv.fields[ 1 ] ];
+        double value = strtod( csv.fields[ 2 ].c_str(), NULL );
+        if( !group.count || ( value < group.min ) )
+            group.min = value;
+        if( !group.count || ( value > group.max ) )
+            group.max = value;
+        group.sum += value;
+        ++group.count;
+    }
+
+    return groups.size();
+}
+
+
+static void csv_aggregate( const string *data, CSVaggregate *agg )
+{
+    istringstream ss( *data );
+    CSVread csv( &ss );
+    agg->Consume( csv );
+}
+
+
+static double seconds_since( chrono::steady_clock::time_point start )
+{
+    return chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+}
+
+
+// 'groups' is 0 if there are none to report.
+static void report( const char *name, uintmax_t records, double seconds, size_t groups )
+{
+    cout << setw( 24 ) << left << name << right
+        << fixed << setprecision( 3 ) << setw( 8 ) << seconds << " s  "
+        << setw( 12 ) << (uintmax_t)( records / seconds ) << " records/s";
+    if( groups )
+        cout << "  " << groups << " groups";
+    cout << endl;
+}
+
+
+/* Write 'records' random doubles with CSVwrite::WriteField( double ) and then with ostringstream to
+17 digits and WriteField( string ). The doubles are from random bits so most need 16 or 17 digits.
+*/
+static void write_benchmark( uintmax_t records )
+{
+    vector<double> values( (size_t)records );
+    uint64_t x = 88172645463325252ULL;
+    for( size_t n = 0; n < values.size(); ++n )
+    {
+        // xorshift64, with the exponents of infinity and NaN skipped.
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        uint64_t bits = x;
+        if( ( ( bits >> 52 ) & 0x7FF ) == 0x7FF )
+            bits &= ~( (uint64_t)1 << 62 );
+        memcpy( &values[ n ], &bits, sizeof bits );
+    }
+
+    ostringstream shortest_out;
+    CSVwrite shortest( &shortest_out );
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for( size_t n = 0; n < values.size(); ++n )
+    {
+        shortest.WriteField( values[ n ], true );
+    }
+    shortest.Flush();
+    report( "WriteField( double )", records, seconds_since( start ), 0 );
+
+    ostringstream stream_out;
+    CSVwrite stream( &stream_out );
+    start = chrono::steady_clock::now();
+    for( size_t n = 0; n < values.size(); ++n )
+    {
+        ostringstream ss;
+        ss << setprecision( 17 ) << values[ n ];
+        stream.WriteField( ss.str(), true );
+    }
+    stream.Flush();
+    report( "ostringstream 17 digits", records, seconds_since( start ), 0 );
+
+    cout << shortest_out.str().size() << " bytes shortest, " << stream_out.str().size()
+        << " bytes 17 digits" << endl;
+}
+
+
+static int benchmark( uintmax_t records, unsigned threads )
+{
+    cout << "Generating " << records << " records in " << threads << " parts..." << endl;
+
+    vector<string> parts( threads );
+    uintmax_t bytes = 0;
+    for( unsigned t = 0; t < threads; ++t )
+    {
+        parts[ t ] = generate( ( records / threads ) + ( t < ( records % threads ) ), t + 1 );
+        bytes += parts[ t ].size();
+    }
+
+    string all;
+    all.reserve( (size_t)bytes );
+    for( unsigned t = 0; t < threads; ++t )
+    {
+        all += parts[ t ];
+    }
+
+    cout << bytes << " bytes" << endl;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t map_groups = map_aggregate( all );
+    report( "std::map", records, seconds_since( start ), map_groups );
+
+    start = chrono::steady_clock::now();
+    CSVaggregate single( 1, 2 );
+    csv_aggregate( &all, &single );
+    report( "CSVaggregate", records, seconds_since( start ), single.size() );
+
+    start = chrono::steady_clock::now();
+    vector<CSVaggregate *> partial;
+    vector<thread> pool;
+    for( unsigned t = 0; t < threads; ++t )
+    {
+        partial.push_back( new CSVaggregate( 1, 2 ) );
+        pool.push_back( thread( csv_aggregate, &parts[ t ], partial.back() ) );
+    }
+    CSVaggregate merged( 1, 2 );
+    for( unsigned t = 0; t < threads; ++t )
+    {
+        pool[ t ].join();
+        merged.Merge( *partial[ t ] );
+        delete partial[ t ];
+    }
+    ostringstream name;
+    name << "CSVaggregate x" << threads;
+    report( name.str().c_str(), records, seconds_since( start ), merged.size() );
+
+    // The merged results must be the same as the single threaded results.
+    bool same = ( merged.size() == single.size() ) && ( merged.size() == map_groups );
+    for( uint32_t g = 0; same && ( g < single.size() ); ++g )
+    {
+        const CSVaggregate::Group *group = merged.Find( single.Key( g ) );
+        same = group
+            && ( group->count == single[ g ].count )
+            && ( group->min == single[ g ].min )
+            && ( group->max == single[ g ].max );
+    }
+
+    if( !same )
+    {
+        cerr << "Error: merged results differ from single threaded results." << endl;
+        return 1;
+    }
+
+    cout << "Writing " << records << " doubles..." << endl;
+    write_benchmark( records );
+
+    return 0;
+}
+
+
+
+int main( int argc, char *argv[] )
+{
+    if( ( argc >= 2 ) && !strcmp( argv[ 1 ], "-b" ) )
+    {
+        uintmax_t records = ( argc >= 3 ) ? strtoul( argv[ 2 ], NULL, 10 ) : 1000000;
+        unsigned threads = ( argc >= 4 ) ? (unsigned)strtoul( argv[ 3 ], NULL, 10 ) : 4;
+        if( !records || !threads || ( argc > 4 ) )
+        {
+            usage();
+        }
+
+        return benchmark( records, threads );
+    }
+
+    return aggregate( argc, argv );
+}
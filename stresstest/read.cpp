@@ -25,22 +25,105 @@ along with jay::util. If not, see <http://www.gnu.org/licenses/>.
 
 #include "read.hpp"
 
+#include <limits.h>
+#include <locale.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#ifdef STRESSTEST_THREADS
+#include <atomic>
+#endif
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <list>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "util.hpp"
 
 #include "CSV.hpp"
+#ifdef STRESSTEST_THREADS
+#include "CSVdistribute.hpp"
+#endif
+#include "csv.h"
 #include "strerror.hpp"
 
 
 using namespace std;
 
 
+// A space function for libcsv that's the same as its default.
+static int libcsv_is_space( unsigned char c )
+{
+    return ( c == CSV_SPACE ) || ( c == CSV_TAB );
+}
+
+
+// Unescape the fields of the current record that are still escaped, if flag 'lazy_unescape', and copy
+// the interned fields from the dictionary.
+static void unescape_fields( jay::util::CSVread &csv_read )
+{
+    for( size_t i = 0; i < csv_read.fields.size(); ++i )
+    {
+        csv_read.Field( i );
+    }
+}
+
+
+// A record read with CSVread::ReadStruct(): the first field of a random record.
+struct first_field
+{
+    string first;
+};
+
+namespace jay {
+namespace util {
+template<> struct CSVfields<first_field>
+{
+    static void Visit( first_field &record, CSVread::FieldReader &field )
+    {
+        field( record.first );
+    }
+};
+} // namespace util
+} // namespace jay
+
+
+// A record read with CSVread::ReadStruct() by the names of its members, of each type it converts.
+struct typed_record
+{
+    string text;
+    int integer;
+    unsigned long long big;
+    double real;
+    float single;
+};
+
+namespace jay {
+namespace util {
+template<> struct CSVfields<typed_record>
+{
+    template< class Record, class Field >
+    static void Visit( Record &record, Field &field )
+    {
+        field( record.text, "text" );
+        field( record.integer, "integer" );
+        field( record.big, "big" );
+        field( record.real, "real" );
+        field( record.single, "single" );
+    }
+};
+} // namespace util
+} // namespace jay
+
+
 // no CSVread::Close() on fail
 bool read_records(
     const char *filename,
@@ -78,6 +161,13 @@ bool read_records(
         flags |= jay::util::CSVread::strict_mode;
     }
 
+    // Maybe unescape quoted fields only when they're accessed.
+    bool lazy_unescape = getrand<bool>();
+    if( lazy_unescape )
+    {
+        flags |= jay::util::CSVread::lazy_unescape;
+    }
+
     bool use_flags = ( flags != jay::util::CSVread::none ) || getrand<bool>();
 
     if( use_association )
@@ -132,9 +222,66 @@ bool read_records(
             "Problem resizing buffer: " << csv_read.error_msg );
     }
 
+    // Maybe have libcsv parse the rest of the stream rather than the parser for the dialect, which
+    // parsed the first chunk. Setting a space function makes CSVread fall back to libcsv.
+    bool use_libcsv = getrand<bool>();
+    if( use_libcsv )
+    {
+        csv_set_space_func( csv_read.parse_obj, libcsv_is_space );
+    }
+
     bool use_sequential_read = getrand<bool>();
-    if( use_sequential_read )
+    if( use_sequential_read && getrand<bool>() )
+    {
+        // Maybe intern a column, whose fields the iterator must copy from the dictionary.
+        bool use_interning = getrand<bool>();
+        size_t interned_column = getrand<size_t>( 0, 3 );
+        if( use_interning )
+        {
+            csv_read.SetInterned( interned_column );
+        }
+
+        // Sequential access through the iterator, moving each record out of the object.
+        jay::util::CSVread::iterator it = csv_read.begin();
+
+        for( ; it != csv_read.end(); ++it )
+        {
+            DEBUG_IF( ( csv_read.error ),
+                "Iterator acccess: csv_read.error is set on a valid iterator: " << csv_read.error_msg );
+
+            // The iterator unescapes the fields and copies the interned fields itself, so the record
+            // is moved out before anything else accesses it.
+            records.push_back( std::move( *it ) );
+
+            DEBUG_IF( ( &*it != &csv_read.fields ),
+                "Iterator acccess: The iterator does not refer to csv_read.fields." );
+        }
+
+        if( use_interning )
+        {
+            csv_read.SetInterned( interned_column, false );
+        }
+
+        DEBUG_IF( ( !csv_read.error ),
+            "Iterator acccess: Logic mismatch, iteration ended but csv_read.error is not set." );
+
+        DEBUG_IF( ( !csv_read.eof
+                || ( csv_read.record_num != csv_read.end_record_num )
+                || ( expected_records_count != csv_read.end_record_num ) ),
+            "Iterator acccess: End record unknown." );
+    }
+    else if( use_sequential_read )
     {
+        bool use_release_fields = getrand<bool>();
+
+        // Maybe intern a column. The dictionary is persistent so it may have codes from before.
+        bool use_interning = getrand<bool>();
+        size_t interned_column = getrand<size_t>( 0, 3 );
+        if( use_interning )
+        {
+            csv_read.SetInterned( interned_column );
+        }
+
         for( ;; )
         {
             b = csv_read.ReadRecord();
@@ -148,7 +295,48 @@ bool read_records(
                 break;
             }
 
-            records.push_back( csv_read.fields );
+            if( use_interning )
+            {
+                DEBUG_IF( ( csv_read.codes.size() != csv_read.fields.size() ),
+                    "Sequential acccess: csv_read.codes.size() != csv_read.fields.size()" );
+
+                for( size_t i = 0; i < csv_read.codes.size(); ++i )
+                {
+                    DEBUG_IF( ( ( i == interned_column )
+                            != ( csv_read.codes[ i ] != jay::util::CSVdictionary::no_code ) ),
+                        "Sequential acccess: Field #" << ( i + 1 ) << " has an unexpected code." );
+
+                    DEBUG_IF( ( ( i == interned_column )
+                            && ( csv_read.dictionary[ csv_read.codes[ i ] ] != csv_read.Field( i ) ) ),
+                        "Sequential acccess: Interned field #" << ( i + 1 ) << " != the field." );
+                }
+
+                // Maybe clear the dictionary, which copies the interned fields of the current record
+                // and those in the cache out of it.
+                if( !getrand<int>( 0, 15 ) )
+                {
+                    csv_read.ClearDictionary();
+                }
+            }
+
+            if( use_release_fields )
+            {
+                records.push_back( vector<string>() );
+                csv_read.ReleaseFields( records.back() );
+
+                DEBUG_IF( ( csv_read.fields.size() ),
+                    "Sequential acccess: csv_read.fields is not empty after ReleaseFields()." );
+            }
+            else
+            {
+                unescape_fields( csv_read );
+                records.push_back( csv_read.fields );
+            }
+        }
+
+        if( use_interning )
+        {
+            csv_read.SetInterned( interned_column, false );
         }
 
         DEBUG_IF( ( !csv_read.eof
@@ -184,6 +372,7 @@ bool read_records(
             DEBUG_IF( ( !b ),
                 "Random access: Failed to read record " << indexes[ i ] << "." );
 
+            unescape_fields( csv_read );
             tmprec[ indexes[ i ] - 1 ] = csv_read.fields;
         }
 
@@ -206,3 +395,1291 @@ bool read_records(
 
     return true;
 }
+
+
+// Build a cache of the file and compare its records to those read by read_records().
+bool read_cache(
+    const char *filename,
+    const bool process_empty,
+    const char delimiter,
+    const list<vector<string>> &records
+)
+{
+    bool b = false;
+
+    const string cache_filename = string( filename ) + ".cache";
+
+    jay::util::CSVread csv_read;
+    csv_read.SetDelimiter( delimiter );
+
+    // Maybe unescape quoted fields only when they're accessed.
+    jay::util::CSVread::Flags flags = getrand<bool>() ?
+        jay::util::CSVread::lazy_unescape : jay::util::CSVread::none;
+    if( process_empty )
+    {
+        flags |= jay::util::CSVread::process_empty_records;
+    }
+
+    b = csv_read.Open( filename, flags );
+
+    DEBUG_IF( ( !b ),
+        "Problem opening file " << filename << ": " << csv_read.error_msg );
+
+    jay::util::CSVcache cache;
+
+    b = cache.Build( csv_read, cache_filename, filename );
+
+    DEBUG_IF( ( b == cache.error ),
+        "Logic mismatch on cache.Build(). b: " << b << ", cache.error: " << cache.error );
+
+    DEBUG_IF( ( !b ),
+        "Problem building cache: " << cache.error_msg );
+
+    b = cache.Open( cache_filename, filename );
+
+    DEBUG_IF( ( !b ),
+        "Problem opening cache: " << cache.error_msg );
+
+    DEBUG_IF( ( cache.end_record_num != records.size() ),
+        "Cache: end_record_num " << cache.end_record_num << " != " << records.size() << " records." );
+
+    /* Maybe rebuild the cache file from one record while it's open. The open cache must still read
+    the records it was opened with. In Windows the cache file can't be replaced while it's open.
+    */
+    bool use_rebuild = getrand<bool>();
+    bool rebuilt = false;
+    if( use_rebuild )
+    {
+        istringstream one_record( "rebuilt\n" );
+        jay::util::CSVread rebuild_read( &one_record );
+        jay::util::CSVcache rebuild;
+        rebuilt = rebuild.Build( rebuild_read, cache_filename );
+
+#ifndef _WIN32
+        DEBUG_IF( ( !rebuilt ),
+            "Cache: Problem rebuilding the open cache: " << rebuild.error_msg );
+#endif
+    }
+
+    bool use_random_access = getrand<bool>();
+    size_t n = 0;
+    for( list<vector<string>>::const_iterator it = records.begin(); it != records.end(); ++it )
+    {
+        ++n;
+
+        if( use_random_access )
+        {
+            // Compare each field read directly from the map, without ReadRecord().
+            for( size_t i = 0; i <= it->size(); ++i )
+            {
+                const char *data;
+                size_t size;
+                b = cache.GetField( n, i, data, size );
+
+                DEBUG_IF( ( b != ( i < it->size() ) ),
+                    "Cache: GetField() of record #" << n << " field #" << ( i + 1 ) << " returned " << b );
+
+                DEBUG_IF( ( b && ( string( data, size ) != ( *it )[ i ] ) ),
+                    "Cache: Record #" << n << " field #" << ( i + 1 ) << " differs." );
+            }
+            continue;
+        }
+
+        b = cache.ReadRecord();
+
+        DEBUG_IF( ( !b ),
+            "Cache: Failed to read record " << n << ": " << cache.error_msg );
+
+        DEBUG_IF( ( cache.fields != *it ),
+            "Cache: Record #" << n << " differs." );
+    }
+
+    if( !use_random_access )
+    {
+        b = cache.ReadRecord();
+
+        DEBUG_IF( ( b || !cache.eof || cache.error ),
+            "Cache: More records than expected, or no EOF." );
+    }
+
+    cache.Close();
+
+    if( rebuilt )
+    {
+        b = cache.Open( cache_filename ) && cache.ReadRecord();
+
+        DEBUG_IF( ( !b || ( cache.end_record_num != 1 ) || ( cache.fields.size() != 1 )
+                || ( cache.fields[ 0 ] != "rebuilt" ) ),
+            "Cache: The rebuilt cache differs: " << cache.error_msg );
+
+        cache.Close();
+    }
+
+    remove( cache_filename.c_str() );
+
+    return true;
+}
+
+
+// Read the file with flag error_on_null_in_field, which should fail at the first null byte.
+bool read_null_check(
+    const char *filename,
+    const bool process_empty,
+    const char delimiter,
+    const list<vector<string>> &records
+)
+{
+    // Find the first null byte in the records read by read_records().
+    ostringstream expected;
+    size_t n = 0;
+    for( list<vector<string>>::const_iterator it = records.begin();
+        ( it != records.end() ) && expected.str().empty();
+        ++it )
+    {
+        ++n;
+        for( size_t i = 0; i < it->size(); ++i )
+        {
+            size_t offset = ( *it )[ i ].find( '\0' );
+            if( offset != string::npos )
+            {
+                expected << "Record #" << n << " Field #" << ( i + 1 )
+                    << " is invalid due to NULL byte at byte offset " << offset << " in field.";
+                break;
+            }
+        }
+    }
+
+    jay::util::CSVread csv_read;
+    csv_read.SetDelimiter( delimiter );
+
+    jay::util::CSVread::Flags flags = jay::util::CSVread::error_on_null_in_field;
+    if( process_empty )
+    {
+        flags |= jay::util::CSVread::process_empty_records;
+    }
+
+    bool b = csv_read.Open( filename, flags );
+
+    DEBUG_IF( ( !b ),
+        "Null check: Problem opening file " << filename << ": " << csv_read.error_msg );
+
+    while( csv_read.ReadRecord() )
+    {
+    }
+
+    if( expected.str().empty() )
+    {
+        DEBUG_IF( ( !csv_read.eof || ( csv_read.end_record_num != records.size() ) ),
+            "Null check: Not all records were read: " << csv_read.error_msg );
+    }
+    else
+    {
+        DEBUG_IF( ( csv_read.error_msg != expected.str() ),
+            "Null check: Unexpected error message: " << csv_read.error_msg
+                << " Expected: " << expected.str() );
+    }
+
+    return true;
+}
+
+
+// Read the first field of each record into a struct. A record without fields is an error.
+bool read_struct(
+    const char *filename,
+    const bool process_empty,
+    const char delimiter,
+    const list<vector<string>> &records
+)
+{
+    jay::util::CSVread csv_read;
+    csv_read.SetDelimiter( delimiter );
+
+    // Maybe unescape quoted fields only when they're accessed.
+    jay::util::CSVread::Flags flags = getrand<bool>() ?
+        jay::util::CSVread::lazy_unescape : jay::util::CSVread::none;
+    if( process_empty )
+    {
+        flags |= jay::util::CSVread::process_empty_records;
+    }
+
+    bool b = csv_read.Open( filename, flags );
+
+    DEBUG_IF( ( !b ),
+        "Struct: Problem opening file " << filename << ": " << csv_read.error_msg );
+
+    size_t n = 0;
+    for( list<vector<string>>::const_iterator it = records.begin(); it != records.end(); ++it )
+    {
+        ++n;
+        first_field record;
+        b = csv_read.ReadStruct( record );
+
+        if( it->empty() )
+        {
+            ostringstream expected;
+            expected << "Record #" << n << " Field #1 is missing. The record has 0 fields.";
+
+            DEBUG_IF( ( b || ( csv_read.error_msg != expected.str() ) ),
+                "Struct: Unexpected error message: " << csv_read.error_msg
+                    << " Expected: " << expected.str() );
+
+            return true;
+        }
+
+        DEBUG_IF( ( !b ),
+            "Struct: Problem reading record #" << n << ": " << csv_read.error_msg );
+
+        DEBUG_IF( ( record.first != ( *it )[ 0 ] ),
+            "Struct: Record #" << n << " has the wrong first field." );
+    }
+
+    DEBUG_IF( ( csv_read.ReadRecord() || !csv_read.eof ),
+        "Struct: Not all records were read: " << csv_read.error_msg );
+
+    return true;
+}
+
+
+// A random double or float from random bits, so any value including infinity and NaN.
+template< class T, class Bits >
+static T random_bits()
+{
+    const Bits bits = getrand<Bits>();
+    T value;
+    memcpy( &value, &bits, sizeof value );
+    return value;
+}
+
+
+// Whether or not two floating point numbers are the same, including the sign of zero and NaN.
+template< class T >
+static bool same_number( const T a, const T b )
+{
+    return ( ( a != a ) && ( b != b ) ) || ( ( a == b ) && ( signbit( a ) == signbit( b ) ) );
+}
+
+
+// Restores the C locale's LC_NUMERIC when it goes out of scope.
+struct numeric_locale_restore
+{
+    numeric_locale_restore() : name( setlocale( LC_NUMERIC, NULL ) ) {}
+    ~numeric_locale_restore() { setlocale( LC_NUMERIC, name.c_str() ); }
+    string name;
+};
+
+
+/* Write typed_records with the columns in a random order, maybe with a column missing, and read
+them back with ReadStruct(), binding the columns with BindHeader() or in order. The numbers must
+read back exactly. Maybe one field of a record is not valid for its member, eg out of range, and
+reading must fail at it with the record, field and member in the error. Maybe the C locale's
+decimal point is a comma while reading and writing, which mustn't matter.
+*/
+bool read_typed( const char *filename, const int max_records )
+{
+    static const char *const members[] = { "text", "integer", "big", "real", "single" };
+    const size_t member_count = sizeof members / sizeof members[ 0 ];
+
+    numeric_locale_restore restore;
+    if( getrand<bool>() )
+    {
+        const char *const comma_locales[] = { "de_DE.UTF-8", "de_DE", "fr_FR.UTF-8", "German" };
+        for( size_t i = 0; i < sizeof comma_locales / sizeof comma_locales[ 0 ]; ++i )
+        {
+            if( setlocale( LC_NUMERIC, comma_locales[ i ] ) )
+                break;
+        }
+    }
+
+    // The columns of the file, as the names of the members.
+    vector<string> header( members, members + member_count );
+    for( size_t i = header.size(); i > 1; --i )
+    {
+        swap( header[ i - 1 ], header[ getrand<size_t>( 0, i - 1 ) ] );
+    }
+
+    string missing;
+    if( !getrand<int>( 0, 5 ) )
+    {
+        const size_t column = getrand<size_t>( 0, header.size() - 1 );
+        missing = header[ column ];
+        header.erase( header.begin() + column );
+    }
+
+    jay::util::CSVwrite::Flags write_flags = jay::util::CSVwrite::truncate;
+    if( getrand<bool>() )
+    {
+        write_flags |= jay::util::CSVwrite::minimal_quoting;
+    }
+
+    jay::util::CSVwrite csv_write;
+    bool b = csv_write.Open( filename, write_flags ) && csv_write.WriteRecord( header );
+    DEBUG_IF( ( !b ),
+        "Typed: Problem writing the header to " << filename << ": " << csv_write.error_msg );
+
+    // The records, and the first one with a field that isn't valid, if any, and its error.
+    vector<typed_record> records;
+    size_t invalid_record = 0;
+    string expected_error;
+
+    for( int n = getrand<int>( 0, max_records ); n > 0; --n )
+    {
+        typed_record record;
+        for( int i = getrand<int>( 0, 8 ); i > 0; --i )
+        {
+            record.text += "ab1.,\"\n"[ getrand<int>( 0, 6 ) ];
+        }
+        record.integer = getrand<int>();
+        record.big = getrand<unsigned long long>();
+        record.real = random_bits<double, unsigned long long>();
+        record.single = random_bits<float, unsigned>();
+
+        /* Maybe write the float as a decimal just past halfway to the next float away from 0. It
+        must round to that float directly, rather than to the double that's halfway and then to
+        even. The decimal is exact, so it's only for floats of a few digits either side of 1.
+        */
+        string single_text;
+        const float magnitude = fabs( record.single );
+        if( ( magnitude >= 1e-3f ) && ( magnitude <= 1e6f ) && getrand<bool>() )
+        {
+            const float next =
+                nextafterf( record.single, ( ( record.single < 0 ) ? -HUGE_VALF : HUGE_VALF ) );
+
+            ostringstream ss;
+            ss << fixed << setprecision( 60 ) << ( ( (double)record.single + next ) / 2 );
+            single_text = ss.str();
+            single_text.erase( single_text.find_last_not_of( '0' ) + 1 );
+            single_text += "1";
+            record.single = next;
+        }
+        records.push_back( record );
+
+        // Maybe replace a number with text that isn't valid for it.
+        size_t invalid_column = header.size();
+        string invalid;
+        if( !invalid_record && !getrand<int>( 0, 15 ) )
+        {
+            invalid_column = getrand<size_t>( 0, header.size() - 1 );
+            const string &name = header[ invalid_column ];
+            ostringstream ss;
+
+            if( name == "integer" )
+            {
+                const long long beyond = getrand<bool>() ?
+                    ( (long long)INT_MAX + getrand<int>( 1, 1000 ) ) :
+                    ( (long long)INT_MIN - getrand<int>( 1, 1000 ) );
+                const char *const bad[] = { "", "+", "-", " 1", "1 ", "1.0", "0x1", "1e3" };
+                if( getrand<bool>() )
+                {
+                    ss << beyond;
+                }
+                else
+                {
+                    ss << bad[ getrand<int>( 0, 7 ) ];
+                }
+            }
+            else if( name == "big" )
+            {
+                const char *const bad[] = { "-1", "18446744073709551616", "99999999999999999999",
+                    "", "1,0", "1a" };
+                ss << bad[ getrand<int>( 0, 5 ) ];
+            }
+            else if( name == "real" )
+            {
+                const char *const bad[] = { "1e999", "-1e999", "1,5", " 1.5", "1.5 ", "", "1..5",
+                    "e5" };
+                ss << bad[ getrand<int>( 0, 7 ) ];
+            }
+            else if( name == "single" )
+            {
+                const char *const bad[] = { "1e39", "-3.5e38", "1,5", "", "x" };
+                ss << bad[ getrand<int>( 0, 4 ) ];
+            }
+            else
+            {
+                // Any text is valid for a string.
+                invalid_column = header.size();
+            }
+
+            if( invalid_column != header.size() )
+            {
+                invalid = ss.str();
+                invalid_record = records.size();
+
+                // The header is record #1.
+                ostringstream error;
+                error << "Record #" << ( records.size() + 1 )
+                    << " Field #" << ( invalid_column + 1 ) << " (" << name << ") is invalid for its member: \"" << invalid << "\"";
+                expected_error = error.str();
+            }
+        }
+
+        for( size_t i = 0; ( i < header.size() ) && b; ++i )
+        {
+            if( i == invalid_column )
+            {
+                b = csv_write.WriteField( invalid );
+            }
+            else if( header[ i ] == "text" )
+            {
+                b = csv_write.WriteField( record.text );
+            }
+            else if( header[ i ] == "integer" )
+            {
+                b = csv_write.WriteField( record.integer );
+            }
+            else if( header[ i ] == "big" )
+            {
+                b = csv_write.WriteField( record.big );
+            }
+            else if( header[ i ] == "real" )
+            {
+                b = csv_write.WriteField( record.real );
+            }
+            else
+            {
+                b = single_text.empty() ? csv_write.WriteField( (double)record.single )
+                    : csv_write.WriteField( single_text );
+            }
+        }
+
+        b = b && csv_write.WriteTerminator();
+        DEBUG_IF( ( !b ),
+            "Typed: Problem writing record: " << csv_write.error_msg );
+    }
+
+    b = csv_write.Close();
+    DEBUG_IF( ( !b ),
+        "Typed: Problem closing: " << csv_write.error_msg );
+
+    // Maybe unescape only what's accessed, and maybe intern the columns, so that the fields are
+    // read from inside their quotes or from the dictionary.
+    jay::util::CSVread::Flags read_flags = getrand<bool>() ?
+        jay::util::CSVread::lazy_unescape : jay::util::CSVread::none;
+
+    jay::util::CSVread csv_read;
+    b = csv_read.Open( filename, read_flags );
+    DEBUG_IF( ( !b ),
+        "Typed: Problem opening file " << filename << ": " << csv_read.error_msg );
+
+    for( size_t i = 0; i < header.size(); ++i )
+    {
+        if( !getrand<int>( 0, 2 ) )
+        {
+            csv_read.SetInterned( i );
+        }
+    }
+
+    // The columns are bound by name, or if they're in the order of the members maybe read in order.
+    const bool in_order = missing.empty()
+        && equal( header.begin(), header.end(), members ) && getrand<bool>();
+
+    if( in_order )
+    {
+        b = csv_read.ReadRecord();
+        DEBUG_IF( ( !b ),
+            "Typed: Problem reading the header: " << csv_read.error_msg );
+    }
+    else
+    {
+        b = csv_read.BindHeader<typed_record>();
+
+        if( !missing.empty() )
+        {
+            const string expected = "The header has no column named \"" + missing + "\".";
+            DEBUG_IF( ( b || ( csv_read.error_msg != expected ) ),
+                "Typed: Unexpected error message: " << csv_read.error_msg
+                    << " Expected: " << expected );
+
+            return true;
+        }
+
+        DEBUG_IF( ( !b ),
+            "Typed: Problem binding the header: " << csv_read.error_msg );
+    }
+
+    for( size_t i = 0; i < records.size(); ++i )
+    {
+        typed_record record;
+        b = csv_read.ReadStruct( record );
+
+        if( ( i + 1 ) == invalid_record )
+        {
+            DEBUG_IF( ( b || ( csv_read.error_msg != expected_error ) ),
+                "Typed: Unexpected error message: " << csv_read.error_msg
+                    << " Expected: " << expected_error );
+
+            return true;
+        }
+
+        DEBUG_IF( ( !b ),
+            "Typed: Problem reading record #" << ( i + 2 ) << ": " << csv_read.error_msg );
+
+        DEBUG_IF( ( ( record.text != records[ i ].text )
+                || ( record.integer != records[ i ].integer )
+                || ( record.big != records[ i ].big )
+                || !same_number( record.real, records[ i ].real )
+                || !same_number( record.single, records[ i ].single ) ),
+            "Typed: Record #" << ( i + 2 ) << " differs." );
+    }
+
+    typed_record extra;
+    DEBUG_IF( ( csv_read.ReadStruct( extra ) || !csv_read.eof ),
+        "Typed: More records than expected, or no EOF: " << csv_read.error_msg );
+
+    return true;
+}
+
+
+/* Read the file divided into ranges at random offsets, which should read the same records at the
+same offsets as reading the whole file. A range that ends inside a quoted field fails, in which case
+it's read again to the next offset instead.
+*/
+bool read_ranges(
+    const char *filename,
+    const bool process_empty,
+    const char delimiter,
+    const list<vector<string>> &records
+)
+{
+    // Maybe unescape quoted fields only when they're accessed.
+    jay::util::CSVread::Flags flags = getrand<bool>() ?
+        jay::util::CSVread::lazy_unescape : jay::util::CSVread::none;
+    if( process_empty )
+    {
+        flags |= jay::util::CSVread::process_empty_records;
+    }
+
+    ifstream file( filename, ios::in | ios::binary | ios::ate );
+
+    DEBUG_IF( ( !file ),
+        "Ranges: Problem opening file " << filename );
+
+    const uint64_t file_size = (uint64_t)file.tellg();
+    file.close();
+
+    // The offset of each record when the whole file is read.
+    vector<uint64_t> offsets;
+    {
+        jay::util::CSVread csv_read;
+        csv_read.SetDelimiter( delimiter );
+        csv_read.ResizeBuffer( getrand( 1, 64 ) );
+
+        bool b = csv_read.Open( filename, flags );
+
+        DEBUG_IF( ( !b ),
+            "Ranges: Problem opening file " << filename << ": " << csv_read.error_msg );
+
+        while( csv_read.ReadRecord() )
+        {
+            DEBUG_IF( ( !offsets.empty() && ( csv_read.record_offset <= offsets.back() ) ),
+                "Ranges: Record #" << csv_read.record_num << " offset "
+                    << csv_read.record_offset << " <= the offset of the record before it." );
+
+            offsets.push_back( csv_read.record_offset );
+        }
+
+        DEBUG_IF( ( !csv_read.eof || ( csv_read.record_num != csv_read.end_record_num ) ),
+            "Ranges: Not all records were read: " << csv_read.error_msg );
+
+        DEBUG_IF( ( offsets.size() != records.size() ),
+            "Ranges: " << offsets.size() << " records read, expected " << records.size() );
+    }
+
+    vector<uint64_t> ends;
+    for( int i = getrand( 0, 8 ); i > 0; --i )
+    {
+        ends.push_back( getrand<uint64_t>( 0, file_size ) );
+    }
+    sort( ends.begin(), ends.end() );
+    ends.push_back( file_size );
+
+    list<vector<string>> output;
+    vector<uint64_t> output_offsets;
+    uint64_t begin = 0;
+    for( size_t i = 0; i < ends.size(); ++i )
+    {
+        jay::util::CSVread csv_read;
+        csv_read.SetDelimiter( delimiter );
+        csv_read.ResizeBuffer( getrand( 1, 64 ) );
+
+        bool b = csv_read.OpenRange( filename, begin, ends[ i ], flags );
+
+        DEBUG_IF( ( !b ),
+            "Ranges: Problem opening range [" << begin << ", " << ends[ i ] << "): "
+                << csv_read.error_msg );
+
+        list<vector<string>> range_records;
+        vector<uint64_t> range_offsets;
+        while( csv_read.ReadRecord() )
+        {
+            range_records.push_back( vector<string>() );
+            csv_read.ReleaseFields( range_records.back() );
+            range_offsets.push_back( csv_read.record_offset );
+        }
+
+        if( csv_read.error_msg.find( "is split by the end of the range" ) != string::npos )
+        {
+            DEBUG_IF( ( ends[ i ] == file_size ),
+                "Ranges: The last range is split: " << csv_read.error_msg );
+
+            continue;
+        }
+
+        DEBUG_IF( ( !csv_read.eof || ( csv_read.record_num != csv_read.end_record_num ) ),
+            "Ranges: Not all records in range [" << begin << ", " << ends[ i ] << ") were read: "
+                << csv_read.error_msg );
+
+        DEBUG_IF( ( !range_offsets.empty() && ( range_offsets[ 0 ] < csv_read.range_begin ) ),
+            "Ranges: The first record of the range is at " << range_offsets[ 0 ]
+                << ", before range_begin " << csv_read.range_begin );
+
+        output.splice( output.end(), range_records );
+        output_offsets.insert( output_offsets.end(), range_offsets.begin(), range_offsets.end() );
+        begin = ends[ i ];
+    }
+
+    DEBUG_IF( ( output != records ),
+        "Ranges: The records read from the ranges differ." );
+
+    DEBUG_IF( ( output_offsets != offsets ),
+        "Ranges: The offsets of the records read from the ranges differ." );
+
+    return true;
+}
+
+
+#ifdef STRESSTEST_THREADS
+// Read the file with CSVdistribute, which should output the same records in order.
+bool read_distribute(
+    const char *filename,
+    const bool process_empty,
+    const char delimiter,
+    const list<vector<string>> &records
+)
+{
+    jay::util::CSVread csv_read;
+    csv_read.SetDelimiter( delimiter );
+
+    // Maybe unescape quoted fields only when they're accessed.
+    jay::util::CSVread::Flags flags = getrand<bool>() ?
+        jay::util::CSVread::lazy_unescape : jay::util::CSVread::none;
+    if( process_empty )
+    {
+        flags |= jay::util::CSVread::process_empty_records;
+    }
+
+    bool b = csv_read.Open( filename, flags );
+
+    DEBUG_IF( ( !b ),
+        "Distribute: Problem opening file " << filename << ": " << csv_read.error_msg );
+
+    // Maybe intern the first columns, whose fields must be copied into the blocks' records.
+    for( size_t i = getrand<size_t>( 0, 3 ); i > 0; --i )
+    {
+        csv_read.SetInterned( i - 1 );
+    }
+
+    // Small blocks and few of them, so that the reader has to wait for the workers.
+    jay::util::CSVdistribute dist( csv_read,
+        getrand<size_t>( 1, 4 ), getrand<size_t>( 1, 8 ), getrand<size_t>( 0, 8 ) );
+
+    atomic<size_t> processed( 0 );
+    list<vector<string>> output;
+    uintmax_t next_record_num = 1;
+    bool out_of_order = false;
+
+    b = dist.Run(
+        [&]( jay::util::CSVdistribute::Block &block, size_t )
+        {
+            processed += block.size;
+        },
+        [&]( jay::util::CSVdistribute::Block &block )
+        {
+            // REM DEBUG_IF can't be used in here since it returns false.
+            if( block.record_num != next_record_num )
+            {
+                out_of_order = true;
+            }
+
+            next_record_num += block.size;
+            for( size_t i = 0; i < block.size; ++i )
+            {
+                output.push_back( vector<string>() );
+                output.back().swap( block.records[ i ] );
+            }
+        }
+    );
+
+    DEBUG_IF( ( !b ),
+        "Distribute: Not all records were read: " << csv_read.error_msg );
+
+    DEBUG_IF( out_of_order,
+        "Distribute: The blocks were output out of order." );
+
+    DEBUG_IF( ( processed != records.size() ),
+        "Distribute: " << processed << " records processed, expected " << records.size() );
+
+    DEBUG_IF( ( output != records ),
+        "Distribute: The records output differ." );
+
+    return true;
+}
+#endif
+
+
+
+
+// A random code point: mostly ASCII, including the characters CSV escapes, but also every length of
+// UTF-8 and code points that are a surrogate pair in UTF-16.
+static uint32_t random_code_point()
+{
+    static const char ascii[] = "\",\r\n ab";
+
+    switch( getrand<int>( 0, 9 ) )
+    {
+    case 0: case 1: case 2:
+        return (unsigned char)ascii[ getrand<size_t>( 0, sizeof ascii - 2 ) ];
+    case 3: case 4:
+        return getrand<uint32_t>( 0x01, 0x7F );
+    case 5: case 6:
+        return getrand<uint32_t>( 0x80, 0x7FF );
+    case 7:
+    {
+        uint32_t cp = getrand<uint32_t>( 0x800, 0xFFFF - 0x800 );
+        return ( cp >= 0xD800 ) ? ( cp + 0x800 ) : cp; // skip the surrogates
+    }
+    default:
+        return getrand<uint32_t>( 0x10000, 0x10FFFF );
+    }
+}
+
+
+static void append_utf8( string &s, const uint32_t cp )
+{
+    if( cp < 0x80 )
+    {
+        s += (char)cp;
+    }
+    else if( cp < 0x800 )
+    {
+        s += (char)( 0xC0 | ( cp >> 6 ) );
+        s += (char)( 0x80 | ( cp & 0x3F ) );
+    }
+    else if( cp < 0x10000 )
+    {
+        s += (char)( 0xE0 | ( cp >> 12 ) );
+        s += (char)( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+        s += (char)( 0x80 | ( cp & 0x3F ) );
+    }
+    else
+    {
+        s += (char)( 0xF0 | ( cp >> 18 ) );
+        s += (char)( 0x80 | ( ( cp >> 12 ) & 0x3F ) );
+        s += (char)( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+        s += (char)( 0x80 | ( cp & 0x3F ) );
+    }
+}
+
+
+static void append_utf16_unit( string &s, const uint32_t unit, const bool big_endian )
+{
+    s += (char)( big_endian ? ( unit >> 8 ) : ( unit & 0xFF ) );
+    s += (char)( big_endian ? ( unit & 0xFF ) : ( unit >> 8 ) );
+}
+
+
+static void append_utf16( string &s, const uint32_t cp, const bool big_endian )
+{
+    if( cp < 0x10000 )
+    {
+        append_utf16_unit( s, cp, big_endian );
+    }
+    else
+    {
+        append_utf16_unit( s, 0xD800 + ( ( cp - 0x10000 ) >> 10 ), big_endian );
+        append_utf16_unit( s, 0xDC00 + ( ( cp - 0x10000 ) & 0x3FF ), big_endian );
+    }
+}
+
+
+/* Generate random records of random code points. 'text' is the code points of the CSV: every field
+quoted, delimited by comma and terminated by LF. 'records' is the fields in UTF-8.
+*/
+static void generate_unicode_records(
+    const int max_code_points,
+    vector<uint32_t> &text, // OUT
+    list<vector<string>> &records // OUT
+)
+{
+    text.clear();
+    records.clear();
+
+    int remaining = getrand( 0, max_code_points );
+
+    while( remaining > 0 )
+    {
+        records.push_back( vector<string>() );
+
+        int field_count = getrand( 1, 8 );
+        for( int i = 0; i < field_count; ++i )
+        {
+            if( i )
+            {
+                text.push_back( ',' );
+            }
+
+            text.push_back( '"' );
+            records.back().push_back( string() );
+
+            int length = getrand( 0, 16 );
+            for( int j = 0; j < length; ++j, --remaining )
+            {
+                uint32_t cp = random_code_point();
+                append_utf8( records.back().back(), cp );
+                text.push_back( cp );
+                if( cp == '"' )
+                {
+                    text.push_back( cp );
+                }
+            }
+
+            text.push_back( '"' );
+        }
+
+        text.push_back( '\n' );
+        --remaining;
+    }
+}
+
+
+static bool write_bytes( const char *filename, const string &bytes )
+{
+    ofstream out( filename, ios::out | ios::binary | ios::trunc );
+
+    DEBUG_IF( ( !out.is_open() ),
+        "Problem opening file " << filename );
+
+    out.write( bytes.data(), (streamsize)bytes.size() );
+
+    DEBUG_IF( ( !out.flush() ),
+        "Problem writing file " << filename );
+
+    return true;
+}
+
+
+/* Read the records of a file, with a small buffer so that multibyte characters and surrogate pairs
+are split between chunks.
+[ret] Whether or not the end was reached without error. 'error_msg' is set otherwise.
+*/
+static bool read_all_records(
+    const char *filename,
+    const jay::util::CSVread::Flags flags,
+    list<vector<string>> &records, // OUT
+    string &error_msg, // OUT
+    bool &has_utf16_bom // OUT
+)
+{
+    records.clear();
+
+    jay::util::CSVread csv_read;
+    csv_read.ResizeBuffer( getrand( 3, 33 ) );
+
+    if( csv_read.Open( filename, flags ) )
+    {
+        while( csv_read.ReadRecord() )
+        {
+            records.push_back( vector<string>() );
+            csv_read.ReleaseFields( records.back() );
+        }
+    }
+
+    error_msg = csv_read.error_msg;
+    has_utf16_bom = csv_read.has_utf16_bom;
+    return csv_read.eof && ( csv_read.record_num == csv_read.end_record_num );
+}
+
+
+/* Read a file of random UTF-8 with flag validate_utf8. Maybe a field has an invalid sequence: a
+stray continuation byte, an overlong encoding, a surrogate, a code point > U+10FFFF or a truncated
+sequence. Reading should fail at it.
+*/
+bool read_utf8( const char *filename, const int max_code_points )
+{
+    vector<uint32_t> text;
+    list<vector<string>> records;
+    generate_unicode_records( max_code_points, text, records );
+
+    // Maybe insert an invalid sequence at the start of a character in a random field.
+    string bytes;
+    bool inject = !records.empty() && getrand<bool>();
+    size_t inject_record = inject ? getrand<size_t>( 0, records.size() - 1 ) : 0;
+    size_t inject_field = 0;
+    size_t inject_offset = 0;
+    string invalid;
+
+    if( inject )
+    {
+        list<vector<string>>::iterator it = records.begin();
+        advance( it, inject_record );
+        inject_field = getrand<size_t>( 0, it->size() - 1 );
+        string &field = ( *it )[ inject_field ];
+
+        // The offset is at the start of a character.
+        do
+        {
+            inject_offset = getrand<size_t>( 0, field.size() );
+        } while( ( inject_offset < field.size() ) && ( ( field[ inject_offset ] & 0xC0 ) == 0x80 ) );
+
+        unsigned char cont = (unsigned char)getrand<int>( 0x80, 0xBF );
+        switch( getrand<int>( 0, 6 ) )
+        {
+        case 0: // stray continuation byte
+            invalid += (char)cont;
+            break;
+        case 1: // overlong 2 byte sequence
+            invalid += (char)getrand<int>( 0xC0, 0xC1 );
+            invalid += (char)cont;
+            break;
+        case 2: // overlong 3 byte sequence
+            invalid += '\xE0';
+            invalid += (char)getrand<int>( 0x80, 0x9F );
+            invalid += (char)cont;
+            break;
+        case 3: // overlong 4 byte sequence
+            invalid += '\xF0';
+            invalid += (char)getrand<int>( 0x80, 0x8F );
+            invalid += (char)cont;
+            invalid += (char)cont;
+            break;
+        case 4: // surrogate
+            invalid += '\xED';
+            invalid += (char)getrand<int>( 0xA0, 0xBF );
+            invalid += (char)cont;
+            break;
+        case 5: // > U+10FFFF
+            if( getrand<bool>() )
+            {
+                invalid += '\xF4';
+                invalid += (char)getrand<int>( 0x90, 0xBF );
+                invalid += (char)cont;
+                invalid += (char)cont;
+            }
+            else
+            {
+                invalid += (char)getrand<int>( 0xF5, 0xFF );
+            }
+            break;
+        default: // truncated sequence, followed by a character or the end of the field
+        {
+            string valid;
+            append_utf8( valid, getrand<uint32_t>( 0x10000, 0x10FFFF ) );
+            invalid = valid.substr( 0, getrand<size_t>( 1, 3 ) );
+        }
+        }
+
+        field.insert( inject_offset, invalid );
+    }
+
+    // The bytes of the file are the text with each field replaced by the one in 'records'.
+    list<vector<string>>::const_iterator it = records.begin();
+    size_t field = 0;
+    bool in_field = false;
+    for( size_t i = 0; i < text.size(); ++i )
+    {
+        if( text[ i ] == '"' )
+        {
+            if( in_field && ( text[ i + 1 ] == '"' ) )
+            {
+                ++i;
+                continue;
+            }
+
+            if( !in_field )
+            {
+                // Quotes in a field are doubled.
+                const string &f = ( *it )[ field ];
+                bytes += '"';
+                for( size_t j = 0; j < f.size(); ++j )
+                {
+                    bytes += f[ j ];
+                    if( f[ j ] == '"' )
+                    {
+                        bytes += '"';
+                    }
+                }
+                bytes += '"';
+            }
+
+            in_field = !in_field;
+        }
+        else if( !in_field )
+        {
+            bytes += (char)text[ i ];
+
+            if( text[ i ] == ',' )
+            {
+                ++field;
+            }
+            else if( text[ i ] == '\n' )
+            {
+                ++it;
+                field = 0;
+            }
+        }
+    }
+
+    if( !write_bytes( filename, bytes ) )
+        return false;
+
+    list<vector<string>> output;
+    string error_msg;
+    bool has_utf16_bom;
+    bool b = read_all_records( filename, jay::util::CSVread::validate_utf8, output, error_msg,
+        has_utf16_bom );
+
+    if( inject )
+    {
+        ostringstream expected;
+        expected << "Record #" << ( inject_record + 1 ) << " Field #" << ( inject_field + 1 )
+            << " is invalid due to invalid UTF-8 sequence at byte offset " << inject_offset
+            << " in field.";
+
+        DEBUG_IF( ( error_msg != expected.str() ),
+            "UTF-8: Unexpected error message: " << error_msg << " Expected: " << expected.str() );
+
+        records.resize( inject_record );
+    }
+    else
+    {
+        DEBUG_IF( ( !b ),
+            "UTF-8: Not all records were read: " << error_msg );
+    }
+
+    DEBUG_IF( ( output != records ),
+        "UTF-8: The records read differ." );
+
+    remove( filename );
+    return true;
+}
+
+
+/* Read a file of random UTF-16, little or big endian, with flag transcode_utf16. With a BOM it's
+transcoded, and maybe it has an unpaired surrogate or ends in half a code unit, which is an error.
+Without one it's parsed as is, the same as without the flag.
+*/
+bool read_utf16( const char *filename, const int max_code_points )
+{
+    vector<uint32_t> text;
+    list<vector<string>> records;
+    generate_unicode_records( max_code_points, text, records );
+
+    const bool big_endian = getrand<bool>();
+    const bool bom = !!getrand<int>( 0, 3 );
+
+    string bytes;
+    for( size_t i = 0; i < text.size(); ++i )
+    {
+        append_utf16( bytes, text[ i ], big_endian );
+    }
+
+    // Maybe insert an unpaired surrogate between two code points, or end in half a code unit.
+    string expected_error;
+    int corrupt = ( bom && !text.empty() ) ? getrand<int>( 0, 5 ) : 0;
+    if( corrupt == 1 )
+    {
+        size_t unit;
+        do
+        {
+            unit = getrand<size_t>( 0, ( bytes.size() / 2 ) - 1 );
+        } while( ( ( (unsigned char)bytes[ unit * 2 + ( big_endian ? 0 : 1 ) ] ) & 0xFC ) == 0xDC );
+
+        string surrogate;
+        append_utf16_unit( surrogate, getrand<uint32_t>( 0xD800, 0xDFFF ), big_endian );
+        bytes.insert( unit * 2, surrogate );
+
+        ostringstream ss;
+        ss << "UTF-16 stream is invalid due to unpaired surrogate at byte offset "
+            << ( 2 + unit * 2 ) << ".";
+        expected_error = ss.str();
+    }
+    else if( corrupt == 2 )
+    {
+        bytes += (char)getrand<char>();
+        expected_error = "UTF-16 stream ends in an incomplete code unit or surrogate pair.";
+    }
+
+    if( bom )
+    {
+        bytes.insert( 0, big_endian ? "\xFE\xFF" : "\xFF\xFE" );
+    }
+
+    if( !write_bytes( filename, bytes ) )
+        return false;
+
+    jay::util::CSVread::Flags flags = jay::util::CSVread::transcode_utf16;
+    if( bom && getrand<bool>() )
+    {
+        flags = flags | jay::util::CSVread::validate_utf8;
+    }
+
+    list<vector<string>> output;
+    string error_msg;
+    bool has_utf16_bom;
+    bool b = read_all_records( filename, flags, output, error_msg, has_utf16_bom );
+
+    DEBUG_IF( ( has_utf16_bom != bom ),
+        "UTF-16: has_utf16_bom is " << has_utf16_bom << ", expected " << bom );
+
+    if( !bom )
+    {
+        list<vector<string>> untranscoded;
+        bool has_bom;
+        bool b2 = read_all_records( filename, jay::util::CSVread::none, untranscoded, error_msg,
+            has_bom );
+
+        DEBUG_IF( ( ( b != b2 ) || ( output != untranscoded ) ),
+            "UTF-16: Without a BOM the records differ from those read without the flag." );
+    }
+    else if( expected_error.size() )
+    {
+        DEBUG_IF( ( error_msg != expected_error ),
+            "UTF-16: Unexpected error message: " << error_msg << " Expected: " << expected_error );
+    }
+    else
+    {
+        DEBUG_IF( ( !b ),
+            "UTF-16: Not all records were read: " << error_msg );
+
+        DEBUG_IF( ( output != records ),
+            "UTF-16: The records read differ." );
+    }
+
+    remove( filename );
+    return true;
+}
+
+
+/* Write random records in a random dialect and read them with flag sniff_dialect. The delimiter
+is one of , ; \t | and the quote character one of " ' like those sniffed. The fields have only the
+delimiter and quote character of the dialect, so that it's the only one to parse consistently, and
+the first record has a field with the delimiter so that the quote character can be told apart.
+*/
+bool read_sniff( const char *filename, const int max_size )
+{
+    static const char delims[] = { ',', ';', '\t', '|' };
+    static const char quotes[] = { '"', '\'' };
+    static const char *const terminators[] = { "\n", "\r\n", "\r" };
+
+    const char delim = delims[ getrand<size_t>( 0, sizeof delims - 1 ) ];
+    const char quote = quotes[ getrand<size_t>( 0, sizeof quotes - 1 ) ];
+    const string terminator = terminators[ getrand<size_t>( 0, 2 ) ];
+
+    // The characters that have to be quoted, and those that can be in a field.
+    string special( 1, delim );
+    special += quote;
+    special += "\r\n";
+    const string alphabet = "ab1 " + special;
+
+    list<vector<string>> records;
+    const size_t field_count = getrand<size_t>( 2, 6 );
+    string bytes;
+
+    do
+    {
+        records.push_back( vector<string>( field_count ) );
+
+        for( size_t i = 0; i < field_count; ++i )
+        {
+            string &field = records.back()[ i ];
+
+            // The first record has no line break and has the delimiter in a field.
+            int length = getrand( 0, 8 );
+            for( int j = 0; j < length; ++j )
+            {
+                char c = alphabet[ getrand<size_t>( 0, alphabet.size() - 1 ) ];
+                if( ( records.size() == 1 ) && ( ( c == '\r' ) || ( c == '\n' ) ) )
+                {
+                    c = 'a';
+                }
+                field += c;
+            }
+
+            if( ( records.size() == 1 ) && ( i == 0 ) )
+            {
+                field.insert( getrand<size_t>( 0, field.size() ), 1, delim );
+            }
+
+            // Quote the field if it needs it, and otherwise maybe.
+            if( i )
+            {
+                bytes += delim;
+            }
+
+            if( getrand<bool>() || field.empty()
+                || ( field.find_first_of( special ) != string::npos )
+                || ( field[ 0 ] == ' ' ) || ( field[ field.size() - 1 ] == ' ' ) )
+            {
+                bytes += quote;
+                for( size_t j = 0; j < field.size(); ++j )
+                {
+                    bytes += field[ j ];
+                    if( field[ j ] == quote )
+                    {
+                        bytes += quote;
+                    }
+                }
+                bytes += quote;
+            }
+            else
+            {
+                bytes += field;
+            }
+        }
+
+        bytes += terminator;
+    } while( ( bytes.size() < (size_t)max_size ) && getrand<int>( 0, 7 ) );
+
+    if( !write_bytes( filename, bytes ) )
+        return false;
+
+    // The sample is the first chunk, so the buffer holds the whole file.
+    jay::util::CSVread csv_read;
+    csv_read.ResizeBuffer( bytes.size() + getrand( 0, 16 ) );
+
+    jay::util::CSVread::Flags flags = jay::util::CSVread::sniff_dialect;
+    if( getrand<bool>() )
+    {
+        flags |= jay::util::CSVread::process_empty_records;
+    }
+    if( getrand<bool>() )
+    {
+        flags |= jay::util::CSVread::lazy_unescape;
+    }
+
+    bool b = csv_read.Open( filename, flags );
+
+    DEBUG_IF( ( !b ),
+        "Sniff: Problem opening file " << filename << ": " << csv_read.error_msg );
+
+    list<vector<string>> output;
+    while( csv_read.ReadRecord() )
+    {
+        output.push_back( vector<string>() );
+        csv_read.ReleaseFields( output.back() );
+    }
+
+    DEBUG_IF( ( ( csv_read.GetDelimiter() != (unsigned char)delim )
+        || ( csv_read.GetQuote() != (unsigned char)quote ) ),
+        "Sniff: The dialect sniffed is delimiter " << (int)csv_read.GetDelimiter() << " quote "
+            << (int)csv_read.GetQuote() << ", expected " << (int)delim << " " << (int)quote );
+
+    DEBUG_IF( ( !csv_read.eof || ( csv_read.end_record_num != records.size() ) ),
+        "Sniff: Not all records were read: " << csv_read.error_msg );
+
+    DEBUG_IF( ( output != records ),
+        "Sniff: The records read differ." );
+
+    remove( filename );
+    return true;
+}
@@ -27,6 +27,8 @@ along with jay::util. If not, see <http://www.gnu.org/licenses/>.
 #include <string>
 #include <vector>
 
+#include "util.hpp"
+
 #include "CSV.hpp"
 
 bool read_records(
@@ -39,4 +41,53 @@ bool read_records(
     std::list<std::vector<std::string>> &records // OUT
 );
 
+bool read_cache(
+    const char *filename,
+    const bool process_empty,
+    const char delimiter,
+    const std::list<std::vector<std::string>> &records
+);
+bool read_null_check(
+    const char *filename,
+    const bool process_empty,
+    const char delimiter,
+    const std::list<std::vector<std::string>> &records
+);
+bool read_struct(
+    const char *filename,
+    const bool process_empty,
+    const char delimiter,
+    const std::list<std::vector<std::string>> &records
+);
+bool read_ranges(
+    const char *filename,
+    const bool process_empty,
+    const char delimiter,
+    const std::list<std::vector<std::string>> &records
+);
+#ifdef STRESSTEST_THREADS
+bool read_distribute(
+    const char *filename,
+    const bool process_empty,
+    const char delimiter,
+    const std::list<std::vector<std::string>> &records
+);
+#endif
+bool read_utf8(
+    const char *filename,
+    const int max_code_points
+);
+bool read_utf16(
+    const char *filename,
+    const int max_code_points
+);
+bool read_sniff(
+    const char *filename,
+    const int max_size
+);
+bool read_typed(
+    const char *filename,
+    const int max_records
+);
+
 #endif // STRESSTEST_READ_
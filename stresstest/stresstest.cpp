@@ -87,6 +87,20 @@ void init()
 }
 
 
+// Whether CSVwrite flag minimal_quoting quotes a field, given the delimiter character.
+bool needs_quotes( const string &field, const bool first, const char delim )
+{
+    if( field.empty() )
+    {
+        return first; // an empty record would have no fields
+    }
+
+    return ( field.find_first_of( string( "\"\r\n" ) + delim ) != string::npos )
+        || ( field[ 0 ] == ' ' ) || ( field[ 0 ] == '\t' ) || ( field[ 0 ] == '\xEF' )
+        || ( *field.rbegin() == ' ' ) || ( *field.rbegin() == '\t' );
+}
+
+
 // clears all OUT params before generating
 void generate_list_of_random_records(
     const int max_space,
@@ -207,8 +221,26 @@ bool generate_and_compare(
     case 3: csv_write.delimiter = " " + csv_write.delimiter + " "; break;
     }
 
+    // Maybe quote only the fields that need it, otherwise every field is quoted.
+    bool minimal_quoting = getrand<bool>();
+    int quoted_count = field_count;
+    if( minimal_quoting )
+    {
+        quoted_count = 0;
+        for( list<vector<string>>::iterator it = randlist.begin(); it != randlist.end(); ++it )
+        {
+            for( size_t i = 0; i < it->size(); ++i )
+            {
+                if( needs_quotes( ( *it )[ i ], !i, delim ) )
+                {
+                    ++quoted_count;
+                }
+            }
+        }
+    }
+
     int expected_bytes = char_count // the number of random bytes in all the records
-        + ( field_count * 2 ) // each field is qualified with double quotes.. "abc"
+        + ( quoted_count * 2 ) // each field that's quoted is qualified with double quotes.. "abc"
         + escape_count // each double quote in a field is escaped with a double quote
         + ( delimiter_count * csv_write.delimiter.length() )
         + ( terminator_count * csv_write.terminator.length() )
@@ -224,16 +256,85 @@ bool generate_and_compare(
     DEBUG_IF( ( !truncate ),
         "Not implemented." );
 
-    DEBUG_IF( !write_records(
-            filename,
-            utf8bom,
-            max_ramdisk_size,
-            randlist_process_empty,
-            truncate,
-            randlist,
-            csv_write
-        ),
-        "write_records() failed." );
+    // Maybe compress the file, in which case it's decompressed before its size is checked.
+    int gzip_level = 0;
+#ifdef JAY_UTIL_CSV_ZLIB
+    bool use_gzip = getrand<bool>();
+    if( use_gzip )
+    {
+        gzip_level = getrand<int>( 1, 9 );
+    }
+#endif
+
+    // Maybe write the file on a background thread, format it on worker threads, or commit it
+    // durably, instead.
+#ifdef STRESSTEST_THREADS
+    bool use_async = !gzip_level && !getrand<int>( 0, 3 );
+    bool use_parallel = !gzip_level && !use_async && !getrand<int>( 0, 2 );
+    bool use_durable = !gzip_level && !use_async && !use_parallel && !getrand<int>( 0, 2 );
+    if( use_durable )
+    {
+        DEBUG_IF( !write_durable(
+                filename,
+                utf8bom,
+                randlist_process_empty,
+                minimal_quoting,
+                csv_write.delimiter,
+                csv_write.terminator,
+                randlist
+            ),
+            "write_durable() failed." );
+    }
+    else if( use_parallel )
+    {
+        DEBUG_IF( !write_parallel(
+                filename,
+                utf8bom,
+                randlist_process_empty,
+                minimal_quoting,
+                csv_write.delimiter,
+                csv_write.terminator,
+                randlist
+            ),
+            "write_parallel() failed." );
+    }
+    else if( use_async )
+    {
+        DEBUG_IF( !write_async(
+                filename,
+                utf8bom,
+                randlist_process_empty,
+                minimal_quoting,
+                csv_write.delimiter,
+                csv_write.terminator,
+                randlist
+            ),
+            "write_async() failed." );
+    }
+    else
+#endif
+    {
+        DEBUG_IF( !write_records(
+                filename,
+                utf8bom,
+                max_ramdisk_size,
+                randlist_process_empty,
+                truncate,
+                minimal_quoting,
+                gzip_level,
+                randlist,
+                csv_write
+            ),
+            "write_records() failed." );
+    }
+
+#ifdef JAY_UTIL_CSV_ZLIB
+    if( gzip_level )
+    {
+        DEBUG_IF( !gunzip_file( filename ),
+            "gunzip_file() failed." );
+    }
+#endif
 
     fstream file( filename, ios::in | ios::ate | ios::binary );
     DEBUG_IF( ( !file ),
@@ -272,6 +373,131 @@ bool generate_and_compare(
     DEBUG_IF( ( list2.size() != list2_expected_count ),
                     "Unexpected number of records read." );
 
+    // Maybe build a cache of the file, which should have the same records.
+    bool use_cache = getrand<bool>();
+    if( use_cache )
+    {
+        DEBUG_IF( !read_cache(
+                filename,
+                list2_process_empty,
+                delim,
+                list2
+            ),
+            "read_cache() failed." );
+    }
+
+    // Maybe read the file again erroring on null bytes, which random fields are likely to have.
+    bool use_null_check = getrand<bool>();
+    if( use_null_check )
+    {
+        DEBUG_IF( !read_null_check(
+                filename,
+                list2_process_empty,
+                delim,
+                list2
+            ),
+            "read_null_check() failed." );
+    }
+
+    // Maybe read the first field of each record into a struct.
+    bool use_struct = getrand<bool>();
+    if( use_struct )
+    {
+        DEBUG_IF( !read_struct(
+                filename,
+                list2_process_empty,
+                delim,
+                list2
+            ),
+            "read_struct() failed." );
+    }
+
+    // Maybe read the file again divided into ranges at random offsets.
+    bool use_ranges = getrand<bool>();
+    if( use_ranges )
+    {
+        DEBUG_IF( !read_ranges(
+                filename,
+                list2_process_empty,
+                delim,
+                list2
+            ),
+            "read_ranges() failed." );
+    }
+
+#ifdef STRESSTEST_THREADS
+    // Maybe read the file again distributing the records to worker threads.
+    bool use_distribute = getrand<bool>();
+    if( use_distribute )
+    {
+        DEBUG_IF( !read_distribute(
+                filename,
+                list2_process_empty,
+                delim,
+                list2
+            ),
+            "read_distribute() failed." );
+    }
+#endif
+
+    // Maybe read random UTF-8 with validation, random UTF-16 with transcoding, records in a random
+    // dialect with sniffing, random numbers, typed structs and rotated records, from their own
+    // files. These don't use the records written above.
+    const string other_filename = string( filename ) + ".utf";
+    const int max_code_points = ( max_ramdisk_size < 4096 ) ? ( max_ramdisk_size / 4 ) : 1024;
+
+    bool use_utf8 = getrand<bool>();
+    if( use_utf8 )
+    {
+        DEBUG_IF( !read_utf8( other_filename.c_str(), max_code_points ),
+            "read_utf8() failed." );
+    }
+
+    bool use_utf16 = getrand<bool>();
+    if( use_utf16 )
+    {
+        DEBUG_IF( !read_utf16( other_filename.c_str(), max_code_points ),
+            "read_utf16() failed." );
+    }
+
+    bool use_sniff = getrand<bool>();
+    if( use_sniff )
+    {
+        DEBUG_IF( !read_sniff( other_filename.c_str(), max_ramdisk_size ),
+            "read_sniff() failed." );
+    }
+
+    // Maybe write random numbers with the WriteField() overloads for numbers and read them back.
+    bool use_numbers = getrand<bool>();
+    if( use_numbers )
+    {
+        DEBUG_IF( !write_numbers( other_filename.c_str(), max_code_points ),
+            "write_numbers() failed." );
+    }
+
+    bool use_write_struct = getrand<bool>();
+    if( use_write_struct )
+    {
+        DEBUG_IF( !write_struct( other_filename.c_str(), max_code_points ),
+            "write_struct() failed." );
+    }
+
+    // Maybe read typed structs by their column names, some fields not valid for their members.
+    bool use_typed = getrand<bool>();
+    if( use_typed )
+    {
+        DEBUG_IF( !read_typed( other_filename.c_str(), max_code_points ),
+            "read_typed() failed." );
+    }
+
+    // Maybe append records to a file with some already, switching files with a header.
+    bool use_rotation = getrand<bool>();
+    if( use_rotation )
+    {
+        DEBUG_IF( !write_rotation( other_filename.c_str(), max_code_points ),
+            "write_rotation() failed." );
+    }
+
     list<vector<string>>::iterator it1 = randlist.begin();
     list<vector<string>>::iterator it2 = list2.begin();
     while( ( it1 != randlist.end() ) && ( it2 != list2.end() ) )
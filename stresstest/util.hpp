@@ -31,6 +31,15 @@ along with jay::util. If not, see <http://www.gnu.org/licenses/>.
 #include <type_traits>
 
 
+/* Whether or not the compiler has the C++11 threads and atomics that CSVdistribute, CSVasyncwrite,
+CSVparallelwrite and CSVdurablewrite require. Visual Studio 2010 doesn't, and CSV.vcxproj leaves
+those classes out when its toolset is used, so they aren't tested.
+*/
+#if !defined( _MSC_VER ) || ( _MSC_VER >= 1700 )
+#define STRESSTEST_THREADS
+#endif
+
+
 extern std::mt19937 mersenne;
 
 bool is_mt19937_state_bug_present();
@@ -25,22 +25,380 @@ along with jay::util. If not, see <http://www.gnu.org/licenses/>.
 
 #include "write.hpp"
 
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <list>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#ifdef JAY_UTIL_CSV_ZLIB
+#include <zlib.h>
+#endif
+
 #include "util.hpp"
 
 #include "CSV.hpp"
+#ifdef STRESSTEST_THREADS
+#include "CSVasyncwrite.hpp"
+#include "CSVdurablewrite.hpp"
+#include "CSVparallelwrite.hpp"
+#endif
 #include "strerror.hpp"
 
 
 using namespace std;
 
 
+/* A record written with CSVwrite::WriteStruct(). Its fields are the strings of a random record,
+followed by the numbers if 'numbers' is true.
+*/
+struct struct_record
+{
+    const vector<string> *fields;
+    bool numbers;
+    int integer;
+    double real;
+    jay::util::CSVwrite::Decimal decimal;
+};
+
+namespace jay {
+namespace util {
+template<> struct CSVfields<struct_record>
+{
+    static void Visit( const struct_record &record, CSVwrite::FieldWriter &field )
+    {
+        for( size_t i = 0; i < record.fields->size(); ++i )
+        {
+            field( (*record.fields)[ i ] );
+        }
+
+        if( record.numbers )
+        {
+            field( record.integer );
+            field( record.real );
+            field( record.decimal );
+        }
+    }
+};
+} // namespace util
+} // namespace jay
+
+
+// A random double: often a special value, otherwise random bits, which are any finite value
+// including denormals and also sometimes infinity or NaN.
+static double random_double()
+{
+    switch( getrand<int>( 0, 15 ) )
+    {
+    case 0: return 0.0;
+    case 1: return -0.0;
+    case 2: return numeric_limits<double>::infinity();
+    case 3: return -numeric_limits<double>::infinity();
+    case 4: return numeric_limits<double>::quiet_NaN();
+    case 5: return numeric_limits<double>::denorm_min();
+    case 6: return -numeric_limits<double>::max();
+    case 7: return getrand<int>( -1000, 1000 ) / 10.0;
+    default: break;
+    }
+
+    unsigned long long bits = getrand<unsigned long long>();
+    double value;
+    memcpy( &value, &bits, sizeof value );
+    return value;
+}
+
+
+/* The number of significant digits in the mantissa of a number written with %g, from the first
+digit that isn't 0 to the last. %g drops the zeros that follow a decimal point so any at the end
+are in the integer part only to place it, eg 100000000 has 1.
+*/
+static int significant_digits( const string &text )
+{
+    int count = 0;
+    int zeros = 0;
+    for( size_t i = 0; ( i < text.size() ) && ( text[ i ] != 'e' ) && ( text[ i ] != 'E' ); ++i )
+    {
+        if( ( text[ i ] < '0' ) || ( text[ i ] > '9' ) || ( !count && ( text[ i ] == '0' ) ) )
+        {
+            continue;
+        }
+
+        ++count;
+        zeros = ( text[ i ] == '0' ) ? ( zeros + 1 ) : 0;
+    }
+
+    return ( count - zeros ) ? ( count - zeros ) : 1;
+}
+
+
+// Whether or not the text of a double written by CSVwrite reads back as it, with the sign if zero.
+static bool double_reads_back( const string &text, const double value )
+{
+    const double parsed = strtod( text.c_str(), NULL );
+
+    if( value != value )
+    {
+        return parsed != parsed;
+    }
+
+    return ( parsed == value ) && ( signbit( parsed ) == signbit( value ) );
+}
+
+
+// The text of a Decimal: its units padded to 'scale' + 1 digits with the decimal point inserted
+// before the last 'scale' digits.
+static string decimal_text( const jay::util::CSVwrite::Decimal &decimal )
+{
+    ostringstream units;
+    if( decimal.units < 0 )
+    {
+        units << (unsigned long long)-( decimal.units + 1 ) + 1;
+    }
+    else
+    {
+        units << decimal.units;
+    }
+
+    string text = units.str();
+    if( text.size() <= decimal.scale )
+    {
+        text.insert( 0, decimal.scale + 1 - text.size(), '0' );
+    }
+    if( decimal.scale )
+    {
+        text.insert( text.size() - decimal.scale, "." );
+    }
+    if( decimal.units < 0 )
+    {
+        text.insert( 0, "-" );
+    }
+
+    return text;
+}
+
+
+/* Write records of a random double, Decimal and long long with the WriteField() overloads for
+numbers, and read them back. A double must read back exactly, with the same sign if it's zero, in
+the fewest significant digits that do. A Decimal must have exactly 'scale' digits after the decimal
+point.
+*/
+bool write_numbers( const char *filename, const int max_records )
+{
+    typedef jay::util::CSVwrite::Decimal Decimal;
+
+    vector<double> doubles;
+    vector<Decimal> decimals;
+    vector<long long> integers;
+
+    jay::util::CSVwrite csv_write;
+
+    // A scale of more than 30 fractional digits is an error.
+    bool b = csv_write.Open( filename, jay::util::CSVwrite::truncate );
+    DEBUG_IF( ( !b ),
+        "Numbers: Problem opening file " << filename << ": " << csv_write.error_msg );
+
+    b = csv_write.WriteField( Decimal( 1, 31 ) );
+    DEBUG_IF( ( b || !csv_write.error ),
+        "Numbers: A Decimal with scale 31 was written." );
+
+    csv_write.Close();
+
+    jay::util::CSVwrite::Flags flags = jay::util::CSVwrite::truncate;
+    if( getrand<bool>() )
+    {
+        flags |= jay::util::CSVwrite::minimal_quoting;
+    }
+
+    b = csv_write.Open( filename, flags );
+    DEBUG_IF( ( !b ),
+        "Numbers: Problem opening file " << filename << ": " << csv_write.error_msg );
+
+    for( int i = getrand<int>( 0, max_records ); i > 0; --i )
+    {
+        doubles.push_back( random_double() );
+        decimals.push_back( Decimal( getrand<long long>(), getrand<unsigned>( 0, 30 ) ) );
+        integers.push_back( getrand<long long>() );
+
+        b = csv_write.WriteField( doubles.back() )
+            && csv_write.WriteField( decimals.back() )
+            && csv_write.WriteField( integers.back(), true );
+
+        DEBUG_IF( ( !b ),
+            "Numbers: Problem writing record: " << csv_write.error_msg );
+    }
+
+    b = csv_write.Close();
+    DEBUG_IF( ( !b ),
+        "Numbers: Problem closing: " << csv_write.error_msg );
+
+    jay::util::CSVread csv_read;
+    b = csv_read.Open( filename );
+    DEBUG_IF( ( !b ),
+        "Numbers: Problem opening file " << filename << ": " << csv_read.error_msg );
+
+    for( size_t i = 0; i < doubles.size(); ++i )
+    {
+        b = csv_read.ReadRecord();
+        DEBUG_IF( ( !b ),
+            "Numbers: Problem reading record #" << ( i + 1 ) << ": " << csv_read.error_msg );
+
+        DEBUG_IF( ( csv_read.fields.size() != 3 ),
+            "Numbers: Record #" << ( i + 1 ) << " has " << csv_read.fields.size() << " fields." );
+
+        // The double
+        const string &text = csv_read.fields[ 0 ];
+        const double value = doubles[ i ];
+
+        DEBUG_IF( !double_reads_back( text, value ),
+            "Numbers: The double written as " << text << " doesn't read back the same." );
+
+        if( value == value )
+        {
+            DEBUG_IF( ( text.find_first_not_of( "0123456789+-.eEinfINF" ) != string::npos ),
+                "Numbers: The double written as " << text << " has an unexpected character." );
+
+            // One less significant digit must not read back the same.
+            const int digits = significant_digits( text );
+            if( ( digits > 1 ) && isfinite( value ) )
+            {
+                ostringstream shorter;
+                shorter << setprecision( digits - 1 ) << value;
+
+                DEBUG_IF( ( strtod( shorter.str().c_str(), NULL ) == value ),
+                    "Numbers: The double written as " << text << " reads back the same as "
+                        << shorter.str() );
+            }
+        }
+
+        // The Decimal
+        const Decimal &decimal = decimals[ i ];
+        const string expected = decimal_text( decimal );
+
+        DEBUG_IF( ( csv_read.fields[ 1 ] != expected ),
+            "Numbers: Decimal( " << decimal.units << ", " << decimal.scale << " ) was written as "
+                << csv_read.fields[ 1 ] << ", expected " << expected );
+
+        // The long long
+        ostringstream integer;
+        integer << integers[ i ];
+
+        DEBUG_IF( ( csv_read.fields[ 2 ] != integer.str() ),
+            "Numbers: " << integers[ i ] << " was written as " << csv_read.fields[ 2 ] );
+    }
+
+    DEBUG_IF( ( csv_read.ReadRecord() || !csv_read.eof ),
+        "Numbers: More records than expected, or no EOF: " << csv_read.error_msg );
+
+    return true;
+}
+
+
+/* Write random records with CSVwrite::WriteStruct(), each a struct_record of random strings followed
+by a random int, double and Decimal, and read them back. The strings must read back the same and
+the numbers as WriteField() writes them.
+*/
+bool write_struct( const char *filename, const int max_records )
+{
+    jay::util::CSVwrite::Flags flags = jay::util::CSVwrite::truncate;
+    if( getrand<bool>() )
+    {
+        flags |= jay::util::CSVwrite::minimal_quoting;
+    }
+
+    jay::util::CSVwrite csv_write;
+    bool b = csv_write.Open( filename, flags );
+    DEBUG_IF( ( !b ),
+        "Struct: Problem opening file " << filename << ": " << csv_write.error_msg );
+
+    list<vector<string>> strings;
+    vector<struct_record> records;
+
+    for( int i = getrand<int>( 0, max_records ); i > 0; --i )
+    {
+        strings.push_back( vector<string>() );
+        for( int j = getrand<int>( 0, 3 ); j > 0; --j )
+        {
+            string field;
+            for( int k = getrand<int>( 0, 8 ); k > 0; --k )
+            {
+                field += "ab \",\r\n"[ getrand<int>( 0, 6 ) ];
+            }
+
+            strings.back().push_back( field );
+        }
+
+        struct_record record = { &strings.back(), true, getrand<int>(), random_double(),
+            jay::util::CSVwrite::Decimal( getrand<long long>(), getrand<unsigned>( 0, 30 ) ) };
+        records.push_back( record );
+
+        // Maybe terminate the record separately.
+        const bool terminate = getrand<bool>();
+        b = csv_write.WriteStruct( record, terminate )
+            && ( terminate || csv_write.WriteTerminator() );
+        DEBUG_IF( ( !b ),
+            "Struct: Problem writing record: " << csv_write.error_msg );
+    }
+
+    b = csv_write.Close();
+    DEBUG_IF( ( !b ),
+        "Struct: Problem closing: " << csv_write.error_msg );
+
+    jay::util::CSVread csv_read;
+    b = csv_read.Open( filename );
+    DEBUG_IF( ( !b ),
+        "Struct: Problem opening file " << filename << ": " << csv_read.error_msg );
+
+    for( size_t i = 0; i < records.size(); ++i )
+    {
+        const struct_record &record = records[ i ];
+        const vector<string> &fields = *record.fields;
+
+        b = csv_read.ReadRecord();
+        DEBUG_IF( ( !b ),
+            "Struct: Problem reading record #" << ( i + 1 ) << ": " << csv_read.error_msg );
+
+        DEBUG_IF( ( csv_read.fields.size() != ( fields.size() + 3 ) ),
+            "Struct: Record #" << ( i + 1 ) << " has " << csv_read.fields.size() << " fields, "
+                "expected " << ( fields.size() + 3 ) );
+
+        for( size_t j = 0; j < fields.size(); ++j )
+        {
+            DEBUG_IF( ( csv_read.Field( j ) != fields[ j ] ),
+                "Struct: Record #" << ( i + 1 ) << " field #" << ( j + 1 ) << " differs." );
+        }
+
+        ostringstream integer;
+        integer << record.integer;
+
+        const size_t n = fields.size();
+
+        DEBUG_IF( ( csv_read.Field( n ) != integer.str() ),
+            "Struct: The int " << record.integer << " was written as " << csv_read.Field( n ) );
+
+        DEBUG_IF( !double_reads_back( csv_read.Field( n + 1 ), record.real ),
+            "Struct: The double written as " << csv_read.Field( n + 1 )
+                << " doesn't read back the same." );
+
+        DEBUG_IF( ( csv_read.Field( n + 2 ) != decimal_text( record.decimal ) ),
+            "Struct: Decimal( " << record.decimal.units << ", " << record.decimal.scale
+                << " ) was written as " << csv_read.Field( n + 2 ) );
+    }
+
+    DEBUG_IF( ( csv_read.ReadRecord() || !csv_read.eof ),
+        "Struct: More records than expected, or no EOF: " << csv_read.error_msg );
+
+    return true;
+}
+
+
 // no CSVwrite::Close() on fail
 bool write_records(
     const char *filename,
@@ -48,6 +406,8 @@ bool write_records(
     const int max_ramdisk_size,
     const bool process_empty,
     const bool truncate,
+    const bool minimal_quoting,
+    const int gzip_level,
     const list<vector<string>> &records,
     jay::util::CSVwrite &csv_write // INOUT
 )
@@ -56,8 +416,36 @@ bool write_records(
 
     ofstream out_file;
 
+    // The compression setting survives Close() so it's set every time, to 0 if not compressing.
+    bool use_gzip_members = getrand<bool>();
+    if( use_gzip_members )
+    {
+        b = csv_write.SetGzip( gzip_level, getrand<unsigned long long>( 1, max_ramdisk_size ) );
+    }
+    else
+    {
+        b = csv_write.SetGzip( gzip_level );
+    }
+
+    DEBUG_IF( ( b == csv_write.error ),
+        "Logic mismatch on csv_write.SetGzip(). b: " << b << ", csv_write.error: " << csv_write.error );
+
+    DEBUG_IF( ( csv_write.error ),
+        "Problem setting compression: " << csv_write.error_msg );
+
     bool use_association = getrand<bool>();
 
+    // Maybe switch files every so often. The files are joined back together after Close(). Like the
+    // compression the rotation survives Close() so it's set every time, to 0 if not rotating.
+    bool use_rotation = !use_association && !getrand<int>( 0, 3 );
+    b = csv_write.SetRotation( use_rotation ? getrand<unsigned long long>( 1, max_ramdisk_size ) : 0, 0 );
+
+    DEBUG_IF( ( b == csv_write.error ),
+        "Logic mismatch on csv_write.SetRotation(). b: " << b << ", csv_write.error: " << csv_write.error );
+
+    DEBUG_IF( ( csv_write.error ),
+        "Problem setting rotation: " << csv_write.error_msg );
+
     jay::util::CSVwrite::Flags flags = jay::util::CSVwrite::none;
 
     if( process_empty )
@@ -65,6 +453,11 @@ bool write_records(
         flags |= jay::util::CSVwrite::process_empty_records;
     }
 
+    if( minimal_quoting )
+    {
+        flags |= jay::util::CSVwrite::minimal_quoting;
+    }
+
     // Truncate flag may only be passed to Open()
     if( truncate && !use_association )
     {
@@ -104,7 +497,14 @@ bool write_records(
     }
     else
     {
-        if( use_flags )
+        // Maybe write with system calls to a file descriptor instead of through an ofstream.
+        bool use_fd = getrand<bool>();
+
+        if( use_fd )
+        {
+            b = csv_write.OpenFD( filename, flags );
+        }
+        else if( use_flags )
         {
             b = csv_write.Open( filename, flags );
         }
@@ -140,12 +540,55 @@ bool write_records(
         csv_write.WriteUTF8BOM();
     }
 
+    // The names of the files written, in order.
+    vector<string> filenames;
+    filenames.push_back( csv_write.filename );
+
     for( list<vector<string>>::const_iterator it = records.begin(); it != records.end(); ++it ) // for each record
     {
         bool use_WriteRecord = getrand<bool>();
         bool use_WriteTerminator = ( it->size() ? getrand<bool>() : process_empty );
 
-        if( use_WriteRecord )
+        // Maybe write the record from a range, of strings or of pointer and length pairs, or as a
+        // struct. An empty struct would still be a record so it's only used if those are written.
+        int use_range = getrand<int>( 0, 3 );
+
+        if( use_WriteRecord && ( use_range == 3 ) && ( it->size() || process_empty ) )
+        {
+            struct_record record = { &*it, false, 0, 0.0, jay::util::CSVwrite::Decimal( 0, 0 ) };
+            b = csv_write.WriteStruct( record, !use_WriteTerminator );
+
+            DEBUG_IF( ( b == csv_write.error ),
+                "Logic mismatch on csv_write.WriteStruct(). b: " << b << ", csv_write.error: " << csv_write.error );
+
+            DEBUG_IF( ( csv_write.error ),
+                "Problem writing struct: " << csv_write.error_msg );
+        }
+        else if( use_WriteRecord && ( use_range == 1 || use_range == 2 ) )
+        {
+            vector<pair<const char *, size_t>> pairs;
+
+            for( size_t i = 0; i < it->size(); ++i )
+            {
+                pairs.push_back( make_pair( (*it)[ i ].data(), (*it)[ i ].size() ) );
+            }
+
+            if( use_range == 1 )
+            {
+                b = csv_write.WriteRecord( it->begin(), it->end(), !use_WriteTerminator );
+            }
+            else
+            {
+                b = csv_write.WriteRecord( pairs.begin(), pairs.end(), !use_WriteTerminator );
+            }
+
+            DEBUG_IF( ( b == csv_write.error ),
+                "Logic mismatch on csv_write.WriteRecord() for a range. b: " << b << ", csv_write.error: " << csv_write.error );
+
+            DEBUG_IF( ( csv_write.error ),
+                "Problem writing record from a range: " << csv_write.error_msg );
+        }
+        else if( use_WriteRecord )
         {
             if( use_WriteTerminator )
             {
@@ -166,7 +609,22 @@ bool write_records(
         {
             for( size_t i = 0; i < it->size(); ++i )
             {
-                if( ( ( i + 1 ) == it->size() ) && !use_WriteTerminator )
+                const bool terminate = ( ( i + 1 ) == it->size() ) && !use_WriteTerminator;
+
+                // Maybe write the field from a pointer and length instead of a string. The length
+                // may be an int, which mustn't be ambiguous with WriteField( field, terminate ).
+                if( getrand<bool>() )
+                {
+                    b = csv_write.WriteField( (*it)[ i ].data(), (*it)[ i ].size(), terminate );
+                }
+                else if( getrand<bool>() )
+                {
+                    const int size = (int)(*it)[ i ].size();
+
+                    b = terminate ? csv_write.WriteField( (*it)[ i ].data(), size, true )
+                        : csv_write.WriteField( (*it)[ i ].data(), size );
+                }
+                else if( terminate )
                 {
                     b = csv_write.WriteField( (*it)[ i ], true );
                 }
@@ -193,11 +651,447 @@ bool write_records(
             DEBUG_IF( ( csv_write.error ),
                 "Problem writing terminator: " << csv_write.error_msg );
         }
+
+        // Maybe write the buffer to the file now instead of waiting for it to be full.
+        bool use_flush = !getrand<int>( 0, 15 );
+        if( use_flush )
+        {
+            b = csv_write.Flush();
+
+            DEBUG_IF( ( b == csv_write.error ),
+                "Logic mismatch on csv_write.Flush(). b: " << b << ", csv_write.error: " << csv_write.error );
+
+            DEBUG_IF( ( csv_write.error ),
+                "Problem flushing: " << csv_write.error_msg );
+        }
+
+        if( csv_write.filename != filenames.back() )
+        {
+            DEBUG_IF( ( !use_rotation ),
+                "The filename changed without rotation: " << csv_write.filename );
+
+            filenames.push_back( csv_write.filename );
+        }
     }
 
     b = csv_write.Close();
     DEBUG_IF( ( b == csv_write.error ),
         "Logic mismatch on csv_write.Close(). b: " << b << ", csv_write.error: " << csv_write.error );
 
-    return b;
+    if( !b )
+        return false;
+
+    // Append the rotated files to the first, so it has all the records.
+    for( size_t i = 1; i < filenames.size(); ++i )
+    {
+        ifstream in_file( filenames[ i ].c_str(), ios::binary );
+        ofstream out_file( filename, ios::app | ios::binary );
+
+        // A file is only switched to for a record, so none is empty.
+        DEBUG_IF( ( in_file.peek() == char_traits<char>::eof() ),
+            "Rotated file " << filenames[ i ] << " is empty." );
+
+        out_file << in_file.rdbuf();
+
+        in_file.close();
+        out_file.close();
+
+        DEBUG_IF( ( !in_file || !out_file ),
+            "Problem appending rotated file " << filenames[ i ] << " to " << filename );
+
+        DEBUG_IF( ( remove( filenames[ i ].c_str() ) ),
+            "Problem removing rotated file " << filenames[ i ] );
+    }
+
+    return true;
+}
+
+
+/* Append random records to a file that has some already, switching files with a header and maybe a
+UTF-8 BOM. The size of the file before counts toward the first switch. A file from before with the
+name of the first rotated file must be skipped rather than appended to. Each rotated file must start
+with the header and have at least one record after it.
+*/
+bool write_rotation( const char *filename, const int max_bytes )
+{
+    const string base = string( filename ) + ".rotation.csv";
+    const string stale = string( filename ) + ".rotation.1.csv";
+
+    list<vector<string>> records;
+    for( int i = getrand<int>( 0, 3 ); i > 0; --i )
+    {
+        records.push_back( vector<string>( 1, "old" ) );
+    }
+
+    {
+        ofstream out_file( base.c_str(), ios::trunc | ios::binary );
+        for( size_t i = 0; i < records.size(); ++i )
+        {
+            out_file << "old\n";
+        }
+
+        ofstream stale_file( stale.c_str(), ios::trunc | ios::binary );
+        stale_file << "stale\n";
+
+        DEBUG_IF( ( !out_file || !stale_file ),
+            "Rotation: Problem writing files " << base << " and " << stale );
+    }
+
+    const uint64_t old_size = records.size() * 4;
+    const uint64_t rotation_bytes = getrand<uint64_t>( 1, max_bytes );
+    const bool utf8bom = getrand<bool>();
+
+    vector<string> header;
+    header.push_back( "h1" );
+    header.push_back( "h2" );
+
+    jay::util::CSVwrite csv_write;
+    bool b = csv_write.SetRotation( rotation_bytes, 0, header, utf8bom );
+    DEBUG_IF( ( !b ),
+        "Rotation: Problem setting rotation: " << csv_write.error_msg );
+
+    // Append, as a stream or as a file descriptor.
+    b = getrand<bool>() ? csv_write.OpenFD( base ) : csv_write.Open( base );
+    DEBUG_IF( ( !b ),
+        "Rotation: Problem opening file " << base << ": " << csv_write.error_msg );
+
+    vector<string> filenames( 1, base );
+
+    for( int i = getrand<int>( 1, 20 ), n = 1; i > 0; --i, ++n )
+    {
+        vector<string> record;
+        for( int j = getrand<int>( 1, 3 ); j > 0; --j )
+        {
+            record.push_back( string( getrand<size_t>( 0, 8 ), (char)getrand<int>( 'a', 'z' ) ) );
+        }
+
+        b = csv_write.WriteRecord( record );
+        DEBUG_IF( ( !b ),
+            "Rotation: Problem writing record: " << csv_write.error_msg );
+
+        // The first record is written to the next file only if the file was big enough before.
+        const bool switched = ( csv_write.filename != base );
+        DEBUG_IF( ( ( n == 1 ) && ( switched != ( old_size >= rotation_bytes ) ) ),
+            "Rotation: The first switch didn't count the " << old_size << " bytes in the file." );
+
+        if( csv_write.filename != filenames.back() )
+        {
+            DEBUG_IF( ( csv_write.filename == stale ),
+                "Rotation: A rotated file that already existed was reused: " << stale );
+
+            filenames.push_back( csv_write.filename );
+            records.push_back( header );
+        }
+
+        records.push_back( record );
+    }
+
+    b = csv_write.Close();
+    DEBUG_IF( ( !b ),
+        "Rotation: Problem closing: " << csv_write.error_msg );
+
+    // Read the files back, the rotated files starting with their header, so that all together they
+    // have the records written.
+    list<vector<string>> output;
+    for( size_t i = 0; i < filenames.size(); ++i )
+    {
+        jay::util::CSVread csv_read;
+        b = csv_read.Open( filenames[ i ] );
+        DEBUG_IF( ( !b ),
+            "Rotation: Problem opening file " << filenames[ i ] << ": " << csv_read.error_msg );
+
+        size_t count = 0;
+        while( csv_read.ReadRecord() )
+        {
+            output.push_back( vector<string>() );
+            csv_read.ReleaseFields( output.back() );
+            ++count;
+        }
+
+        DEBUG_IF( ( !csv_read.eof || ( csv_read.record_num != csv_read.end_record_num ) ),
+            "Rotation: Not all records in " << filenames[ i ] << " were read: "
+                << csv_read.error_msg );
+
+        DEBUG_IF( ( i && ( csv_read.has_utf8_bom != utf8bom ) ),
+            "Rotation: Rotated file " << filenames[ i ] << " has_utf8_bom "
+                << csv_read.has_utf8_bom );
+
+        DEBUG_IF( ( i && ( count < 2 ) ),
+            "Rotation: Rotated file " << filenames[ i ] << " has no records after the header." );
+
+        csv_read.Close();
+        remove( filenames[ i ].c_str() );
+    }
+
+    DEBUG_IF( ( output != records ),
+        "Rotation: The records read back differ." );
+
+    ifstream stale_file( stale.c_str(), ios::binary );
+    string stale_text( ( istreambuf_iterator<char>( stale_file ) ), istreambuf_iterator<char>() );
+    stale_file.close();
+    remove( stale.c_str() );
+
+    DEBUG_IF( ( stale_text != "stale\n" ),
+        "Rotation: The file from before was changed: " << stale_text );
+
+    return true;
+}
+
+
+#ifdef STRESSTEST_THREADS
+// Write the records with CSVparallelwrite, in small batches and few of them so that the batches
+// have to wait for the workers and the output.
+bool write_parallel(
+    const char *filename,
+    const bool utf8bom,
+    const bool process_empty,
+    const bool minimal_quoting,
+    const string &delimiter,
+    const string &terminator,
+    const list<vector<string>> &records
+)
+{
+    jay::util::CSVwrite csv_write;
+    csv_write.delimiter = delimiter;
+    csv_write.terminator = terminator;
+
+    jay::util::CSVwrite::Flags flags = jay::util::CSVwrite::truncate;
+
+    if( process_empty )
+    {
+        flags |= jay::util::CSVwrite::process_empty_records;
+    }
+
+    if( minimal_quoting )
+    {
+        flags |= jay::util::CSVwrite::minimal_quoting;
+    }
+
+    bool b = csv_write.Open( filename, flags );
+    DEBUG_IF( ( !b ),
+        "Parallel: Problem opening file " << filename << ": " << csv_write.error_msg );
+
+    if( utf8bom )
+    {
+        csv_write.WriteUTF8BOM();
+    }
+
+    jay::util::CSVparallelwrite parallel( csv_write,
+        getrand<size_t>( 1, 4 ), getrand<size_t>( 0, 8 ) );
+
+    jay::util::CSVparallelwrite::Batch batch;
+    size_t batch_size = getrand<size_t>( 1, 64 );
+
+    for( list<vector<string>>::const_iterator it = records.begin(); it != records.end(); ++it )
+    {
+        batch.push_back( *it );
+
+        if( batch.size() == batch_size )
+        {
+            b = parallel.Write( batch );
+            DEBUG_IF( ( !b ),
+                "Parallel: Problem writing batch." );
+
+            DEBUG_IF( ( !batch.empty() ),
+                "Parallel: The batch wasn't emptied." );
+        }
+    }
+
+    b = parallel.Write( batch ) && parallel.Finish();
+    DEBUG_IF( ( !b ),
+        "Parallel: Problem writing records: " << csv_write.error_msg );
+
+    b = csv_write.Close();
+    DEBUG_IF( ( !b ),
+        "Parallel: Problem closing: " << csv_write.error_msg );
+
+    return true;
+}
+#endif
+
+
+#ifdef JAY_UTIL_CSV_ZLIB
+// Decompress a file written with CSVwrite::SetGzip() in place. All its gzip members are decompressed.
+bool gunzip_file( const char *filename )
+{
+    gzFile in = gzopen( filename, "rb" );
+    DEBUG_IF( ( !in ),
+        "Gzip: Problem opening file " << filename );
+
+    string data;
+    char buf[ 65536 ];
+    int count;
+
+    while( ( count = gzread( in, buf, sizeof buf ) ) > 0 )
+    {
+        data.append( buf, count );
+    }
+
+    int err = Z_OK;
+    const string msg = gzerror( in, &err );
+    gzclose( in );
+
+    DEBUG_IF( ( count < 0 ),
+        "Gzip: Problem decompressing file " << filename << ": " << msg );
+
+    ofstream out( filename, ios::trunc | ios::binary );
+    out.write( data.data(), data.size() );
+    out.close();
+
+    DEBUG_IF( ( !out ),
+        "Gzip: Problem writing decompressed file " << filename );
+
+    return true;
+}
+#endif
+
+
+#ifdef STRESSTEST_THREADS
+// Write the records with CSVasyncwrite, in small blocks so that the writer has to wait for the I/O
+// thread.
+bool write_async(
+    const char *filename,
+    const bool utf8bom,
+    const bool process_empty,
+    const bool minimal_quoting,
+    const string &delimiter,
+    const string &terminator,
+    const list<vector<string>> &records
+)
+{
+    jay::util::CSVasyncwrite csv_write;
+    csv_write.delimiter = delimiter;
+    csv_write.terminator = terminator;
+
+    bool b = csv_write.SetBlocks( getrand<size_t>( 1, 64 ), getrand<size_t>( 2, 4 ) );
+    DEBUG_IF( ( !b ),
+        "Async: Problem setting blocks: " << csv_write.error_msg );
+
+    jay::util::CSVwrite::Flags flags = jay::util::CSVwrite::truncate;
+
+    if( process_empty )
+    {
+        flags |= jay::util::CSVwrite::process_empty_records;
+    }
+
+    if( minimal_quoting )
+    {
+        flags |= jay::util::CSVwrite::minimal_quoting;
+    }
+
+    b = csv_write.Open( filename, flags );
+    DEBUG_IF( ( !b ),
+        "Async: Problem opening file " << filename << ": " << csv_write.error_msg );
+
+    if( utf8bom )
+    {
+        csv_write.WriteUTF8BOM();
+    }
+
+    for( list<vector<string>>::const_iterator it = records.begin(); it != records.end(); ++it )
+    {
+        b = csv_write.WriteRecord( *it );
+        DEBUG_IF( ( !b ),
+            "Async: Problem writing record: " << csv_write.error_msg );
+
+        if( !getrand<int>( 0, 15 ) )
+        {
+            b = csv_write.Flush();
+            DEBUG_IF( ( !b ),
+                "Async: Problem flushing: " << csv_write.error_msg );
+        }
+    }
+
+    b = csv_write.Close();
+    DEBUG_IF( ( !b ),
+        "Async: Problem closing: " << csv_write.error_msg );
+
+    return true;
+}
+
+
+// Write the records with CSVdurablewrite, committing often and waiting on some of the tickets. If
+// there's a UTF-8 BOM it's written first and the records are appended to it.
+bool write_durable(
+    const char *filename,
+    const bool utf8bom,
+    const bool process_empty,
+    const bool minimal_quoting,
+    const string &delimiter,
+    const string &terminator,
+    const list<vector<string>> &records
+)
+{
+    jay::util::CSVdurablewrite csv_write;
+    csv_write.delimiter = delimiter;
+    csv_write.terminator = terminator;
+
+    bool b = csv_write.SetCommit( getrand<size_t>( 0, 4096 ), getrand<unsigned>( 0, 2 ) );
+    DEBUG_IF( ( !b ),
+        "Durable: Problem setting commit: " << csv_write.error_msg );
+
+    jay::util::CSVwrite::Flags flags = jay::util::CSVwrite::none;
+
+    if( utf8bom )
+    {
+        ofstream out_file( filename, ios::trunc | ios::binary );
+        out_file.write( "\xEF\xBB\xBF", 3 );
+        out_file.close();
+
+        DEBUG_IF( ( !out_file ),
+            "Durable: Problem writing UTF-8 BOM to file " << filename );
+    }
+    else
+    {
+        flags |= jay::util::CSVwrite::truncate;
+    }
+
+    if( process_empty )
+    {
+        flags |= jay::util::CSVwrite::process_empty_records;
+    }
+
+    if( minimal_quoting )
+    {
+        flags |= jay::util::CSVwrite::minimal_quoting;
+    }
+
+    b = csv_write.Open( filename, flags );
+    DEBUG_IF( ( !b ),
+        "Durable: Problem opening file " << filename << ": " << csv_write.error_msg );
+
+    jay::util::CSVdurablewrite::Ticket previous = 0;
+
+    for( list<vector<string>>::const_iterator it = records.begin(); it != records.end(); ++it )
+    {
+        jay::util::CSVdurablewrite::Ticket ticket = 0;
+        b = csv_write.WriteRecord( *it, &ticket );
+        DEBUG_IF( ( !b ),
+            "Durable: Problem writing record: " << csv_write.error_msg );
+
+        DEBUG_IF( ( ticket < previous ),
+            "Durable: Ticket " << ticket << " < previous ticket " << previous );
+
+        previous = ticket;
+
+        if( !getrand<int>( 0, 15 ) )
+        {
+            b = csv_write.WaitDurable( ticket );
+            DEBUG_IF( ( !b ),
+                "Durable: Problem waiting for ticket " << ticket );
+        }
+        else if( !getrand<int>( 0, 31 ) )
+        {
+            b = csv_write.Commit();
+            DEBUG_IF( ( !b ),
+                "Durable: Problem committing: " << csv_write.error_msg );
+        }
+    }
+
+    b = csv_write.Close();
+    DEBUG_IF( ( !b ),
+        "Durable: Problem closing: " << csv_write.error_msg );
+
+    return true;
 }
+#endif
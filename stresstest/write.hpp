@@ -27,6 +27,8 @@ along with jay::util. If not, see <http://www.gnu.org/licenses/>.
 #include <string>
 #include <vector>
 
+#include "util.hpp"
+
 #include "CSV.hpp"
 
 bool write_records(
@@ -35,8 +37,63 @@ bool write_records(
     const int max_ramdisk_size,
     const bool process_empty,
     const bool truncate,
+    const bool minimal_quoting,
+    const int gzip_level,
     const std::list<std::vector<std::string>> &records,
     jay::util::CSVwrite &csv_write // INOUT
 );
 
+bool write_numbers(
+    const char *filename,
+    const int max_records
+);
+
+bool write_struct(
+    const char *filename,
+    const int max_records
+);
+
+bool write_rotation(
+    const char *filename,
+    const int max_bytes
+);
+
+#ifdef STRESSTEST_THREADS
+bool write_parallel(
+    const char *filename,
+    const bool utf8bom,
+    const bool process_empty,
+    const bool minimal_quoting,
+    const std::string &delimiter,
+    const std::string &terminator,
+    const std::list<std::vector<std::string>> &records
+);
+#endif
+
+#ifdef JAY_UTIL_CSV_ZLIB
+bool gunzip_file( const char *filename );
+#endif
+
+#ifdef STRESSTEST_THREADS
+bool write_async(
+    const char *filename,
+    const bool utf8bom,
+    const bool process_empty,
+    const bool minimal_quoting,
+    const std::string &delimiter,
+    const std::string &terminator,
+    const std::list<std::vector<std::string>> &records
+);
+
+bool write_durable(
+    const char *filename,
+    const bool utf8bom,
+    const bool process_empty,
+    const bool minimal_quoting,
+    const std::string &delimiter,
+    const std::string &terminator,
+    const std::list<std::vector<std::string>> &records
+);
+#endif
+
 #endif // STRESSTEST_WRITE_